@@ -4,16 +4,17 @@ INCLUDEPATH += . src
 QT += core gui widgets
 CONFIG += c++11
 
+include(src/core.pri)
+
 HEADERS += \
-    src/commands.h \
     src/compositetoolswidget.h \
     src/compositewidget.h \
     src/mainwindow.h \
     src/paletteview.h \
     src/partlist.h \
     src/partwidget.h \
-    src/projectmodel.h \
     src/resizemodedialog.h \
+    src/assettreemodel.h \
     src/assettreewidget.h \
     src/modelistwidget.h \
     src/drawingtools.h \
@@ -21,7 +22,14 @@ HEADERS += \
     src/animationwidget.h \
     src/spritezoomwidget.h \
     src/optionswidget.h \
-    src/zip.h
+    src/dropshadow.h \
+    src/animationclock.h \
+    src/viewstats.h \
+    src/projectstatswidget.h \
+    src/spritebrowser.h \
+    src/autosave.h \
+    src/savetask.h \
+    src/pixelcanvasitem.h
 
 FORMS += \
     src/compositetoolswidget.ui \
@@ -35,7 +43,6 @@ FORMS += \
     src/optionswidget.ui
 
 SOURCES += \
-    src/commands.cpp \
     src/compositetoolswidget.cpp \
     src/compositewidget.cpp \
     src/main.cpp \
@@ -43,8 +50,8 @@ SOURCES += \
     src/paletteview.cpp \
     src/partlist.cpp \
     src/partwidget.cpp \
-    src/projectmodel.cpp \
     src/resizemodedialog.cpp \
+    src/assettreemodel.cpp \
     src/assettreewidget.cpp \
     src/modelistwidget.cpp \
     src/drawingtools.cpp \
@@ -52,7 +59,14 @@ SOURCES += \
     src/animationwidget.cpp \
     src/spritezoomwidget.cpp \
     src/optionswidget.cpp \
-    src/zip.cpp
+    src/dropshadow.cpp \
+    src/animationclock.cpp \
+    src/viewstats.cpp \
+    src/projectstatswidget.cpp \
+    src/spritebrowser.cpp \
+    src/autosave.cpp \
+    src/savetask.cpp \
+    src/pixelcanvasitem.cpp
 
 RESOURCES += \
     icons.qrc
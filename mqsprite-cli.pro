@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = mqsprite-cli
+INCLUDEPATH += . src
+# NB: widgets is only needed for QUndoCommand, the cli never creates a window
+QT += core gui widgets
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+include(src/core.pri)
+
+SOURCES += \
+    src/cli.cpp
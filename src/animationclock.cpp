@@ -0,0 +1,96 @@
+#include "animationclock.h"
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Deadlines within this much of each other are serviced by the same wake-up
+static const qint64 DeadlineSlackNs = 1000000;
+
+AnimationClock* AnimationClock::Instance(){
+    static AnimationClock* sInstance = nullptr;
+    if (sInstance == nullptr){
+        sInstance = new AnimationClock(QCoreApplication::instance());
+    }
+    return sInstance;
+}
+
+AnimationClock::AnimationClock(QObject* parent):QObject(parent){
+    mElapsed.start();
+    mTimer.setSingleShot(true);
+    mTimer.setTimerType(Qt::PreciseTimer);
+    connect(&mTimer, SIGNAL(timeout()), this, SLOT(tick()));
+}
+
+void AnimationClock::start(QObject* client, TickFunction tick){
+    if (!mClients.contains(client)){
+        connect(client, SIGNAL(destroyed(QObject*)), this, SLOT(clientDestroyed(QObject*)));
+    }
+    const qint64 now = mElapsed.nsecsElapsed();
+    Client c;
+    c.tick = tick;
+    c.lastTickNs = now;
+    c.deadlineNs = now; // Tick straight away to get the first deadline
+    mClients.insert(client, c);
+    schedule();
+}
+
+void AnimationClock::stop(QObject* client){
+    if (mClients.remove(client) > 0){
+        disconnect(client, SIGNAL(destroyed(QObject*)), this, SLOT(clientDestroyed(QObject*)));
+        schedule();
+    }
+}
+
+void AnimationClock::wake(QObject* client){
+    auto it = mClients.find(client);
+    if (it != mClients.end()){
+        it->deadlineNs = mElapsed.nsecsElapsed();
+        schedule();
+    }
+}
+
+void AnimationClock::clientDestroyed(QObject* client){
+    mClients.remove(client);
+    schedule();
+}
+
+void AnimationClock::tick(){
+    TRACE_SCOPE("AnimationClock::tick");
+    const qint64 now = mElapsed.nsecsElapsed();
+
+    // NB: A client may start or stop clients while ticking, so work on a snapshot
+    const QList<QObject*> clients = mClients.keys();
+    for (QObject* object: clients){
+        auto it = mClients.find(object);
+        if (it == mClients.end() || it->deadlineNs > now + DeadlineSlackNs) continue;
+
+        const double dt = (now - it->lastTickNs) / 1e9;
+        it->lastTickNs = now;
+        const TickFunction tick = it->tick;
+        const double next = tick(dt);
+
+        it = mClients.find(object);
+        if (it == mClients.end()) continue;
+        it->deadlineNs = next < 0 ? std::numeric_limits<qint64>::max() : now + (qint64) std::ceil(next * 1e9);
+    }
+    schedule();
+}
+
+void AnimationClock::schedule(){
+    qint64 deadline = std::numeric_limits<qint64>::max();
+    for (const Client& c: mClients){
+        deadline = std::min(deadline, c.deadlineNs);
+    }
+
+    if (deadline == std::numeric_limits<qint64>::max()){
+        mTimer.stop();
+        return;
+    }
+
+    const qint64 now = mElapsed.nsecsElapsed();
+    const qint64 waitMs = std::max<qint64>(0, (deadline - now + 999999) / 1000000);
+    mTimer.start((int) std::min<qint64>(waitMs, std::numeric_limits<int>::max()));
+}
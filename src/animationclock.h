@@ -0,0 +1,48 @@
+#ifndef ANIMATIONCLOCK_H
+#define ANIMATIONCLOCK_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QTimer>
+#include <functional>
+
+// A single, application-wide clock that drives all animation previews.
+// Each playing client supplies a tick function that is called with the real time
+// (in seconds) since its last tick, and returns the time until it next needs to be
+// ticked (or a negative number if it doesn't need waking up again).
+// The clock sleeps until the earliest of those deadlines, so idle windows and
+// slow animations cost nothing between frames.
+class AnimationClock : public QObject {
+    Q_OBJECT
+public:
+    typedef std::function<double(double)> TickFunction;
+
+    static AnimationClock* Instance();
+
+    void start(QObject* client, TickFunction tick);
+    void stop(QObject* client);
+    void wake(QObject* client); // Tick client as soon as possible, e.g., if its playback rate changed
+    bool isRunning(QObject* client) const {return mClients.contains(client);}
+
+protected:
+    explicit AnimationClock(QObject* parent = nullptr);
+    void schedule();
+
+protected slots:
+    void tick();
+    void clientDestroyed(QObject* client);
+
+protected:
+    struct Client {
+        TickFunction tick;
+        qint64 lastTickNs;
+        qint64 deadlineNs;
+    };
+
+    QElapsedTimer mElapsed;
+    QTimer mTimer;
+    QMap<QObject*, Client> mClients;
+};
+
+#endif // ANIMATIONCLOCK_H
@@ -0,0 +1,165 @@
+#include "assetindex.h"
+#include "trace.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QStringList>
+
+namespace {
+
+quint64 Trigram(const QChar* c){
+    return ((quint64) c[0].unicode() << 32) | ((quint64) c[1].unicode() << 16) | (quint64) c[2].unicode();
+}
+
+void AddTrigrams(const QString& term, QSet<quint64>* trigrams){
+    for (int i = 0; i + 3 <= term.size(); i++){
+        trigrams->insert(Trigram(term.constData() + i));
+    }
+}
+
+void AddJsonTerms(const QJsonValue& value, QStringList* terms){
+    switch (value.type()){
+    case QJsonValue::Object: {
+        const QJsonObject obj = value.toObject();
+        for (auto it = obj.begin(); it != obj.end(); ++it){
+            terms->append(it.key());
+            AddJsonTerms(it.value(), terms);
+        }
+        break;
+    }
+    case QJsonValue::Array:
+        for (const QJsonValue& v: value.toArray()) AddJsonTerms(v, terms);
+        break;
+    case QJsonValue::String: terms->append(value.toString()); break;
+    case QJsonValue::Double: terms->append(QString::number(value.toDouble())); break;
+    case QJsonValue::Bool: terms->append(value.toBool() ? "true" : "false"); break;
+    default: break;
+    }
+}
+
+void AddPropertyTerms(const QString& properties, const PropertiesCache& cache, QStringList* terms){
+    if (cache.error.isEmpty()){
+        AddJsonTerms(cache.object, terms);
+    }
+    else {
+        // Still findable while the properties are being edited
+        terms->append(properties);
+    }
+}
+
+}
+
+QString AssetIndex::SearchableText(AssetRef ref){
+    Asset* asset = PM()->getAsset(ref);
+    if (asset == nullptr) return QString();
+
+    QStringList terms;
+    terms.append(asset->name);
+    if (ref.type == AssetType::Part){
+        Part* part = PM()->getPart(ref);
+        terms.append(part->modes.keys());
+        AddPropertyTerms(part->properties, ParseProperties(part), &terms);
+    }
+    else if (ref.type == AssetType::Composite){
+        Composite* comp = PM()->getComposite(ref);
+        AddPropertyTerms(comp->properties, ParseProperties(comp), &terms);
+    }
+
+    // NB: Terms are one per line, so a search never matches across two terms
+    for (QString& term: terms) term.replace('\n', ' ');
+    return terms.join('\n').toLower();
+}
+
+void AssetIndex::invalidate(AssetRef ref){
+    if (!mAllDirty) mDirty.insert(ref);
+}
+
+void AssetIndex::invalidateAll(){
+    mAllDirty = true;
+    mDirty.clear();
+}
+
+int AssetIndex::size(){
+    update();
+    return mEntries.size();
+}
+
+QSet<AssetRef> AssetIndex::find(const QString& text){
+    TRACE_SCOPE("AssetIndex::find");
+    update();
+
+    QSet<AssetRef> result;
+    const QString query = text.toLower();
+    if (query.isEmpty()){
+        for (auto it = mEntries.begin(); it != mEntries.end(); ++it) result.insert(it.key());
+        return result;
+    }
+
+    if (query.size() < 3){
+        // Too short for a trigram, but checking every entry is still cheap
+        for (auto it = mEntries.begin(); it != mEntries.end(); ++it){
+            if (it.value().text.contains(query)) result.insert(it.key());
+        }
+        return result;
+    }
+
+    // Only the assets with the rarest trigram of the query can match
+    const QSet<AssetRef>* candidates = nullptr;
+    for (int i = 0; i + 3 <= query.size(); i++){
+        auto it = mPostings.find(Trigram(query.constData() + i));
+        if (it == mPostings.end()) return result;
+        if (candidates == nullptr || it.value().size() < candidates->size()) candidates = &it.value();
+    }
+    for (const AssetRef& ref: *candidates){
+        if (mEntries.value(ref).text.contains(query)) result.insert(ref);
+    }
+    return result;
+}
+
+void AssetIndex::update(){
+    if (mAllDirty){
+        TRACE_SCOPE("AssetIndex::rebuild");
+        mEntries.clear();
+        mPostings.clear();
+        for (const AssetRef& ref: PM()->folders.keys()) addEntry(ref);
+        for (const AssetRef& ref: PM()->composites.keys()) addEntry(ref);
+        for (const AssetRef& ref: PM()->parts.keys()) addEntry(ref);
+        mAllDirty = false;
+    }
+    else {
+        for (const AssetRef& ref: mDirty){
+            removeEntry(ref);
+            addEntry(ref);
+        }
+    }
+    mDirty.clear();
+}
+
+void AssetIndex::removeEntry(AssetRef ref){
+    auto it = mEntries.find(ref);
+    if (it == mEntries.end()) return;
+    for (quint64 trigram: it.value().trigrams){
+        auto pit = mPostings.find(trigram);
+        if (pit == mPostings.end()) continue;
+        pit.value().remove(ref);
+        if (pit.value().isEmpty()) mPostings.erase(pit);
+    }
+    mEntries.erase(it);
+}
+
+void AssetIndex::addEntry(AssetRef ref){
+    if (!PM()->hasAsset(ref)) return; // deleted
+
+    Entry entry;
+    entry.text = SearchableText(ref);
+
+    QSet<quint64> trigrams;
+    for (const QString& term: entry.text.split('\n')) AddTrigrams(term, &trigrams);
+    entry.trigrams.reserve(trigrams.size());
+    for (quint64 trigram: trigrams){
+        entry.trigrams.push_back(trigram);
+        mPostings[trigram].insert(ref);
+    }
+    mEntries.insert(ref, entry);
+}
@@ -0,0 +1,47 @@
+#ifndef ASSETINDEX_H
+#define ASSETINDEX_H
+
+#include "projectmodel.h"
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+// A trigram index over the searchable text of every asset: its name, the names of
+// its modes and the keys and values of its properties. Commands invalidate the
+// assets they change and the index catches up on the next find(), so filtering
+// the asset list doesn't have to look at every asset on each keystroke.
+// Access it with PM()->searchIndex()
+class AssetIndex {
+public:
+    void invalidate(AssetRef ref);
+    void invalidateAll();
+
+    // The assets whose searchable text contains text (case insensitive)
+    // Everything matches an empty text
+    QSet<AssetRef> find(const QString& text);
+
+    // Number of assets in the index
+    int size();
+
+    // The lower case terms of an asset, one per line (empty if there is no asset)
+    static QString SearchableText(AssetRef ref);
+
+private:
+    struct Entry {
+        QString text;
+        QVector<quint64> trigrams;
+    };
+
+    void update();
+    void removeEntry(AssetRef ref);
+    void addEntry(AssetRef ref);
+
+    QHash<AssetRef, Entry> mEntries;
+    QHash<quint64, QSet<AssetRef>> mPostings; // trigram -> assets
+    QSet<AssetRef> mDirty;
+    bool mAllDirty = true;
+};
+
+#endif // ASSETINDEX_H
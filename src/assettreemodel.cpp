@@ -0,0 +1,338 @@
+#include "assettreemodel.h"
+#include "commands.h"
+#include "imageops.h"
+#include "trace.h"
+
+#include <QPixmap>
+#include <algorithm>
+
+static int TypeOrder(AssetType type){
+    switch (type){
+    case AssetType::Folder: return 0;
+    case AssetType::Composite: return 1;
+    case AssetType::Part: return 2;
+    default: return 3;
+    }
+}
+
+AssetTreeModel::AssetTreeModel(QObject* parent):QAbstractItemModel(parent){
+}
+
+AssetTreeModel::~AssetTreeModel(){
+    for (Node* child: mRoot.children) deleteNode(child);
+}
+
+bool AssetTreeModel::lessThan(const Node* a, const Node* b){
+    const int ta = TypeOrder(a->ref.type);
+    const int tb = TypeOrder(b->ref.type);
+    if (ta != tb) return ta < tb;
+    if (a->name != b->name) return a->name < b->name;
+    return a->ref.id < b->ref.id;
+}
+
+AssetTreeModel::Node* AssetTreeModel::node(const QModelIndex& index) const {
+    if (!index.isValid()) return const_cast<Node*>(&mRoot);
+    return static_cast<Node*>(index.internalPointer());
+}
+
+QModelIndex AssetTreeModel::nodeIndex(Node* n) const {
+    if (n == nullptr || n == &mRoot) return QModelIndex();
+    return createIndex(n->parent->children.indexOf(n), 0, n);
+}
+
+AssetRef AssetTreeModel::assetRef(const QModelIndex& index) const {
+    return index.isValid() ? node(index)->ref : AssetRef();
+}
+
+QModelIndex AssetTreeModel::assetIndex(AssetRef ref) const {
+    return nodeIndex(mNodes.value(ref, nullptr));
+}
+
+AssetTreeModel::Node* AssetTreeModel::parentNode(AssetRef ref){
+    Asset* asset = PM()->getAsset(ref);
+    if (asset == nullptr) return nullptr;
+    if (asset->parent.isNull()) return &mRoot;
+    return mNodes.value(asset->parent, nullptr); // null if the folder isn't shown
+}
+
+AssetTreeModel::Node* AssetTreeModel::createNode(AssetRef ref){
+    Node* n = new Node();
+    n->ref = ref;
+    n->name = PM()->getAsset(ref)->name;
+    mNodes.insert(ref, n);
+
+    if (ref.type == AssetType::Folder){
+        // Bring back anything that was in this folder (e.g., undoing a delete)
+        auto addChildren = [&](const QList<AssetRef>& refs){
+            for (const AssetRef& childRef: refs){
+                if (!mNodes.contains(childRef) && PM()->getAsset(childRef)->parent == ref){
+                    Node* child = createNode(childRef);
+                    child->parent = n;
+                    n->children.push_back(child);
+                }
+            }
+        };
+        addChildren(PM()->folders.keys());
+        addChildren(PM()->composites.keys());
+        addChildren(PM()->parts.keys());
+        std::sort(n->children.begin(), n->children.end(), lessThan);
+    }
+    return n;
+}
+
+void AssetTreeModel::deleteNode(Node* n){
+    for (Node* child: n->children) deleteNode(child);
+    mNodes.remove(n->ref);
+    mIcons.remove(n->ref);
+    delete n;
+}
+
+int AssetTreeModel::sortedRow(Node* parent, Node* n) const {
+    if (n->parent != parent){
+        return std::lower_bound(parent->children.begin(), parent->children.end(), n, lessThan) - parent->children.begin();
+    }
+    // NB: n may be out of order after a rename
+    QVector<Node*> siblings = parent->children;
+    siblings.removeOne(n);
+    return std::lower_bound(siblings.begin(), siblings.end(), n, lessThan) - siblings.begin();
+}
+
+void AssetTreeModel::reset(){
+    TRACE_SCOPE("AssetTreeModel::reset");
+    beginResetModel();
+    for (Node* child: mRoot.children) deleteNode(child);
+    mRoot.children.clear();
+    mNodes.clear();
+    mIcons.clear();
+
+    QList<AssetRef> refs = PM()->folders.keys();
+    refs += PM()->composites.keys();
+    refs += PM()->parts.keys();
+    for (const AssetRef& ref: refs){
+        Node* n = new Node();
+        n->ref = ref;
+        n->name = PM()->getAsset(ref)->name;
+        mNodes.insert(ref, n);
+    }
+
+    for (Node* n: mNodes){
+        const AssetRef parentRef = PM()->getAsset(n->ref)->parent;
+        Node* parent = parentRef.isNull() ? &mRoot : mNodes.value(parentRef, nullptr);
+        if (parent){
+            n->parent = parent;
+            parent->children.push_back(n);
+        }
+    }
+
+    // Leave out anything in a missing folder
+    QSet<Node*> shown;
+    QVector<Node*> stack {&mRoot};
+    while (!stack.isEmpty()){
+        Node* n = stack.takeLast();
+        std::sort(n->children.begin(), n->children.end(), lessThan);
+        for (Node* child: n->children){
+            shown.insert(child);
+            stack.push_back(child);
+        }
+    }
+    for (auto it = mNodes.begin(); it != mNodes.end();){
+        if (shown.contains(it.value())){
+            ++it;
+        }
+        else {
+            delete it.value();
+            it = mNodes.erase(it);
+        }
+    }
+    endResetModel();
+}
+
+void AssetTreeModel::assetInserted(AssetRef ref){
+    if (mNodes.contains(ref)){
+        assetMoved(ref);
+        return;
+    }
+    Node* parent = parentNode(ref);
+    if (parent == nullptr) return;
+
+    Node* n = createNode(ref);
+    const int row = sortedRow(parent, n);
+    beginInsertRows(nodeIndex(parent), row, row);
+    n->parent = parent;
+    parent->children.insert(row, n);
+    endInsertRows();
+}
+
+void AssetTreeModel::assetRemoved(AssetRef ref){
+    Node* n = mNodes.value(ref, nullptr);
+    if (n == nullptr) return;
+
+    Node* parent = n->parent;
+    const int row = parent->children.indexOf(n);
+    beginRemoveRows(nodeIndex(parent), row, row);
+    parent->children.remove(row);
+    endRemoveRows();
+    deleteNode(n);
+}
+
+void AssetTreeModel::assetMoved(AssetRef ref){
+    Node* n = mNodes.value(ref, nullptr);
+    if (n == nullptr){
+        assetInserted(ref);
+        return;
+    }
+    Node* newParent = parentNode(ref);
+    if (newParent == nullptr){
+        assetRemoved(ref);
+        return;
+    }
+
+    n->name = PM()->getAsset(ref)->name;
+    Node* oldParent = n->parent;
+    const int oldRow = oldParent->children.indexOf(n);
+    const int newRow = sortedRow(newParent, n);
+    if (oldParent == newParent && oldRow == newRow){
+        const QModelIndex index = createIndex(oldRow, 0, n);
+        emit dataChanged(index, index);
+        return;
+    }
+
+    const int destination = (oldParent == newParent && newRow > oldRow) ? newRow + 1 : newRow;
+    if (!beginMoveRows(nodeIndex(oldParent), oldRow, oldRow, nodeIndex(newParent), destination)){
+        // A folder into itself
+        assetRemoved(ref);
+        return;
+    }
+    oldParent->children.remove(oldRow);
+    newParent->children.insert(newRow, n);
+    n->parent = newParent;
+    endMoveRows();
+
+    const QModelIndex index = createIndex(newRow, 0, n);
+    emit dataChanged(index, index);
+}
+
+void AssetTreeModel::assetRenamed(AssetRef ref){
+    assetMoved(ref);
+}
+
+void AssetTreeModel::iconChanged(AssetRef ref){
+    if (mIcons.remove(ref) > 0){
+        const QModelIndex index = assetIndex(ref);
+        emit dataChanged(index, index, {Qt::DecorationRole});
+    }
+}
+
+void AssetTreeModel::resetIcons(){
+    // NB: The view has to repaint
+    mIcons.clear();
+}
+
+QModelIndex AssetTreeModel::index(int row, int column, const QModelIndex& parent) const {
+    Node* p = node(parent);
+    if (column != 0 || row < 0 || row >= p->children.size()) return QModelIndex();
+    return createIndex(row, column, p->children.at(row));
+}
+
+QModelIndex AssetTreeModel::parent(const QModelIndex& index) const {
+    if (!index.isValid()) return QModelIndex();
+    return nodeIndex(node(index)->parent);
+}
+
+int AssetTreeModel::rowCount(const QModelIndex& parent) const {
+    if (parent.column() > 0) return 0;
+    return node(parent)->children.size();
+}
+
+int AssetTreeModel::columnCount(const QModelIndex&) const {
+    return 1;
+}
+
+bool AssetTreeModel::hasChildren(const QModelIndex& parent) const {
+    // NB: Folders always have an indicator, even when empty
+    const Node* n = node(parent);
+    return n == &mRoot || n->ref.type == AssetType::Folder;
+}
+
+QVariant AssetTreeModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid()) return QVariant();
+    const Node* n = node(index);
+    switch (role){
+    case Qt::DisplayRole:
+    case Qt::EditRole:
+        return n->name;
+    case Qt::DecorationRole:
+        if (n->ref.type == AssetType::Folder){
+            static const QIcon folderIcon {":/icon/icons/gentleface/folder_icon&16.png"};
+            return folderIcon;
+        }
+        else if (n->ref.type == AssetType::Part){
+            auto it = mIcons.find(n->ref);
+            if (it == mIcons.end()){
+                static const QIcon pictureIcon {":/icon/icons/gentleface/picture_icon&16.png"};
+                QIcon icon = pictureIcon;
+                Part* part = PM()->getPart(n->ref);
+                const QImage image = part ? PartIconImage(part) : QImage();
+                if (!image.isNull()) icon = QIcon(QPixmap::fromImage(image));
+                it = mIcons.insert(n->ref, icon);
+            }
+            return it.value();
+        }
+        return QVariant();
+    default:
+        return QVariant();
+    }
+}
+
+bool AssetTreeModel::setData(const QModelIndex& index, const QVariant& value, int role){
+    if (!index.isValid() || role != Qt::EditRole) return false;
+    const Node* n = node(index);
+    const QString newName = value.toString();
+    if (newName.isEmpty() || newName == n->name) return false;
+
+    // NB: The command notifies the listener, which calls assetRenamed
+    switch (n->ref.type){
+    case AssetType::Folder: TryCommand(new CRenameFolder(n->ref, newName)); break;
+    case AssetType::Part: TryCommand(new CRenamePart(n->ref, newName)); break;
+    case AssetType::Composite: TryCommand(new CRenameComposite(n->ref, newName)); break;
+    default: return false;
+    }
+    return true;
+}
+
+Qt::ItemFlags AssetTreeModel::flags(const QModelIndex& index) const {
+    if (!index.isValid()) return Qt::ItemIsDropEnabled;
+    Qt::ItemFlags f = Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsDragEnabled | Qt::ItemIsEditable;
+    if (node(index)->ref.type == AssetType::Folder) f |= Qt::ItemIsDropEnabled;
+    return f;
+}
+
+Qt::DropActions AssetTreeModel::supportedDropActions() const {
+    return Qt::MoveAction;
+}
+
+AssetFilterModel::AssetFilterModel(QObject* parent):QSortFilterProxyModel(parent){
+}
+
+void AssetFilterModel::setMatches(const QSet<AssetRef>* matches){
+    mFiltered = matches != nullptr;
+    mVisible.clear();
+    if (matches){
+        mVisible = *matches;
+        // Show the folders they're in
+        for (const AssetRef& ref: *matches){
+            Asset* asset = PM()->getAsset(ref);
+            while (asset && !asset->parent.isNull() && !mVisible.contains(asset->parent)){
+                mVisible.insert(asset->parent);
+                asset = PM()->getAsset(asset->parent);
+            }
+        }
+    }
+    invalidateFilter();
+}
+
+bool AssetFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const {
+    if (!mFiltered) return true;
+    const AssetTreeModel* model = static_cast<const AssetTreeModel*>(sourceModel());
+    return mVisible.contains(model->assetRef(model->index(sourceRow, 0, sourceParent)));
+}
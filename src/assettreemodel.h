@@ -0,0 +1,84 @@
+#ifndef ASSETTREEMODEL_H
+#define ASSETTREEMODEL_H
+
+#include "projectmodel.h"
+
+#include <QAbstractItemModel>
+#include <QHash>
+#include <QIcon>
+#include <QSet>
+#include <QSortFilterProxyModel>
+#include <QVector>
+
+// The asset hierarchy of PM(): folders, then composites, then sprites, each sorted by name.
+// It keeps its own nodes in step with the project through the fine-grained notifications
+// of the commands (see ProjectListener::assetInserted), so an edit only touches its rows.
+// Sprite icons are made when a row is first drawn.
+class AssetTreeModel: public QAbstractItemModel {
+    Q_OBJECT
+public:
+    explicit AssetTreeModel(QObject* parent = nullptr);
+    ~AssetTreeModel();
+
+    AssetRef assetRef(const QModelIndex& index) const;
+    QModelIndex assetIndex(AssetRef ref) const;
+
+    // Rebuilds everything (e.g., after loading a project)
+    void reset();
+
+    void assetInserted(AssetRef ref);
+    void assetRemoved(AssetRef ref);
+    void assetMoved(AssetRef ref);
+    void assetRenamed(AssetRef ref);
+    void iconChanged(AssetRef ref);
+    void resetIcons();
+
+    QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex& index) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    bool setData(const QModelIndex& index, const QVariant& value, int role = Qt::EditRole) override;
+    Qt::ItemFlags flags(const QModelIndex& index) const override;
+    Qt::DropActions supportedDropActions() const override;
+
+private:
+    struct Node {
+        AssetRef ref;
+        QString name;
+        Node* parent = nullptr;
+        QVector<Node*> children;
+    };
+
+    static bool lessThan(const Node* a, const Node* b);
+    Node* node(const QModelIndex& index) const;
+    QModelIndex nodeIndex(Node* node) const;
+    Node* createNode(AssetRef ref);
+    void deleteNode(Node* node);
+    int sortedRow(Node* parent, Node* node) const;
+    Node* parentNode(AssetRef ref);
+
+    Node mRoot;
+    QHash<AssetRef, Node*> mNodes;
+    mutable QHash<AssetRef, QIcon> mIcons;
+};
+
+// Shows the matches of a search (see AssetIndex) and the folders they're in
+class AssetFilterModel: public QSortFilterProxyModel {
+    Q_OBJECT
+public:
+    explicit AssetFilterModel(QObject* parent = nullptr);
+
+    // nullptr shows everything
+    void setMatches(const QSet<AssetRef>* matches);
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const override;
+
+private:
+    bool mFiltered = false;
+    QSet<AssetRef> mVisible;
+};
+
+#endif // ASSETTREEMODEL_H
@@ -1,33 +1,35 @@
 #ifndef ASSETTREEWIDGET_H
 #define ASSETTREEWIDGET_H
 
-#include <QTreeWidget>
-#include <QVector>
-#include <QSet>
+#include <QTreeView>
+#include <QList>
 #include <QString>
 #include "projectmodel.h"
 
-class AssetTreeWidget : public QTreeWidget
+class AssetTreeModel;
+class AssetFilterModel;
+
+// The asset list. Only the visible rows of the AssetTreeModel are ever looked at.
+class AssetTreeWidget : public QTreeView
 {
     Q_OBJECT
 public:
     explicit AssetTreeWidget(QWidget *parent = nullptr);
 
-    AssetRef assetRef(int id) const;
-    const QString& assetName(int id) const;
-	bool selectAsset(AssetRef, QTreeWidgetItem* fromNode = nullptr);
+    AssetRef assetRef(const QModelIndex& index) const;
+	QList<AssetRef> selectedAssets() const;
+	bool selectAsset(AssetRef);
 
 public slots:
 	void resetIcons();
     void updateList();
 	void updateIcon(AssetRef ref);
-    // void addAsset(AssetRef ref);
-    // void removeAsset(AssetRef ref);
+	void assetInserted(AssetRef ref);
+	void assetRemoved(AssetRef ref);
+	void assetMoved(AssetRef ref);
+	void assetRenamed(AssetRef ref);
 
-    void activateItem(QTreeWidgetItem* item, int col);
-    void expandItem(QTreeWidgetItem* item);
-    void collapseItem(QTreeWidgetItem* item);
-	void changeItem(QTreeWidgetItem* item, int col);
+    void activateItem(const QModelIndex& index);
 
 	void setFilter(const QString& filter);
 
@@ -38,22 +40,15 @@ signals:
 	void assetSelected(AssetRef ref);
 
 protected:
-    Qt::DropActions supportedDropActions() const;
     void dropEvent(QDropEvent *event);
-    void addAssetsWithParent(const QList<AssetRef>& assets, AssetRef parentRef, QTreeWidgetItem* parentItem, int& index);
     void keyPressEvent(QKeyEvent* event);
-	bool filterItem(const QString& text, QTreeWidgetItem* item);
-	
-	QTreeWidgetItem* findItem(std::function<bool(QTreeWidgetItem*)> searchQuery, QTreeWidgetItem* root = nullptr);
-	void applyToAllItems(std::function<void(QTreeWidgetItem*)> function, QTreeWidgetItem* root = nullptr);
+	void applyFilter();
 
 protected:
-    QVector<AssetRef> mAssetRefs;
-    // QVector<QTreeWidgetItem*> mItems;
-    QVector<QString> mAssetNames;
-    QSet<AssetRef> mOpenFolders;
+	AssetTreeModel* mModel = nullptr;
+	AssetFilterModel* mFilterModel = nullptr;
     QPointF mStartPos;
-	QMap<AssetRef, QIcon> mAssetIcons;
+	QString mFilter; // matched against names, modes and properties (see AssetIndex)
 };
 
 #endif // ASSETTREEWIDGET_H
@@ -0,0 +1,221 @@
+#include "atlas.h"
+#include "trace.h"
+
+#include <QDir>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVector>
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+struct Rect {
+    int x, y, w, h;
+    int right() const {return x + w;}
+    int bottom() const {return y + h;}
+    bool contains(const Rect& r) const {return r.x >= x && r.y >= y && r.right() <= right() && r.bottom() <= bottom();}
+    bool intersects(const Rect& r) const {return r.x < right() && r.right() > x && r.y < bottom() && r.bottom() > y;}
+};
+
+// See Jukka Jylanki, "A Thousand Ways to Pack the Bin"
+class MaxRectsBin {
+public:
+    MaxRectsBin(int width, int height){
+        mFree.push_back(Rect {0, 0, width, height});
+    }
+
+    bool insert(int w, int h, Rect* result){
+        int bestShort = std::numeric_limits<int>::max();
+        int bestLong = std::numeric_limits<int>::max();
+        int best = -1;
+        for (int i = 0; i < mFree.size(); i++){
+            const Rect& r = mFree.at(i);
+            if (r.w < w || r.h < h) continue;
+            const int leftoverShort = std::min(r.w - w, r.h - h);
+            const int leftoverLong = std::max(r.w - w, r.h - h);
+            if (leftoverShort < bestShort || (leftoverShort == bestShort && leftoverLong < bestLong)){
+                bestShort = leftoverShort;
+                bestLong = leftoverLong;
+                best = i;
+            }
+        }
+        if (best == -1) return false;
+
+        const Rect used {mFree.at(best).x, mFree.at(best).y, w, h};
+        QVector<Rect> split;
+        for (int i = 0; i < mFree.size();){
+            if (splitFreeRect(mFree.at(i), used, &split)){
+                mFree.remove(i);
+            }
+            else {
+                i++;
+            }
+        }
+        mFree += split;
+        prune();
+
+        mUsedWidth = std::max(mUsedWidth, used.right());
+        mUsedHeight = std::max(mUsedHeight, used.bottom());
+        *result = used;
+        return true;
+    }
+
+    int usedWidth() const {return mUsedWidth;}
+    int usedHeight() const {return mUsedHeight;}
+
+private:
+    static bool splitFreeRect(const Rect& free, const Rect& used, QVector<Rect>* split){
+        if (!free.intersects(used)) return false;
+        if (used.x < free.right() && used.right() > free.x){
+            if (used.y > free.y) split->push_back(Rect {free.x, free.y, free.w, used.y - free.y});
+            if (used.bottom() < free.bottom()) split->push_back(Rect {free.x, used.bottom(), free.w, free.bottom() - used.bottom()});
+        }
+        if (used.y < free.bottom() && used.bottom() > free.y){
+            if (used.x > free.x) split->push_back(Rect {free.x, free.y, used.x - free.x, free.h});
+            if (used.right() < free.right()) split->push_back(Rect {used.right(), free.y, free.right() - used.right(), free.h});
+        }
+        return true;
+    }
+
+    // Remove free rects that are inside other free rects
+    void prune(){
+        for (int i = 0; i < mFree.size(); i++){
+            for (int j = i + 1; j < mFree.size();){
+                if (mFree.at(i).contains(mFree.at(j))){
+                    mFree.remove(j);
+                }
+                else if (mFree.at(j).contains(mFree.at(i))){
+                    mFree.remove(i);
+                    i--;
+                    break;
+                }
+                else {
+                    j++;
+                }
+            }
+        }
+    }
+
+    QVector<Rect> mFree;
+    int mUsedWidth = 0;
+    int mUsedHeight = 0;
+};
+
+int NextPowerOfTwo(int n){
+    int p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+class WritePageTask: public QRunnable {
+public:
+    WritePageTask(const QList<QImage>& images, const QList<AtlasPlacement>& placements, int page, QSize size, const QString& fileName, QMutex* logMutex, QStringList* log)
+        :mImages(images), mPlacements(placements), mPage(page), mSize(size), mFileName(fileName), mLogMutex(logMutex), mLog(log){}
+
+    void run() override {
+        TRACE_SCOPE("WritePageTask");
+        QImage image(mSize, QImage::Format_ARGB32);
+        image.fill(Qt::transparent);
+        QPainter painter(&image);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        for (int i = 0; i < mImages.size(); i++){
+            if (mPlacements.at(i).page == mPage){
+                painter.drawImage(mPlacements.at(i).rect.topLeft(), mImages.at(i));
+            }
+        }
+        painter.end();
+
+        if (!image.save(mFileName, "PNG")){
+            QMutexLocker lock(mLogMutex);
+            mLog->append("Couldn't save image " + mFileName);
+        }
+    }
+
+private:
+    const QList<QImage>& mImages;
+    const QList<AtlasPlacement>& mPlacements;
+    int mPage;
+    QSize mSize;
+    QString mFileName;
+    QMutex* mLogMutex;
+    QStringList* mLog;
+};
+
+}
+
+bool PackAtlas(const QList<QSize>& sizes, const AtlasSettings& settings, QList<AtlasPlacement>* placements, QList<QSize>* pageSizes, QStringList* log){
+    TRACE_SCOPE("PackAtlas");
+    const int pageSize = NextPowerOfTwo(std::max(1, settings.maxPageSize));
+    const int padding = std::max(0, settings.padding);
+
+    // Biggest first packs much tighter
+    QVector<int> order(sizes.size());
+    for (int i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b){
+        const QSize& sa = sizes.at(a);
+        const QSize& sb = sizes.at(b);
+        const int maxA = std::max(sa.width(), sa.height());
+        const int maxB = std::max(sb.width(), sb.height());
+        if (maxA != maxB) return maxA > maxB;
+        return sa.width() * sa.height() > sb.width() * sb.height();
+    });
+
+    placements->clear();
+    for (int i = 0; i < sizes.size(); i++) placements->push_back(AtlasPlacement());
+
+    QList<MaxRectsBin> bins;
+    for (int index: order){
+        const QSize& size = sizes.at(index);
+        const int w = size.width() + padding;
+        const int h = size.height() + padding;
+        if (size.width() > pageSize || size.height() > pageSize){
+            log->append(QString("A %1x%2 frame doesn't fit in a %3x%3 atlas page").arg(size.width()).arg(size.height()).arg(pageSize));
+            return false;
+        }
+
+        Rect rect;
+        int page = -1;
+        for (int b = 0; b < bins.size() && page == -1; b++){
+            if (bins[b].insert(w, h, &rect)) page = b;
+        }
+        if (page == -1){
+            if (settings.maxPages > 0 && bins.size() >= settings.maxPages){
+                log->append(QString("The frames don't fit in %1 %2x%2 atlas page(s)").arg(settings.maxPages).arg(pageSize));
+                return false;
+            }
+            // NB: The padding is on the right and bottom, so a frame can fill the page exactly
+            bins.push_back(MaxRectsBin(pageSize + padding, pageSize + padding));
+            page = bins.size() - 1;
+            bins[page].insert(w, h, &rect);
+        }
+
+        (*placements)[index].page = page;
+        (*placements)[index].rect = QRect(rect.x, rect.y, size.width(), size.height());
+    }
+
+    pageSizes->clear();
+    for (const MaxRectsBin& bin: bins){
+        pageSizes->push_back(QSize(NextPowerOfTwo(std::min(bin.usedWidth(), pageSize)), NextPowerOfTwo(std::min(bin.usedHeight(), pageSize))));
+    }
+    return true;
+}
+
+bool WriteAtlasPages(const QList<QImage>& images, const QList<AtlasPlacement>& placements, const QList<QSize>& pageSizes, const QString& directory, const QString& prefix, QStringList* log){
+    const QDir dir { directory };
+    QMutex logMutex;
+    QStringList errors;
+    {
+        QThreadPool pool;
+        for (int page = 0; page < pageSizes.size(); page++){
+            const QString fileName = dir.absoluteFilePath(QString("%1_%2.png").arg(prefix).arg(page));
+            pool.start(new WritePageTask(images, placements, page, pageSizes.at(page), fileName, &logMutex, &errors));
+        }
+        pool.waitForDone();
+    }
+    log->append(errors);
+    return errors.isEmpty();
+}
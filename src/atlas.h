@@ -0,0 +1,31 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <QImage>
+#include <QList>
+#include <QRect>
+#include <QSize>
+#include <QStringList>
+
+// Texture atlas packing for ProjectModel::exportAtlas
+
+struct AtlasSettings {
+    int maxPageSize = 2048; // a power of two
+    int maxPages = 0; // 0 for no limit
+    int padding = 1; // transparent pixels between frames
+    bool trim = false; // trim transparent borders (see ProjectModel::exportSimple)
+};
+
+struct AtlasPlacement {
+    int page = -1;
+    QRect rect; // NB: excludes padding
+};
+
+// Packs rectangles into as few power of two pages as possible (MaxRects, best short side fit)
+// Returns false if they don't fit.
+bool PackAtlas(const QList<QSize>& sizes, const AtlasSettings& settings, QList<AtlasPlacement>* placements, QList<QSize>* pageSizes, QStringList* log);
+
+// Draws the images into their pages and saves them as <prefix>_N.png, one page per thread
+bool WriteAtlasPages(const QList<QImage>& images, const QList<AtlasPlacement>& placements, const QList<QSize>& pageSizes, const QString& directory, const QString& prefix, QStringList* log);
+
+#endif // ATLAS_H
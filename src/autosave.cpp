@@ -0,0 +1,78 @@
+#include "autosave.h"
+#include "savetask.h"
+#include "trace.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QSettings>
+#include <QStandardPaths>
+
+static const int DefaultAutosaveMinutes = 2;
+
+Autosave::Autosave(QObject* parent):QObject(parent){
+    mPool.setMaxThreadCount(1);
+
+    QSettings settings;
+    const int minutes = settings.value("autosave_minutes", DefaultAutosaveMinutes).toInt();
+    if (minutes > 0){
+        connect(&mTimer, SIGNAL(timeout()), this, SLOT(autosave()));
+        mTimer.start(minutes*60*1000);
+    }
+}
+
+Autosave::~Autosave(){
+    // A normal exit, so nothing needs recovering
+    mPool.waitForDone();
+    QFile::remove(RecoveryFileName());
+}
+
+QString Autosave::RecoveryFileName(){
+    const QDir dir { QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) };
+    dir.mkpath(".");
+    return dir.absoluteFilePath("recovery.mqs");
+}
+
+QString Autosave::RecoveredProjectName(){
+    QSettings settings;
+    return settings.value("autosave_project").toString();
+}
+
+void Autosave::projectModified(){
+    mModified = true;
+}
+
+void Autosave::discard(){
+    mGeneration++;
+    mModified = false;
+    QFile::remove(RecoveryFileName());
+}
+
+void Autosave::autosave(){
+    // NB: If one is still running then try again next time
+    if (!mModified || mRunning) return;
+    mModified = false;
+    mRunning = true;
+
+    QSettings settings;
+    settings.setValue("autosave_project", PM()->fileName);
+
+    auto* task = new SaveTask(PM()->snapshot(), RecoveryFileName());
+    const int generation = mGeneration;
+    connect(task, &SaveTask::finished, this, [this, task, generation](){ taskFinished(task, generation); }, Qt::QueuedConnection);
+    mPool.start(task);
+}
+
+void Autosave::taskFinished(SaveTask* task, int generation){
+    task->deleteLater();
+    mRunning = false;
+    if (generation != mGeneration){
+        // The project was saved or replaced while this was being written
+        QFile::remove(RecoveryFileName());
+        return;
+    }
+    if (!task->success()){
+        mModified = true;
+        qWarning() << "Autosave failed:" << task->log().join("\n");
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QTimer>
+
+class SaveTask;
+
+// Periodically saves the project to a recovery file, if it has changed.
+// Only the snapshot is taken on the main thread, the encoding and writing is done
+// in the background, so drawing carries on while it saves.
+// The recovery file is removed when the project is saved, replaced or closed normally,
+// so if there is one at startup the editor didn't exit cleanly.
+class Autosave: public QObject {
+    Q_OBJECT
+public:
+    explicit Autosave(QObject* parent = nullptr);
+    ~Autosave();
+
+    static QString RecoveryFileName();
+    // The project that the recovery file is a copy of (empty if it was never saved)
+    static QString RecoveredProjectName();
+
+    void projectModified();
+    void discard(); // The project has been saved or replaced
+
+protected slots:
+    void autosave();
+
+protected:
+    void taskFinished(SaveTask* task, int generation);
+
+private:
+    QTimer mTimer;
+    QThreadPool mPool; // NB: One at a time
+    bool mModified = false;
+    bool mRunning = false;
+    int mGeneration = 0; // Ignore autosaves of a discarded project
+};
+
+#endif // AUTOSAVE_H
@@ -0,0 +1,259 @@
+#include "bake.h"
+#include "trace.h"
+
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// A child at a baked frame
+struct Layer {
+    QImage image; // NB: A shallow copy, so each worker only reads its own copies
+    QPoint pos;
+    int z;
+    int index;
+};
+
+struct ChildBake {
+    const Part::Mode* mode = nullptr;
+    bool loop = true;
+    bool visible = true;
+};
+
+class RenderFrameTask: public QRunnable {
+public:
+    RenderFrameTask(const QVector<Layer>& layers, const QRect& bounds, QImage* target)
+        :mLayers(layers), mBounds(bounds), mTarget(target){}
+
+    void run() override {
+        TRACE_SCOPE("RenderFrameTask");
+        QImage image(mBounds.size(), QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+        QPainter painter(&image);
+        for (const Layer& layer: mLayers){
+            painter.drawImage(layer.pos - mBounds.topLeft(), layer.image);
+        }
+        painter.end();
+        *mTarget = image.convertToFormat(QImage::Format_ARGB32);
+    }
+
+private:
+    QVector<Layer> mLayers;
+    QRect mBounds;
+    QImage* mTarget;
+};
+
+int ChildFrame(const ChildBake& child, double seconds){
+    const int n = child.mode->numFrames;
+    const int frame = (int) std::floor(seconds * child.mode->framesPerSecond + 1e-6);
+    return child.loop ? (frame % n) : std::min(frame, n - 1);
+}
+
+}
+
+bool BakeComposite(const Composite& comp, const BakeSettings& settings, BakedComposite* result, QStringList* log){
+    TRACE_SCOPE("BakeComposite");
+    const int numChildren = comp.children.size();
+    QVector<ChildBake> children(numChildren);
+    QVector<const Composite::Child*> childData(numChildren, nullptr);
+
+    int fastestFPS = 0;
+    int longestFrames = 0;
+    double longestSeconds = 0;
+    for (int i = 0; i < numChildren; i++){
+        const QString& name = comp.children.at(i);
+        auto cit = comp.childrenMap.find(name);
+        if (cit == comp.childrenMap.end()) continue;
+        childData[i] = &cit.value();
+
+        Part* part = PM()->getPart(cit->part);
+        if (part == nullptr || part->modes.isEmpty()){
+            log->append("Child " + name + " has no sprite, skipping it.");
+            continue;
+        }
+
+        const QString modeName = settings.childModes.value(name, part->modes.firstKey());
+        auto mit = part->modes.find(modeName);
+        if (mit == part->modes.end()){
+            log->append("Child " + name + " has no mode " + modeName + ", skipping it.");
+            continue;
+        }
+
+        ChildBake& child = children[i];
+        child.mode = &mit.value();
+        child.loop = settings.childLoops.value(name, true);
+        child.visible = settings.childVisible.value(name, true);
+        if (child.mode->numFrames <= 0 || child.mode->framesPerSecond <= 0){
+            child.mode = nullptr;
+            continue;
+        }
+
+        fastestFPS = std::max(fastestFPS, child.mode->framesPerSecond);
+        const double seconds = (double) child.mode->numFrames / child.mode->framesPerSecond;
+        if (seconds > longestSeconds){
+            longestSeconds = seconds;
+            longestFrames = child.mode->numFrames;
+        }
+    }
+
+    const int fps = settings.framesPerSecond > 0 ? settings.framesPerSecond : fastestFPS;
+    if (fps <= 0){
+        log->append("Composite " + comp.name + " has nothing to bake.");
+        return false;
+    }
+    const int numFrames = settings.numFrames > 0 ? settings.numFrames : std::max(longestFrames, (int) std::ceil(longestSeconds * fps - 1e-6));
+
+    // Breadth first from the roots so parents are posed before their children (see CompositeWidget::compilePose)
+    QVector<int> order;
+    QVector<bool> visited(numChildren, false);
+    for (int i = 0; i < numChildren; i++){
+        if (childData.at(i) && childData.at(i)->parent == -1 && children.at(i).mode){
+            visited[i] = true;
+            order.push_back(i);
+        }
+    }
+    for (int k = 0; k < order.size(); k++){
+        for (int c: childData.at(order.at(k))->children){
+            if (c < 0 || c >= numChildren || visited.at(c) || childData.at(c) == nullptr || children.at(c).mode == nullptr) continue;
+            visited[c] = true;
+            order.push_back(c);
+        }
+    }
+
+    // Pose every frame and find the overall bounds
+    const int root = (comp.root >= 0 && comp.root < numChildren && children.at(comp.root).mode) ? comp.root : (order.isEmpty() ? -1 : order.first());
+    QVector<QVector<Layer>> layers(numFrames);
+    QVector<QPoint> offsets(numChildren);
+    QVector<int> frames(numChildren);
+    QList<QPoint> rootPivots[Part::MaxPivots];
+    QRect bounds;
+    for (int f = 0; f < numFrames; f++){
+        const double seconds = (double) f / fps;
+        for (int index: order){
+            const ChildBake& child = children.at(index);
+            const int frame = ChildFrame(child, seconds);
+            frames[index] = frame;
+
+            const int parent = childData.at(index)->parent;
+            if (parent < 0 || parent >= numChildren || !visited.at(parent)){
+                offsets[index] = -child.mode->anchor.at(frame);
+            }
+            else {
+                const Part::Mode* parentMode = children.at(parent).mode;
+                const int pivot = childData.at(index)->parentPivot;
+                QPoint pp = offsets.at(parent);
+                if (pivot >= 0 && pivot < parentMode->numPivots){
+                    pp += parentMode->pivots[pivot].at(frames.at(parent)) - child.mode->anchor.at(frame);
+                }
+                offsets[index] = pp;
+            }
+
+            const auto& image = child.mode->frames.at(frame);
+            if (child.visible && image){
+                Layer layer {*image, offsets.at(index), childData.at(index)->z, index};
+                layers[f].push_back(layer);
+                bounds = bounds.united(QRect(layer.pos, image->size()));
+            }
+        }
+
+        if (root >= 0){
+            const Part::Mode* rootMode = children.at(root).mode;
+            for (int p = 0; p < rootMode->numPivots; p++){
+                rootPivots[p].push_back(rootMode->pivots[p].at(frames.at(root)) + offsets.at(root));
+            }
+        }
+
+        // Composites are drawn from lowest z to highest z
+        std::stable_sort(layers[f].begin(), layers[f].end(), [](const Layer& a, const Layer& b){ return a.z < b.z; });
+    }
+
+    if (bounds.isEmpty()){
+        log->append("Composite " + comp.name + " has nothing to bake.");
+        return false;
+    }
+
+    QVector<QImage> images(numFrames);
+    {
+        QThreadPool pool;
+        for (int f = 0; f < numFrames; f++){
+            pool.start(new RenderFrameTask(layers.at(f), bounds, &images[f]));
+        }
+        pool.waitForDone();
+    }
+
+    result->width = bounds.width();
+    result->height = bounds.height();
+    result->framesPerSecond = fps;
+    result->numPivots = root >= 0 ? children.at(root).mode->numPivots : 0;
+    result->frames.clear();
+    result->anchor.clear();
+    for (int f = 0; f < numFrames; f++){
+        result->frames.push_back(QSharedPointer<QImage>::create(images.at(f)));
+        result->anchor.push_back(-bounds.topLeft());
+    }
+    for (int p = 0; p < Part::MaxPivots; p++){
+        result->pivots[p].clear();
+        for (int f = 0; f < numFrames; f++){
+            result->pivots[p].push_back(p < result->numPivots ? rootPivots[p].at(f) - bounds.topLeft() : QPoint(0,0));
+        }
+    }
+    return true;
+}
+
+bool ExportBakedComposite(const BakedComposite& baked, const QString& directory, const QString& name, QStringList* log){
+    const QDir dir { directory };
+    if (!dir.exists()){
+        log->append("Export requires a directory!");
+        return false;
+    }
+
+    QString fixedName = name;
+    fixedName.replace(' ', '_');
+
+    QJsonObject data;
+    data.insert("name", name);
+    data.insert("width", baked.width);
+    data.insert("height", baked.height);
+    data.insert("numFrames", baked.frames.size());
+    data.insert("numPivots", baked.numPivots);
+    data.insert("framesPerSecond", baked.framesPerSecond);
+
+    QJsonArray frameArray;
+    for (int frame = 0; frame < baked.frames.size(); frame++){
+        const QString imageName = QString("%1_%2.png").arg(fixedName).arg(frame, 3, 10, QChar('0'));
+        const QString imageFilename = dir.absoluteFilePath(imageName);
+        if (!baked.frames.at(frame)->save(imageFilename, "PNG")){
+            log->append("Couldn't save image " + imageFilename);
+            return false;
+        }
+
+        QJsonObject frameObject;
+        frameObject.insert("image", imageName);
+        frameObject.insert("ax", baked.anchor.at(frame).x());
+        frameObject.insert("ay", baked.anchor.at(frame).y());
+        for (int p = 0; p < baked.numPivots; p++){
+            frameObject.insert(QString("p%1x").arg(p), baked.pivots[p].at(frame).x());
+            frameObject.insert(QString("p%1y").arg(p), baked.pivots[p].at(frame).y());
+        }
+        frameArray.append(frameObject);
+    }
+    data.insert("frames", frameArray);
+
+    const QString jsonFilename = dir.absoluteFilePath(fixedName + ".json");
+    QFile file(jsonFilename);
+    if (!file.open(QFile::OpenModeFlag::WriteOnly)){
+        log->append("Couldn't create file " + jsonFilename);
+        return false;
+    }
+    file.write(QJsonDocument(data).toJson());
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef BAKE_H
+#define BAKE_H
+
+#include "projectmodel.h"
+
+#include <QMap>
+#include <QStringList>
+
+// Baking flattens a composite animation (with a chosen mode per child) into a
+// single sequence of frames, so the pivot hierarchy doesn't have to be evaluated
+// at runtime. Frames are rendered in parallel on a thread pool.
+
+struct BakeSettings {
+    QMap<QString, QString> childModes; // child -> mode (default is the child's first mode)
+    QMap<QString, bool> childLoops; // child -> loop (default is true)
+    QMap<QString, bool> childVisible; // child -> visible (default is true)
+    int framesPerSecond = 0; // 0 to use the fastest child
+    int numFrames = 0; // 0 to play every child's mode through once
+};
+
+struct BakedComposite {
+    int width = 0;
+    int height = 0;
+    int framesPerSecond = 0;
+    int numPivots = 0; // the pivots of the root child
+
+    // Each of these are numFrames long
+    QList<QSharedPointer<QImage>> frames;
+    QList<QPoint> anchor; // the composite origin
+    QList<QPoint> pivots[Part::MaxPivots];
+};
+
+bool BakeComposite(const Composite& comp, const BakeSettings& settings, BakedComposite* result, QStringList* log);
+
+// Writes name_NNN.png for each frame and name.json with the frame metadata into directory
+bool ExportBakedComposite(const BakedComposite& baked, const QString& directory, const QString& name, QStringList* log);
+
+#endif // BAKE_H
@@ -0,0 +1,504 @@
+// mqsprite-cli
+// Headless batch tools for MQ Sprite projects, e.g., for exporting assets on a build machine.
+// Usage: mqsprite-cli <command> [arguments]
+
+#include "assetindex.h"
+#include "commands.h"
+#include "generator.h"
+#include "imageops.h"
+#include "projectmodel.h"
+#include "projectstats.h"
+#include "trace.h"
+#include "validate.h"
+#include "zip.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSet>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <limits>
+
+namespace {
+
+QTextStream& Out(){
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+QTextStream& Err(){
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+void PrintLog(const QString& title, const QList<QString>& log){
+    if (log.isEmpty()) return;
+    Err() << title << ":\n";
+    for (const QString& line: log){
+        Err() << "  " << line << "\n";
+    }
+    Err().flush();
+}
+
+bool LoadProject(const QString& fileName){
+    QString reason;
+    bool result = PM()->load(fileName, reason);
+    if (!result){
+        Err() << "Couldn't load " << fileName << ": " << reason << "\n";
+    }
+    PrintLog("Import issues", PM()->importLog);
+    return result;
+}
+
+// Returns whether the flag is in args (and removes it)
+bool TakeFlag(QStringList& args, const QString& name){
+    return args.removeAll(name) > 0;
+}
+
+int Export(const QStringList& arguments){
+    QStringList args = arguments;
+    const bool trim = TakeFlag(args, "--trim");
+    if (args.size() != 2) return -1;
+    if (!LoadProject(args.at(0))) return 1;
+
+    QDir().mkpath(args.at(1));
+    PM()->exportLog.clear();
+    bool result = PM()->exportSimple(args.at(1), trim);
+    PrintLog("Export issues", PM()->exportLog);
+    if (!result){
+        Err() << "Couldn't export to " << args.at(1) << "\n";
+        return 1;
+    }
+    Out() << "Exported " << PM()->parts.size() << " sprites to " << QDir(args.at(1)).absolutePath() << "\n";
+    return 0;
+}
+
+// Returns the value of --name N in args (and removes it), or defaultValue
+int TakeIntOption(QStringList& args, const QString& name, int defaultValue, bool* ok){
+    const int i = args.indexOf(name);
+    if (i == -1) return defaultValue;
+    if (i + 1 >= args.size()){
+        *ok = false;
+        return defaultValue;
+    }
+    bool parsed = false;
+    const int value = args.at(i + 1).toInt(&parsed);
+    *ok = *ok && parsed;
+    args.removeAt(i);
+    args.removeAt(i);
+    return value;
+}
+
+int Atlas(const QStringList& arguments){
+    QStringList args = arguments;
+    AtlasSettings settings;
+    bool ok = true;
+    settings.maxPageSize = TakeIntOption(args, "--size", settings.maxPageSize, &ok);
+    settings.maxPages = TakeIntOption(args, "--pages", settings.maxPages, &ok);
+    settings.padding = TakeIntOption(args, "--padding", settings.padding, &ok);
+    settings.trim = TakeFlag(args, "--trim");
+    if (!ok || args.size() != 2) return -1;
+    if (!LoadProject(args.at(0))) return 1;
+
+    QDir().mkpath(args.at(1));
+    PM()->exportLog.clear();
+    bool result = PM()->exportAtlas(args.at(1), settings);
+    PrintLog("Export issues", PM()->exportLog);
+    if (!result){
+        Err() << "Couldn't export to " << args.at(1) << "\n";
+        return 1;
+    }
+    Out() << "Exported " << PM()->parts.size() << " sprites to " << QDir(args.at(1)).absoluteFilePath("atlas.json") << "\n";
+    return 0;
+}
+
+int Stats(const QStringList& args){
+    const bool json = args.contains("--json");
+    QStringList files = args;
+    files.removeAll("--json");
+    if (files.size() != 1) return -1;
+    if (!LoadProject(files.at(0))) return 1;
+
+    int numModes = 0, numFrames = 0, numChildren = 0;
+    qint64 numPixels = 0, imageBytes = 0;
+    for (auto part: PM()->parts){
+        numModes += part->modes.size();
+        for (const Part::Mode& m: part->modes){
+            numFrames += m.frames.size();
+            for (const auto& img: m.frames){
+                if (!img) continue;
+                numPixels += (qint64) img->width() * img->height();
+                imageBytes += img->byteCount();
+            }
+        }
+    }
+    for (auto comp: PM()->composites){
+        numChildren += comp->children.size();
+    }
+
+    QJsonObject stats;
+    stats.insert("file", QFileInfo(files.at(0)).absoluteFilePath());
+    stats.insert("fileBytes", QFileInfo(files.at(0)).size());
+    stats.insert("folders", PM()->folders.size());
+    stats.insert("sprites", PM()->parts.size());
+    stats.insert("modes", numModes);
+    stats.insert("frames", numFrames);
+    stats.insert("pixels", numPixels);
+    stats.insert("imageBytes", imageBytes);
+    stats.insert("composites", PM()->composites.size());
+    stats.insert("compositeChildren", numChildren);
+
+    if (json){
+        Out() << QJsonDocument(stats).toJson();
+    }
+    else {
+        for (auto it = stats.begin(); it != stats.end(); ++it){
+            Out() << it.key() << ": " << it.value().toVariant().toString() << "\n";
+        }
+    }
+    return 0;
+}
+
+int Report(const QStringList& arguments){
+    QStringList args = arguments;
+    bool ok = true;
+    const int top = TakeIntOption(args, "--top", 20, &ok);
+    const bool json = TakeFlag(args, "--json");
+    if (!ok || args.size() != 1) return -1;
+    if (!LoadProject(args.at(0))) return 1;
+
+    const ProjectStats stats = ComputeProjectStats(TakeProjectStatsSnapshot());
+    if (json){
+        Out() << QJsonDocument(ProjectStatsToJson(stats)).toJson();
+        return 0;
+    }
+
+    auto print = [](const AssetStats& s){
+        Out() << QString("%1 %2 %3 %4 %5 %6\n").arg(s.name, -32).arg(s.decodedBytes, 12).arg(s.compressedBytes, 12)
+            .arg(s.numFrames, 8).arg(s.duplicateFrames, 10).arg(s.uniqueColours, 8);
+    };
+    auto printTop = [&](const QString& title, QList<AssetStats> list){
+        if (list.isEmpty()) return;
+        std::stable_sort(list.begin(), list.end(), [](const AssetStats& a, const AssetStats& b){ return a.decodedBytes > b.decodedBytes; });
+        Out() << "\n" << title << " (largest " << std::min(top, list.size()) << " of " << list.size() << ")\n";
+        Out() << QString("%1 %2 %3 %4 %5 %6\n").arg("name", -32).arg("memory", 12).arg("png", 12).arg("frames", 8).arg("duplicates", 10).arg("colours", 8);
+        for (int i = 0; i < list.size() && i < top; i++) print(list.at(i));
+    };
+
+    Out() << "file: " << stats.fileBytes << " bytes\n";
+    Out() << "memory: " << stats.total.decodedBytes << " bytes\n";
+    Out() << "png: " << stats.total.compressedBytes << " bytes\n";
+    Out() << "undo: " << stats.undoStackBytes << " bytes\n";
+    Out() << "frames: " << stats.total.numFrames << " (" << stats.total.duplicateFrames << " duplicates)\n";
+    Out() << "colours: " << stats.total.uniqueColours << "\n";
+    printTop("Sprites", stats.parts);
+    printTop("Folders", stats.folders);
+    return 0;
+}
+
+int Validate(const QStringList& args){
+    if (args.size() != 1) return -1;
+    if (!LoadProject(args.at(0))) return 1;
+
+    const QStringList problems = ValidateProject();
+    for (const QString& problem: problems){
+        Out() << problem << "\n";
+    }
+    Out() << args.at(0) << ": " << problems.size() << " problem(s)\n";
+    return problems.isEmpty() ? 0 : 1;
+}
+
+int Convert(const QStringList& args){
+    if (args.size() != 2) return -1;
+    if (!LoadProject(args.at(0))) return 1;
+
+    PM()->exportLog.clear();
+    bool result = PM()->save(args.at(1));
+    PrintLog("Save issues", PM()->exportLog);
+    if (!result){
+        Err() << "Couldn't save " << args.at(1) << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Returns the value of --name VALUE in args (and removes it), or defaultValue
+QString TakeOption(QStringList& args, const QString& name, const QString& defaultValue, bool* ok){
+    const int i = args.indexOf(name);
+    if (i == -1) return defaultValue;
+    if (i + 1 >= args.size()){
+        *ok = false;
+        return defaultValue;
+    }
+    const QString value = args.at(i + 1);
+    args.removeAt(i);
+    args.removeAt(i);
+    return value;
+}
+
+qint64 DirectorySize(const QString& path, QMap<QString, QString>* files = nullptr){
+    qint64 bytes = 0;
+    QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()){
+        it.next();
+        bytes += it.fileInfo().size();
+        if (files) files->insert(QDir(path).relativeFilePath(it.filePath()), it.filePath());
+    }
+    return bytes;
+}
+
+struct BenchResult {
+    QString name;
+    int parts;
+    int frames; // frames (or other items) processed per run
+    qint64 bytes; // bytes processed per run (0 if not meaningful)
+    double seconds; // the fastest run
+};
+
+// Runs setup then fn repeat times, and returns the fastest time of fn in seconds
+double TimeBest(int repeat, std::function<void()> setup, std::function<void()> fn){
+    double best = std::numeric_limits<double>::max();
+    for (int r = 0; r < repeat; r++){
+        if (setup) setup();
+        QElapsedTimer timer;
+        timer.start();
+        fn();
+        best = std::min(best, timer.nsecsElapsed() * 1e-9);
+    }
+    return best;
+}
+
+int Bench(const QStringList& arguments){
+    QStringList args = arguments;
+    bool ok = true;
+    const QStringList partCounts = TakeOption(args, "--parts", "10,100,1000", &ok).split(',', QString::SkipEmptyParts);
+    const int numFrames = TakeIntOption(args, "--frames", 4, &ok);
+    const int frameSize = TakeIntOption(args, "--size", 32, &ok);
+    const int repeat = TakeIntOption(args, "--repeat", 3, &ok);
+    const bool json = TakeFlag(args, "--json");
+    if (!ok || !args.isEmpty() || numFrames <= 0 || frameSize <= 0 || repeat <= 0) return -1;
+
+    QTemporaryDir tempDir;
+    if (!tempDir.isValid()){
+        Err() << "Couldn't create a temporary directory\n";
+        return 1;
+    }
+    const QString projectFile = tempDir.filePath("bench.mqs");
+    const QString exportDir = tempDir.filePath("export");
+    const QString zipFile = tempDir.filePath("bench.zip");
+
+    QList<BenchResult> results;
+    for (const QString& partCount: partCounts){
+        bool parsed = false;
+        const int numParts = partCount.toInt(&parsed);
+        if (!parsed || numParts <= 0) return -1;
+
+        GeneratorSettings generatorSettings;
+        generatorSettings.numParts = numParts;
+        generatorSettings.framesPerMode = numFrames;
+        generatorSettings.frameSize = frameSize;
+        QStringList log;
+        if (!GenerateProject(generatorSettings, &log)){
+            PrintLog("Generator issues", log);
+            return 1;
+        }
+        const int totalFrames = numParts * generatorSettings.modesPerPart * numFrames;
+        const qint64 pixelBytes = (qint64) totalFrames * frameSize * frameSize * 4;
+        auto add = [&](const QString& name, int frames, qint64 bytes, double seconds){
+            results.append(BenchResult {name, numParts, frames, bytes, seconds});
+        };
+
+        double seconds = TimeBest(repeat, nullptr, [&](){ PM()->save(projectFile); });
+        add("save", totalFrames, QFileInfo(projectFile).size(), seconds);
+
+        QString reason;
+        seconds = TimeBest(repeat, nullptr, [&](){ PM()->load(projectFile, reason); });
+        add("load", totalFrames, QFileInfo(projectFile).size(), seconds);
+
+        // The first find after a load builds the index, the rest only look at the assets that can match
+        seconds = TimeBest(repeat, [](){ PM()->searchIndex()->invalidateAll(); }, [](){ PM()->searchIndex()->size(); });
+        add("search index", numParts, 0, seconds);
+
+        const QStringList queries {"s", "sprite_0", "m001", "group_3", "nothing"};
+        seconds = TimeBest(repeat, nullptr, [&](){
+            for (const QString& query: queries) PM()->searchIndex()->find(query);
+        });
+        add("search", queries.size(), 0, seconds);
+
+        seconds = TimeBest(repeat, [&](){
+            QDir(exportDir).removeRecursively();
+            QDir().mkpath(exportDir);
+        }, [&](){ PM()->exportSimple(exportDir); });
+        QMap<QString, QString> exportedFiles;
+        const qint64 exportBytes = DirectorySize(exportDir, &exportedFiles);
+        add("exportSimple", totalFrames, exportBytes, seconds);
+
+        seconds = TimeBest(repeat, nullptr, [&](){ PM()->exportSimple(exportDir); });
+        add("exportSimple (unchanged)", totalFrames, exportBytes, seconds);
+
+        seconds = TimeBest(repeat, nullptr, [&](){ WriteZip(zipFile, exportedFiles); });
+        add("WriteZip", exportedFiles.size(), exportBytes, seconds);
+
+        seconds = TimeBest(repeat, nullptr, [&](){ LoadZip(zipFile); });
+        add("LoadZip", exportedFiles.size(), exportBytes, seconds);
+
+        seconds = TimeBest(repeat, nullptr, [&](){
+            for (auto part: PM()->parts) PartIconImage(part.data());
+        });
+        add("createIcon", numParts, 0, seconds);
+
+        seconds = TimeBest(repeat, nullptr, [&](){
+            for (auto part: PM()->parts) for (const Part::Mode& m: part->modes) for (const auto& img: m.frames) FloodFill(*img, QPoint(0, 0), qRgba(255, 0, 255, 255));
+        });
+        add("floodFill", totalFrames, pixelBytes, seconds);
+
+        const QSet<AssetRef> originals = PM()->parts.keys().toSet();
+        seconds = TimeBest(repeat, [&](){
+            for (const AssetRef& ref: PM()->parts.keys()){
+                if (!originals.contains(ref)) PM()->parts.remove(ref);
+            }
+        }, [&](){
+            for (const AssetRef& ref: originals) TryCommand(new CCopyPart(ref));
+        });
+        add("CCopyPart", totalFrames, pixelBytes, seconds);
+    }
+    PM()->clear();
+
+    if (json){
+        QJsonArray array;
+        for (const BenchResult& result: results){
+            QJsonObject object;
+            object.insert("benchmark", result.name);
+            object.insert("parts", result.parts);
+            object.insert("items", result.frames);
+            object.insert("bytes", result.bytes);
+            object.insert("seconds", result.seconds);
+            object.insert("itemsPerSecond", result.seconds > 0 ? result.frames / result.seconds : 0.0);
+            object.insert("megabytesPerSecond", result.seconds > 0 ? result.bytes / (1024.0 * 1024.0) / result.seconds : 0.0);
+            array.append(object);
+        }
+        QJsonObject root;
+        root.insert("qtVersion", QString(qVersion()));
+        root.insert("threads", QThread::idealThreadCount());
+        root.insert("framesPerMode", numFrames);
+        root.insert("frameSize", frameSize);
+        root.insert("repeat", repeat);
+        root.insert("results", array);
+        Out() << QJsonDocument(root).toJson();
+    }
+    else {
+        Out() << QString("%1 %2 %3 %4 %5\n").arg("benchmark", -26).arg("parts", 8).arg("seconds", 10).arg("items/s", 12).arg("MB/s", 10);
+        for (const BenchResult& result: results){
+            const double itemsPerSecond = result.seconds > 0 ? result.frames / result.seconds : 0;
+            const double mbPerSecond = result.seconds > 0 ? result.bytes / (1024.0 * 1024.0) / result.seconds : 0;
+            Out() << QString("%1 %2 %3 %4 %5\n").arg(result.name, -26).arg(result.parts, 8).arg(result.seconds, 10, 'f', 4).arg(itemsPerSecond, 12, 'f', 0).arg(result.bytes > 0 ? QString::number(mbPerSecond, 'f', 1) : QString("-"), 10);
+        }
+    }
+    return 0;
+}
+
+int Generate(const QStringList& arguments){
+    QStringList args = arguments;
+    GeneratorSettings settings;
+    bool ok = true;
+    settings.seed = (quint32) TakeIntOption(args, "--seed", (int) settings.seed, &ok);
+    settings.numParts = TakeIntOption(args, "--parts", settings.numParts, &ok);
+    settings.modesPerPart = TakeIntOption(args, "--modes", settings.modesPerPart, &ok);
+    settings.framesPerMode = TakeIntOption(args, "--frames", settings.framesPerMode, &ok);
+    settings.frameSize = TakeIntOption(args, "--size", settings.frameSize, &ok);
+    settings.folderDepth = TakeIntOption(args, "--depth", settings.folderDepth, &ok);
+    settings.foldersPerLevel = TakeIntOption(args, "--folders", settings.foldersPerLevel, &ok);
+    settings.numComposites = TakeIntOption(args, "--composites", settings.numComposites, &ok);
+    settings.compositeSize = TakeIntOption(args, "--children", settings.compositeSize, &ok);
+    bool parsed = true;
+    settings.duplicateRatio = TakeOption(args, "--duplicates", QString::number(settings.duplicateRatio), &ok).toDouble(&parsed);
+    if (!ok || !parsed || args.size() != 1) return -1;
+
+    QStringList log;
+    bool result = GenerateProject(settings, &log);
+    PrintLog("Generator issues", log);
+    if (!result) return 1;
+
+    PM()->exportLog.clear();
+    result = PM()->save(args.at(0));
+    PrintLog("Save issues", PM()->exportLog);
+    if (!result){
+        Err() << "Couldn't save " << args.at(0) << "\n";
+        return 1;
+    }
+    Out() << "Generated " << PM()->parts.size() << " sprites, " << PM()->composites.size() << " composites and " << PM()->folders.size() << " folders in " << args.at(0) << "\n";
+    return 0;
+}
+
+struct CliCommand {
+    const char* name;
+    const char* arguments;
+    const char* description;
+    int (*run)(const QStringList& args); // Returns the exit code, or -1 for bad arguments
+};
+
+const CliCommand Commands[] = {
+    {"export", "<project.mqs> <directory> [--trim]", "Export sprites to images and data.json (see File > Export As)", Export},
+    {"atlas", "<project.mqs> <directory> [--size 2048] [--pages 0] [--padding 1] [--trim]", "Export sprites packed into power of two atlas pages, with atlas.json", Atlas},
+    {"stats", "<project.mqs> [--json]", "Print asset counts and sizes", Stats},
+    {"report", "<project.mqs> [--top 20] [--json]", "Print memory and storage per sprite and per folder (see View > Project Statistics Window)", Report},
+    {"validate", "<project.mqs>", "Check the project for inconsistencies, exits with 1 if there are any", Validate},
+    {"convert", "<project.mqs> <output.mqs>", "Load and re-save a project in the current file format", Convert},
+    {"generate", "<output.mqs> [--parts 100] [--modes 2] [--frames 4] [--size 32] [--depth 0] [--folders 2] [--composites 0] [--children 4] [--duplicates 0] [--seed 1]",
+        "Generate a synthetic project, the same arguments always give the same project", Generate},
+    {"bench", "[--parts 10,100,1000] [--frames 4] [--size 32] [--repeat 3] [--json]", "Time load, save, search, export, zip, icons, flood fill and copying on synthetic projects", Bench},
+};
+
+void PrintUsage(){
+    Err() << "Usage: mqsprite-cli <command> [arguments]\n\nCommands:\n";
+    for (const CliCommand& command: Commands){
+        Err() << "  " << command.name << " " << command.arguments << "\n      " << command.description << "\n";
+    }
+    Err().flush();
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication::setOrganizationName("Wizard Mode");
+    QCoreApplication::setOrganizationDomain("playmoonquest.com");
+    QCoreApplication::setApplicationName("MQ Sprite");
+    QCoreApplication a(argc, argv);
+    Trace::startFromEnvironment();
+
+    QStringList args = a.arguments().mid(1);
+    if (args.isEmpty()){
+        PrintUsage();
+        return 2;
+    }
+
+    const QString name = args.takeFirst();
+    for (const CliCommand& command: Commands){
+        if (name == command.name){
+            ProjectModel model;
+            const int result = command.run(args);
+            Trace::stop();
+            if (result < 0){
+                Err() << "Usage: mqsprite-cli " << command.name << " " << command.arguments << "\n";
+                return 2;
+            }
+            return result;
+        }
+    }
+
+    Err() << "Unknown command " << name << "\n";
+    PrintUsage();
+    return 2;
+}
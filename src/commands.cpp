@@ -1,14 +1,45 @@
 #include "commands.h"
-#include "mainwindow.h"
+#include "assetindex.h"
+#include "trace.h"
 #include <QObject>
 #include <QString>
 
 static int sNewCompositeSuffix = 0;
 static int sNewModeSuffix = 0;
 
+static qint64 ImageBytes(const QImage& image){
+    return image.isNull() ? 0 : image.byteCount();
+}
+
+static qint64 ModeBytes(const Part::Mode& mode){
+    qint64 bytes = 0;
+    for (const auto& img: mode.frames){
+        if (img) bytes += ImageBytes(*img);
+    }
+    return bytes;
+}
+
+static ProjectListener sNullListener;
+static ProjectListener* sListener = &sNullListener;
+
+void SetProjectListener(ProjectListener* listener){
+    sListener = listener ? listener : &sNullListener;
+}
+
+ProjectListener* GetProjectListener(){
+    return sListener;
+}
+
 bool TryCommand(Command* command){
     if (command->ok){
-        MainWindow::Instance()->undoStack()->push(command);
+        QUndoStack* undoStack = GetProjectListener()->undoStack();
+        if (undoStack){
+            undoStack->push(command);
+        }
+        else {
+            command->redo();
+            delete command;
+        }
         return true;
     }
     else {
@@ -17,19 +48,32 @@ bool TryCommand(Command* command){
     }
 }
 
+void Command::undo(){
+    TRACE_SCOPE("Command::undo");
+    doUndo();
+}
+
+void Command::redo(){
+    TRACE_SCOPE("Command::redo");
+    doRedo();
+}
+
 CNewPart::CNewPart() {
 	mRef = PM()->createAssetRef(AssetType::Part);
     ok = true;
 }
 
-void CNewPart::undo()
+void CNewPart::doUndo()
 {
+    PM()->searchIndex()->invalidate(mRef);
     PM()->parts.take(mRef);
-    MainWindow::Instance()->partListChanged();
+    GetProjectListener()->assetRemoved(mRef);
+    GetProjectListener()->partListChanged();
 }
 
-void CNewPart::redo()
+void CNewPart::doRedo()
 {
+    PM()->searchIndex()->invalidate(mRef);
     // Find a unique name
     QString name;
     int number = 0;
@@ -57,8 +101,9 @@ void CNewPart::redo()
 
     part->modes.insert("icon", mode);
     PM()->parts.insert(part->ref, part);
+    GetProjectListener()->assetInserted(part->ref);
 
-	MainWindow::Instance()->newAssetCreated(part->ref);
+	GetProjectListener()->newAssetCreated(part->ref);
 }
 
 CCopyPart::CCopyPart(AssetRef ref){
@@ -81,12 +126,15 @@ CCopyPart::CCopyPart(AssetRef ref){
     }
 }
 
-void CCopyPart::undo(){
+void CCopyPart::doUndo(){
+    PM()->searchIndex()->invalidate(mCopy);
     PM()->parts.take(mCopy);
-    MainWindow::Instance()->partListChanged();
+    GetProjectListener()->assetRemoved(mCopy);
+    GetProjectListener()->partListChanged();
 }
 
-void CCopyPart::redo(){
+void CCopyPart::doRedo(){
+    PM()->searchIndex()->invalidate(mCopy);
     auto partToCopy = PM()->parts.value(mOriginal);
     Q_ASSERT(partToCopy);
 
@@ -95,6 +143,7 @@ void CCopyPart::redo(){
     part->name = mNewPartName;
     part->parent = partToCopy->parent;
     part->properties = partToCopy->properties;
+    part->propertiesCache = partToCopy->propertiesCache;
     QMapIterator<QString, Part::Mode> it(partToCopy->modes);
     while (it.hasNext()) {
         it.next();
@@ -114,24 +163,37 @@ void CCopyPart::redo(){
         part->modes.insert(key, newMode);
     }
     PM()->parts.insert(mCopy, part);    
+    GetProjectListener()->assetInserted(mCopy);
 
-	MainWindow::Instance()->newAssetCreated(part->ref);
+	GetProjectListener()->newAssetCreated(part->ref);
 }
 
 CDeletePart::CDeletePart(AssetRef ref):mRef(ref),mCopy() {
     ok = PM()->parts.contains(ref);
 }
 
-void CDeletePart::undo()
+void CDeletePart::doUndo()
 {
+    PM()->searchIndex()->invalidate(mRef);
     PM()->parts.insert(mRef, mCopy);
-    MainWindow::Instance()->partListChanged();
+    GetProjectListener()->assetInserted(mRef);
+    GetProjectListener()->partListChanged();
 }
 
-void CDeletePart::redo()
+void CDeletePart::doRedo()
 {
+    PM()->searchIndex()->invalidate(mRef);
     mCopy = PM()->parts.take(mRef);
-    // MainWindow::Instance()->partListChanged();
+    GetProjectListener()->assetRemoved(mRef);
+    // GetProjectListener()->partListChanged();
+}
+
+qint64 CDeletePart::memoryBytes() const {
+    qint64 bytes = 0;
+    if (mCopy){
+        for (const Part::Mode& mode: mCopy->modes) bytes += ModeBytes(mode);
+    }
+    return bytes;
 }
 
 CRenamePart::CRenamePart(AssetRef ref, QString newName):mRef(ref){
@@ -145,19 +207,21 @@ CRenamePart::CRenamePart(AssetRef ref, QString newName):mRef(ref){
     } while (PM()->findPartByName(mNewName)!=nullptr);
 }
 
-void CRenamePart::undo(){
+void CRenamePart::doUndo(){
+    PM()->searchIndex()->invalidate(mRef);
     auto p = PM()->parts[mRef];
     p->name = mOldName;
 
-    MainWindow::Instance()->partRenamed(mRef, mOldName);
+    GetProjectListener()->partRenamed(mRef, mOldName);
 }
 
-void CRenamePart::redo(){
+void CRenamePart::doRedo(){
+    PM()->searchIndex()->invalidate(mRef);
     auto p = PM()->parts[mRef];
     mOldName = p->name;
     p->name = mNewName;
 
-    MainWindow::Instance()->partRenamed(mRef, mNewName);
+    GetProjectListener()->partRenamed(mRef, mNewName);
 }
 
 CNewComposite::CNewComposite() {
@@ -173,20 +237,24 @@ CNewComposite::CNewComposite() {
     ok = true;
 }
 
-void CNewComposite::undo()
+void CNewComposite::doUndo()
 {
+    PM()->searchIndex()->invalidate(mRef);
     PM()->composites.take(mRef);
-    MainWindow::Instance()->partListChanged();
+    GetProjectListener()->assetRemoved(mRef);
+    GetProjectListener()->partListChanged();
 }
 
-void CNewComposite::redo()
+void CNewComposite::doRedo()
 {
+    PM()->searchIndex()->invalidate(mRef);
     QSharedPointer<Composite> comp = QSharedPointer<Composite>::create();
     comp->root = -1;
     comp->name = mName;
     comp->ref = mRef;
     PM()->composites.insert(comp->ref, comp);
-    MainWindow::Instance()->newAssetCreated(comp->ref);
+    GetProjectListener()->assetInserted(comp->ref);
+    GetProjectListener()->newAssetCreated(comp->ref);
 }
 
 CCopyComposite::CCopyComposite(AssetRef ref){
@@ -202,12 +270,14 @@ CCopyComposite::CCopyComposite(AssetRef ref){
     }
 }
 
-void CCopyComposite::undo(){
+void CCopyComposite::doUndo(){
+    PM()->searchIndex()->invalidate(mCopy);
     PM()->composites.take(mCopy);
-    MainWindow::Instance()->partListChanged();
+    GetProjectListener()->assetRemoved(mCopy);
+    GetProjectListener()->partListChanged();
 }
 
-void CCopyComposite::redo(){
+void CCopyComposite::doRedo(){
     auto comp = PM()->getComposite(mOriginal);
 
     QSharedPointer<Composite> copy = QSharedPointer<Composite>::create();
@@ -218,28 +288,81 @@ void CCopyComposite::redo(){
     copy->parent = comp->parent;
     copy->root = comp->root;
     copy->properties = comp->properties;
+    copy->propertiesCache = comp->propertiesCache;
     copy->children = comp->children;
     copy->childrenMap = comp->childrenMap;
     PM()->composites.insert(copy->ref, copy);
+    PM()->searchIndex()->invalidate(mCopy);
+    GetProjectListener()->assetInserted(mCopy);
 
-    // MainWindow::Instance()->partListChanged();
+    // GetProjectListener()->partListChanged();
+}
+
+CBakeComposite::CBakeComposite(AssetRef ref, const BakeSettings& settings, QStringList* log){
+    Composite* comp = PM()->getComposite(ref);
+    BakedComposite baked;
+    ok = comp != nullptr && BakeComposite(*comp, settings, &baked, log);
+    if (ok){
+        QString name;
+        int number = 0;
+        do {
+            name = comp->name + ((number==0)?QString("_baked"):(QObject::tr("_baked_") + QString::number(number)));
+            number++;
+        } while (PM()->findPartByName(name)!=nullptr);
+
+        mPart = QSharedPointer<Part>::create();
+        mPart->ref = PM()->createAssetRef(AssetType::Part);
+        mPart->name = name;
+        mPart->parent = comp->parent;
+
+        Part::Mode mode;
+        mode.width = baked.width;
+        mode.height = baked.height;
+        mode.numFrames = baked.frames.size();
+        mode.numPivots = baked.numPivots;
+        mode.framesPerSecond = baked.framesPerSecond;
+        mode.frames = baked.frames;
+        mode.anchor = baked.anchor;
+        for(int p=0;p<Part::MaxPivots;p++){
+            mode.pivots[p] = baked.pivots[p];
+        }
+        mPart->modes.insert("bake", mode);
+    }
+}
+
+void CBakeComposite::doUndo(){
+    PM()->searchIndex()->invalidate(mPart->ref);
+    PM()->parts.take(mPart->ref);
+    GetProjectListener()->assetRemoved(mPart->ref);
+    GetProjectListener()->partListChanged();
+}
+
+void CBakeComposite::doRedo(){
+    PM()->searchIndex()->invalidate(mPart->ref);
+    PM()->parts.insert(mPart->ref, mPart);
+    GetProjectListener()->assetInserted(mPart->ref);
+    GetProjectListener()->newAssetCreated(mPart->ref);
 }
 
 CDeleteComposite::CDeleteComposite(AssetRef ref): mRef(ref), mCopy(){
     ok = PM()->hasComposite(ref);
 }
 
-void CDeleteComposite::undo()
+void CDeleteComposite::doUndo()
 {
+    PM()->searchIndex()->invalidate(mRef);
     PM()->composites.insert(mRef, mCopy);
-    MainWindow::Instance()->partListChanged();
+    GetProjectListener()->assetInserted(mRef);
+    GetProjectListener()->partListChanged();
 }
 
-void CDeleteComposite::redo()
+void CDeleteComposite::doRedo()
 {
+    PM()->searchIndex()->invalidate(mRef);
     mCopy = PM()->composites.take(mRef);
+    GetProjectListener()->assetRemoved(mRef);
 
-    // MainWindow::Instance()->partListChanged();
+    // GetProjectListener()->partListChanged();
 }
 
 CRenameComposite::CRenameComposite(AssetRef ref, QString newName):mRef(ref),mNewName(newName){
@@ -256,18 +379,20 @@ CRenameComposite::CRenameComposite(AssetRef ref, QString newName):mRef(ref),mNew
     }
 }
 
-void CRenameComposite::undo(){
+void CRenameComposite::doUndo(){
+    PM()->searchIndex()->invalidate(mRef);
     Composite* p = PM()->getComposite(mRef);
     p->name = mOldName;
 
-    MainWindow::Instance()->compositeRenamed(mRef, mOldName);
+    GetProjectListener()->compositeRenamed(mRef, mOldName);
 }
 
-void CRenameComposite::redo(){
+void CRenameComposite::doRedo(){
+    PM()->searchIndex()->invalidate(mRef);
     Composite* p = PM()->getComposite(mRef);
     p->name = mNewName;
 
-    MainWindow::Instance()->compositeRenamed(mRef, mNewName);
+    GetProjectListener()->compositeRenamed(mRef, mNewName);
 }
 
 CNewFolder::CNewFolder() {
@@ -276,14 +401,17 @@ CNewFolder::CNewFolder() {
     ok = true;
 }
 
-void CNewFolder::undo()
+void CNewFolder::doUndo()
 {
+    PM()->searchIndex()->invalidate(mRef);
     PM()->folders.take(mRef);
-    MainWindow::Instance()->partListChanged();
+    GetProjectListener()->assetRemoved(mRef);
+    GetProjectListener()->partListChanged();
 }
 
-void CNewFolder::redo()
+void CNewFolder::doRedo()
 {
+    PM()->searchIndex()->invalidate(mRef);
     // Find a unique name
     QString name;
     int number = 0;
@@ -296,28 +424,33 @@ void CNewFolder::redo()
     folder->ref = mRef;
     folder->name = name;
     PM()->folders.insert(folder->ref, folder);
+    GetProjectListener()->assetInserted(mRef);
 
-    MainWindow::Instance()->newAssetCreated(mRef);
+    GetProjectListener()->newAssetCreated(mRef);
 }
 
 CDeleteFolder::CDeleteFolder(AssetRef ref):mRef(ref),mCopy() {
     ok = PM()->hasFolder(ref);
 }
 
-void CDeleteFolder::undo()
+void CDeleteFolder::doUndo()
 {
+    PM()->searchIndex()->invalidate(mRef);
     qDebug() << "TODO: Undelete the folder contents";
     PM()->folders.insert(mRef, mCopy);
+    GetProjectListener()->assetInserted(mRef);
 
-    MainWindow::Instance()->partListChanged();
+    GetProjectListener()->partListChanged();
 }
 
-void CDeleteFolder::redo()
+void CDeleteFolder::doRedo()
 {
+    PM()->searchIndex()->invalidate(mRef);
     qDebug() << "TODO: Deleting the folder contents";
     mCopy = PM()->folders.take(mRef);
+    GetProjectListener()->assetRemoved(mRef);
 
-    // MainWindow::Instance()->partListChanged();
+    // GetProjectListener()->partListChanged();
 }
 
 CRenameFolder::CRenameFolder(AssetRef ref, QString newName):mRef(ref){
@@ -331,19 +464,21 @@ CRenameFolder::CRenameFolder(AssetRef ref, QString newName):mRef(ref){
     } while (PM()->findFolderByName(mNewName)!=nullptr);
 }
 
-void CRenameFolder::undo(){
+void CRenameFolder::doUndo(){
+    PM()->searchIndex()->invalidate(mRef);
     Folder* f = PM()->getFolder(mRef);
     f->name = mOldName;
 
-    MainWindow::Instance()->folderRenamed(mRef, mOldName);
+    GetProjectListener()->folderRenamed(mRef, mOldName);
 }
 
-void CRenameFolder::redo(){
+void CRenameFolder::doRedo(){
+    PM()->searchIndex()->invalidate(mRef);
     Folder* f = PM()->getFolder(mRef);
     mOldName = f->name;
     f->name = mNewName;
 
-    MainWindow::Instance()->folderRenamed(mRef, mNewName);
+    GetProjectListener()->folderRenamed(mRef, mNewName);
 }
 
 
@@ -356,7 +491,7 @@ CMoveAsset::CMoveAsset(AssetRef ref, AssetRef newParent):mRef(ref),mNewParent(ne
     }
 }
 
-void CMoveAsset::undo(){
+void CMoveAsset::doUndo(){
     // Move the asset back
     Asset* asset = PM()->getAsset(mRef);
     asset->parent = mOldParent;
@@ -371,10 +506,11 @@ void CMoveAsset::undo(){
         oldParent->children.append(asset->ref);
     }
 
-    MainWindow::Instance()->partListChanged();
+    GetProjectListener()->assetMoved(mRef);
+    GetProjectListener()->partListChanged();
 }
 
-void CMoveAsset::redo(){
+void CMoveAsset::doRedo(){
     // Move the asset
     Asset* asset = PM()->getAsset(mRef);
     asset->parent = mNewParent;
@@ -389,8 +525,10 @@ void CMoveAsset::redo(){
         oldParent->children.removeAll(asset->ref);
     }
 
+    GetProjectListener()->assetMoved(mRef);
+
     // NB: partListChanged() is called just once from PartList after all its moves are done
-    // MainWindow::Instance()->partListChanged();
+    // GetProjectListener()->partListChanged();
 }
 
 
@@ -422,13 +560,15 @@ CNewMode::CNewMode(AssetRef part, const QString& copyModeName):mPart(part), mCop
     }
 }
 
-void CNewMode::undo(){
+void CNewMode::doUndo(){
+    PM()->searchIndex()->invalidate(mPart);
     auto p = PM()->getPart(mPart);
     p->modes.take(mModeName);
-    MainWindow::Instance()->partModesChanged(mPart);
+    GetProjectListener()->partModesChanged(mPart);
 }
 
-void CNewMode::redo(){
+void CNewMode::doRedo(){
+    PM()->searchIndex()->invalidate(mPart);
     auto p = PM()->parts.value(mPart);
     Part::Mode copyMode = p->modes.value(mCopyModeName);
     Part::Mode m;
@@ -445,7 +585,7 @@ void CNewMode::redo(){
     img->fill(0x00FFFFFF);
 	m.frames.push_back(img);
     p->modes.insert(mModeName,m);
-    MainWindow::Instance()->partModesChanged(mPart);
+    GetProjectListener()->partModesChanged(mPart);
 }
 
 
@@ -454,18 +594,24 @@ CDeleteMode::CDeleteMode(AssetRef part, const QString& modeName):mPart(part),mMo
     ok = PM()->hasPart(mPart) && PM()->getPart(mPart)->modes.contains(mModeName);
 }
 
-void CDeleteMode::undo(){
+void CDeleteMode::doUndo(){
+    PM()->searchIndex()->invalidate(mPart);
     // re-add the mode..
     auto p = PM()->getPart(mPart);
     p->modes.insert(mModeName, mModeCopy);
-    MainWindow::Instance()->partModesChanged(mPart);
+    GetProjectListener()->partModesChanged(mPart);
 }
 
-void CDeleteMode::redo(){
+void CDeleteMode::doRedo(){
+    PM()->searchIndex()->invalidate(mPart);
     // remove the mode..
     auto p = PM()->getPart(mPart);
     mModeCopy = p->modes.take(mModeName);
-    MainWindow::Instance()->partModesChanged(mPart);
+    GetProjectListener()->partModesChanged(mPart);
+}
+
+qint64 CDeleteMode::memoryBytes() const {
+    return ModeBytes(mModeCopy);
 }
 
 
@@ -474,16 +620,16 @@ CResetMode::CResetMode(AssetRef part, const QString& modeName):mPart(part),mMode
     ok = PM()->hasPart(mPart) && PM()->getPart(mPart)->modes.contains(mModeName);
 }
 
-void CResetMode::undo(){
+void CResetMode::doUndo(){
     // re-add the mode..
     auto p = PM()->getPart(mPart);
     p->modes.remove(mModeName);
     p->modes.insert(mModeName, mModeCopy);
 
-    MainWindow::Instance()->partModesChanged(mPart);
+    GetProjectListener()->partModesChanged(mPart);
 }
 
-void CResetMode::redo(){
+void CResetMode::doRedo(){
     auto p = PM()->getPart(mPart);
     Part::Mode& mode = p->modes[mModeName];
 
@@ -509,7 +655,11 @@ void CResetMode::redo(){
     mode.numPivots = 0;
     mode.numFrames = 1;
     mode.framesPerSecond = 8;
-    MainWindow::Instance()->partModesChanged(mPart);
+    GetProjectListener()->partModesChanged(mPart);
+}
+
+qint64 CResetMode::memoryBytes() const {
+    return ModeBytes(mModeCopy);
 }
 
 
@@ -529,14 +679,16 @@ CCopyMode::CCopyMode(AssetRef part, const QString& modeName):mPart(part), mModeN
     }
 }
 
-void CCopyMode::undo(){
+void CCopyMode::doUndo(){
+    PM()->searchIndex()->invalidate(mPart);
     // remove the mode..
     auto p = PM()->getPart(mPart);
     Part::Mode mode = p->modes.take(mNewModeName);
-    MainWindow::Instance()->partModesChanged(mPart);
+    GetProjectListener()->partModesChanged(mPart);
 }
 
-void CCopyMode::redo(){
+void CCopyMode::doRedo(){
+    PM()->searchIndex()->invalidate(mPart);
     auto p = PM()->getPart(mPart);
     const Part::Mode& copyMode = p->modes.value(mModeName);
     Part::Mode m;
@@ -553,7 +705,7 @@ void CCopyMode::redo(){
         m.frames.push_back(img);
     }
     p->modes.insert(mNewModeName,m);
-    MainWindow::Instance()->partModesChanged(mPart);
+    GetProjectListener()->partModesChanged(mPart);
 }
 
 CRenameMode::CRenameMode(AssetRef part, const QString& oldModeName, const QString& newModeName)
@@ -568,20 +720,22 @@ CRenameMode::CRenameMode(AssetRef part, const QString& oldModeName, const QStrin
     ok =PM()->hasPart(mPart) && PM()->getPart(mPart)->modes.contains(mOldModeName) && !PM()->getPart(mPart)->modes.contains(mNewModeName);
 }
 
-void CRenameMode::undo(){
+void CRenameMode::doUndo(){
+    PM()->searchIndex()->invalidate(mPart);
     Part* p = PM()->getPart(mPart);
     Part::Mode m = p->modes.take(mNewModeName);
     p->modes.insert(mOldModeName, m);
 
-    MainWindow::Instance()->partModeRenamed(mPart, mNewModeName, mOldModeName);
+    GetProjectListener()->partModeRenamed(mPart, mNewModeName, mOldModeName);
 }
 
-void CRenameMode::redo(){
+void CRenameMode::doRedo(){
+    PM()->searchIndex()->invalidate(mPart);
     Part* p = PM()->getPart(mPart);
     Part::Mode m = p->modes.take(mOldModeName);
     p->modes.insert(mNewModeName, m);
 
-    MainWindow::Instance()->partModeRenamed(mPart, mOldModeName, mNewModeName);
+    GetProjectListener()->partModeRenamed(mPart, mOldModeName, mNewModeName);
 }
 
 
@@ -596,34 +750,38 @@ CDrawOnPart::CDrawOnPart(AssetRef part, QString mode, int frame, QImage data, QP
             p->modes.contains(mode) &&
             p->modes[mode].numFrames >= frame && // TODO: Check this
             p->modes[mode].frames.at(frame)!=nullptr;
+    if (ok){
+        // Only the tiles that are drawn on are kept for undo
+        mTiles = OpaqueTiles(mData, mOffset, p->modes[mode].frames.at(frame)->size());
+    }
 }
 
-void CDrawOnPart::undo(){
-    //qDebug() << "CDrawOnPart::undo()";
-    // Reload the old frame
+void CDrawOnPart::doUndo(){
+    // Reload the old tiles
     auto img = PM()->getPart(mPart)->modes[mMode].frames.at(mFrame);
-    QPainter painter(img.data());
-    painter.setCompositionMode(QPainter::CompositionMode_Source);
-    painter.drawImage(0, 0, mOldFrame);
-    // *img = mOldFrame;
+    RestoreTiles(img.data(), mOldTiles);
 
     // tell everyone that the part has been updated
 	PM()->resetImageCache(img.get());
-    MainWindow::Instance()->partFrameUpdated(mPart, mMode, mFrame);
+    GetProjectListener()->partFrameUpdated(mPart, mMode, mFrame, mOldTiles.bounds());
 }
 
-void CDrawOnPart::redo(){
-    //qDebug() << "CDrawOnPart::redo()";
-    // Record the old frame
+void CDrawOnPart::doRedo(){
+    // Record the old tiles
     // Draw the image into the part
     auto img = PM()->getPart(mPart)->modes[mMode].frames.at(mFrame);
-    mOldFrame = img->copy();
+    mOldTiles = SaveTiles(*img, mTiles);
     QPainter painter(img.data());
     painter.drawImage(mOffset.x(), mOffset.y(), mData);
+    painter.end();
 
     // tell everyone that the part has been updated
 	PM()->resetImageCache(img.get());
-    MainWindow::Instance()->partFrameUpdated(mPart, mMode, mFrame);
+    GetProjectListener()->partFrameUpdated(mPart, mMode, mFrame, mOldTiles.bounds());
+}
+
+qint64 CDrawOnPart::memoryBytes() const {
+    return ImageBytes(mData) + mOldTiles.bytes();
 }
 
 CEraseOnPart::CEraseOnPart(AssetRef part, QString mode, int frame, QImage data, QPoint offset)
@@ -633,32 +791,38 @@ CEraseOnPart::CEraseOnPart(AssetRef part, QString mode, int frame, QImage data,
             p->modes.contains(mode) &&
             p->modes[mode].numFrames>=frame &&
             p->modes[mode].frames.at(frame)!=nullptr;
+    if (ok){
+        mTiles = OpaqueTiles(mData, mOffset, p->modes[mode].frames.at(frame)->size());
+    }
 }
 
-void CEraseOnPart::undo(){
-    // Reload the old frame
+void CEraseOnPart::doUndo(){
+    // Reload the old tiles
     auto img = PM()->getPart(mPart)->modes[mMode].frames.at(mFrame);
-    QPainter painter(img.data());
-    painter.drawImage(0, 0, mOldFrame);
-    // *img = mOldFrame;
+    RestoreTiles(img.data(), mOldTiles);
 
     // tell everyone that the part has been updated
 	PM()->resetImageCache(img.get());
-    MainWindow::Instance()->partFrameUpdated(mPart, mMode, mFrame);
+    GetProjectListener()->partFrameUpdated(mPart, mMode, mFrame, mOldTiles.bounds());
 }
 
-void CEraseOnPart::redo(){
-    // Record the old frame
+void CEraseOnPart::doRedo(){
+    // Record the old tiles
     // Draw the image into the part
     auto img = PM()->getPart(mPart)->modes[mMode].frames.at(mFrame);
-    mOldFrame = *img;
+    mOldTiles = SaveTiles(*img, mTiles);
     QPainter painter(img.data());
     painter.setCompositionMode(QPainter::CompositionMode_DestinationOut);
     painter.drawImage(mOffset.x(), mOffset.y(), mData);
+    painter.end();
 
     // tell everyone that the part has been updated
 	PM()->resetImageCache(img.get());
-    MainWindow::Instance()->partFrameUpdated(mPart, mMode, mFrame);
+    GetProjectListener()->partFrameUpdated(mPart, mMode, mFrame, mOldTiles.bounds());
+}
+
+qint64 CEraseOnPart::memoryBytes() const {
+    return ImageBytes(mData) + mOldTiles.bytes();
 }
 
 
@@ -673,7 +837,7 @@ CNewFrame::CNewFrame(AssetRef part, QString modeName, int index)
     }
 }
 
-void CNewFrame::undo(){
+void CNewFrame::doUndo(){
     auto part = PM()->getPart(mPart);
     Part::Mode& mode = part->modes[mModeName];
     mode.frames.takeAt(mIndex);
@@ -683,10 +847,10 @@ void CNewFrame::undo(){
     }
     mode.numFrames--;
 
-    MainWindow::Instance()->partFramesUpdated(mPart, mModeName);
+    GetProjectListener()->partFramesUpdated(mPart, mModeName);
 }
 
-void CNewFrame::redo(){
+void CNewFrame::doRedo(){
     // Create the new frame
     auto part = PM()->getPart(mPart);
     Part::Mode& mode = part->modes[mModeName];
@@ -711,7 +875,7 @@ void CNewFrame::redo(){
     }
     mode.numFrames++;
 
-    MainWindow::Instance()->partFramesUpdated(mPart, mModeName);
+    GetProjectListener()->partFramesUpdated(mPart, mModeName);
 }
 
 CCopyFrame::CCopyFrame(AssetRef part, QString modeName, int index)
@@ -724,7 +888,7 @@ CCopyFrame::CCopyFrame(AssetRef part, QString modeName, int index)
     }
 }
 
-void CCopyFrame::undo(){
+void CCopyFrame::doUndo(){
     auto part = PM()->getPart(mPart);
     Part::Mode& mode = part->modes[mModeName];
     mode.frames.takeAt(mIndex+1);
@@ -733,10 +897,10 @@ void CCopyFrame::undo(){
         mode.pivots[i].removeAt(mIndex+1);
     }
     mode.numFrames--;
-    MainWindow::Instance()->partFramesUpdated(mPart, mModeName);
+    GetProjectListener()->partFramesUpdated(mPart, mModeName);
 }
 
-void CCopyFrame::redo(){
+void CCopyFrame::doRedo(){
     // Create the new frame
     Part* part = PM()->getPart(mPart);
     Part::Mode& mode = part->modes[mModeName];
@@ -767,7 +931,7 @@ void CCopyFrame::redo(){
     }
     mode.numFrames++;
 
-    MainWindow::Instance()->partFramesUpdated(mPart, mModeName);
+    GetProjectListener()->partFramesUpdated(mPart, mModeName);
 }
 
 CDeleteFrame::CDeleteFrame(AssetRef part, QString modeName, int index)
@@ -780,7 +944,7 @@ CDeleteFrame::CDeleteFrame(AssetRef part, QString modeName, int index)
     }
 }
 
-void CDeleteFrame::undo(){
+void CDeleteFrame::doUndo(){
     // Create the new frame
     auto part = PM()->getPart(mPart);
     Part::Mode& mode = part->modes[mModeName];
@@ -792,11 +956,11 @@ void CDeleteFrame::undo(){
     mode.numFrames++;
     mImage.clear();
 
-    MainWindow::Instance()->partFramesUpdated(mPart, mModeName);
+    GetProjectListener()->partFramesUpdated(mPart, mModeName);
 
 }
 
-void CDeleteFrame::redo(){
+void CDeleteFrame::doRedo(){
     // NB: Remember old frame info (image, etc..)
     auto part = PM()->getPart(mPart);
     Part::Mode& mode = part->modes[mModeName];
@@ -807,7 +971,11 @@ void CDeleteFrame::redo(){
     }
     mode.numFrames--;
 
-    MainWindow::Instance()->partFramesUpdated(mPart, mModeName);
+    GetProjectListener()->partFramesUpdated(mPart, mModeName);
+}
+
+qint64 CDeleteFrame::memoryBytes() const {
+    return mImage ? ImageBytes(*mImage) : 0;
 }
 
 
@@ -827,17 +995,17 @@ CUpdateAnchorAndPivots::CUpdateAnchorAndPivots(AssetRef part, QString modeName,
             p->modes[mModeName].numFrames>mIndex;
 }
 
-void CUpdateAnchorAndPivots::undo(){
+void CUpdateAnchorAndPivots::doUndo(){
     Part* part = PM()->getPart(mPart);
     Part::Mode& mode = part->modes[mModeName];
     mode.anchor.replace(mIndex, mOldAnchor);
     for(int i=0;i<mode.numPivots;i++){
         mode.pivots[i].replace(mIndex, mOldPivots[i]);
     }
-    MainWindow::Instance()->partFrameUpdated(mPart, mModeName, mIndex);
+    GetProjectListener()->partFrameUpdated(mPart, mModeName, mIndex, QRect());
 }
 
-void CUpdateAnchorAndPivots::redo(){
+void CUpdateAnchorAndPivots::doRedo(){
     Part* part = PM()->getPart(mPart);
     Part::Mode& mode = part->modes[mModeName];
     mOldAnchor = mode.anchor.at(mIndex);
@@ -847,7 +1015,7 @@ void CUpdateAnchorAndPivots::redo(){
         mode.pivots[i].replace(mIndex, mPivots[i]);
     }
 
-    MainWindow::Instance()->partFrameUpdated(mPart, mModeName, mIndex);
+    GetProjectListener()->partFrameUpdated(mPart, mModeName, mIndex, QRect());
 }
 
 CChangeNumPivots::CChangeNumPivots(AssetRef part, QString modeName, int numPivots)
@@ -856,21 +1024,21 @@ CChangeNumPivots::CChangeNumPivots(AssetRef part, QString modeName, int numPivot
             PM()->getPart(part)->modes.contains(modeName);
 }
 
-void CChangeNumPivots::undo(){
+void CChangeNumPivots::doUndo(){
     Part* part = PM()->getPart(mPart);
     Part::Mode& mode = part->modes[mModeName];
     mode.numPivots = mOldNumPivots;
 
-    MainWindow::Instance()->partNumPivotsUpdated(mPart, mModeName);
+    GetProjectListener()->partNumPivotsUpdated(mPart, mModeName);
 }
 
-void CChangeNumPivots::redo(){
+void CChangeNumPivots::doRedo(){
     Part* part = PM()->getPart(mPart);
     Part::Mode& mode = part->modes[mModeName];
     mOldNumPivots = mode.numPivots;
     mode.numPivots = mNumPivots;
 
-    MainWindow::Instance()->partNumPivotsUpdated(mPart, mModeName);
+    GetProjectListener()->partNumPivotsUpdated(mPart, mModeName);
 }
 
 CChangeModeSize::CChangeModeSize(AssetRef part, QString modeName, int width, int height, int offsetx, int offsety)
@@ -880,13 +1048,13 @@ CChangeModeSize::CChangeModeSize(AssetRef part, QString modeName, int width, int
     ok = ok && mWidth>0 && mHeight>0;
 }
 
-void CChangeModeSize::undo(){
+void CChangeModeSize::doUndo(){
     Part* part = PM()->getPart(mPart);
     part->modes[mModeName] = mOldMode;
-    MainWindow::Instance()->partModesChanged(mPart);
+    GetProjectListener()->partModesChanged(mPart);
 }
 
-void CChangeModeSize::redo(){
+void CChangeModeSize::doRedo(){
     Part* part = PM()->getPart(mPart);
     Part::Mode& mode = part->modes[mModeName];
     mOldWidth = mode.width;
@@ -919,7 +1087,11 @@ void CChangeModeSize::redo(){
         }
     }
 
-    MainWindow::Instance()->partModesChanged(mPart);
+    GetProjectListener()->partModesChanged(mPart);
+}
+
+qint64 CChangeModeSize::memoryBytes() const {
+    return ModeBytes(mOldMode);
 }
 
 CChangeModeFPS::CChangeModeFPS(AssetRef part, QString modeName, int fps)
@@ -929,19 +1101,19 @@ CChangeModeFPS::CChangeModeFPS(AssetRef part, QString modeName, int fps)
     ok = ok && mFPS>0;
 }
 
-void CChangeModeFPS::undo(){
+void CChangeModeFPS::doUndo(){
     Part* part = PM()->getPart(mPart);
     Part::Mode& mode = part->modes[mModeName];
     mode.framesPerSecond = mOldFPS;
-    MainWindow::Instance()->partModesChanged(mPart);
+    GetProjectListener()->partModesChanged(mPart);
 }
 
-void CChangeModeFPS::redo(){
+void CChangeModeFPS::doRedo(){
     Part* part = PM()->getPart(mPart);
     Part::Mode& mode = part->modes[mModeName];
     mOldFPS = mode.framesPerSecond;
     mode.framesPerSecond = mFPS;
-    MainWindow::Instance()->partModesChanged(mPart);
+    GetProjectListener()->partModesChanged(mPart);
 }
 
 
@@ -951,7 +1123,7 @@ CEditCompositeChild::CEditCompositeChild(AssetRef comp, const QString& childName
     ok = PM()->hasComposite(mComp) && PM()->getComposite(mComp)->childrenMap.contains(mChildName);
 }
 
-void CEditCompositeChild::undo(){
+void CEditCompositeChild::doUndo(){
     Composite* comp = PM()->getComposite(mComp);
     Composite::Child& child = comp->childrenMap[mChildName];
 
@@ -990,10 +1162,10 @@ void CEditCompositeChild::undo(){
     comp->root = mOldRoot;
 
     // Update comp..
-    MainWindow::Instance()->compositeUpdatedMinorChanges(mComp);
+    GetProjectListener()->compositeUpdatedMinorChanges(mComp);
 }
 
-void CEditCompositeChild::redo(){
+void CEditCompositeChild::doRedo(){
     Composite* comp = PM()->getComposite(mComp);
     Composite::Child& child = comp->childrenMap[mChildName];
 
@@ -1043,7 +1215,7 @@ void CEditCompositeChild::redo(){
     }
 
     // Update comp..
-    MainWindow::Instance()->compositeUpdatedMinorChanges(mComp);
+    GetProjectListener()->compositeUpdatedMinorChanges(mComp);
 }
 
 CNewCompositeChild::CNewCompositeChild(AssetRef comp):
@@ -1063,17 +1235,17 @@ CNewCompositeChild::CNewCompositeChild(AssetRef comp):
     }
 }
 
-void CNewCompositeChild::undo(){
+void CNewCompositeChild::doUndo(){
     // Delete the child..
     Composite* comp = PM()->getComposite(mComp);
     comp->children.removeAll(mChildName);
     comp->childrenMap.remove(mChildName);
 
     // Update widgets
-    MainWindow::Instance()->compositeUpdated(mComp);
+    GetProjectListener()->compositeUpdated(mComp);
 }
 
-void CNewCompositeChild::redo(){
+void CNewCompositeChild::doRedo(){
     // Add a new blank child..
     Composite* comp = PM()->getComposite(mComp);
     comp->children.append(mChildName);
@@ -1087,7 +1259,7 @@ void CNewCompositeChild::redo(){
     comp->childrenMap.insert(mChildName, child);
 
     // Update widgets
-    MainWindow::Instance()->compositeUpdated(mComp);
+    GetProjectListener()->compositeUpdated(mComp);
 }
 
 CEditCompositeChildName::CEditCompositeChildName(AssetRef ref, const QString& child, const QString& newChildName)
@@ -1103,20 +1275,20 @@ CEditCompositeChildName::CEditCompositeChildName(AssetRef ref, const QString& ch
     }
 }
 
-void CEditCompositeChildName::undo(){
+void CEditCompositeChildName::doUndo(){
     // Unchange the child name
     Composite* comp = PM()->getComposite(mComp);
     comp->children.replace(comp->children.indexOf(mNewChildName), mOldChildName);
     comp->childrenMap.insert(mOldChildName, comp->childrenMap.take(mNewChildName));
-    MainWindow::Instance()->compositeUpdated(mComp);
+    GetProjectListener()->compositeUpdated(mComp);
 }
 
-void CEditCompositeChildName::redo(){
+void CEditCompositeChildName::doRedo(){
     // Change the child name
     Composite* comp = PM()->getComposite(mComp);
     comp->children.replace(comp->children.indexOf(mOldChildName), mNewChildName);
     comp->childrenMap.insert(mNewChildName, comp->childrenMap.take(mOldChildName));
-    MainWindow::Instance()->compositeUpdated(mComp);
+    GetProjectListener()->compositeUpdated(mComp);
 }
 
 CDeleteCompositeChild::CDeleteCompositeChild(AssetRef ref, const QString& childName)
@@ -1130,11 +1302,11 @@ CDeleteCompositeChild::CDeleteCompositeChild(AssetRef ref, const QString& childN
     }
 }
 
-void CDeleteCompositeChild::undo(){
+void CDeleteCompositeChild::doUndo(){
     // Overwrite the old comp
     PM()->composites.insert(mComp, mCompCopy);
     mCompCopy.clear();
-    MainWindow::Instance()->compositeUpdated(mComp);
+    GetProjectListener()->compositeUpdated(mComp);
 }
 
 int FixIndex(int i, int ci){
@@ -1143,7 +1315,7 @@ int FixIndex(int i, int ci){
     else return i;
 }
 
-void CDeleteCompositeChild::redo(){
+void CDeleteCompositeChild::doRedo(){
     auto comp = PM()->getComposite(mComp);
     mCompCopy = QSharedPointer<Composite>::create(*comp); // make a copy so we can undo it
 
@@ -1190,7 +1362,7 @@ void CDeleteCompositeChild::redo(){
         comp->root--;
     }
 
-    MainWindow::Instance()->compositeUpdated(mComp);
+    GetProjectListener()->compositeUpdated(mComp);
 }
 
 
@@ -1199,18 +1371,22 @@ CChangePartProperties::CChangePartProperties(AssetRef part, QString properties)
     ok = PM()->hasPart(mPart);
 }
 
-void CChangePartProperties::undo(){
+void CChangePartProperties::doUndo(){
+    PM()->searchIndex()->invalidate(mPart);
     Part* part = PM()->getPart(mPart);
     part->properties = mOldProperties;
-    MainWindow::Instance()->partPropertiesUpdated(mPart);
+    part->propertiesCache = PropertiesCache();
+    GetProjectListener()->partPropertiesUpdated(mPart);
 }
 
-void CChangePartProperties::redo(){
+void CChangePartProperties::doRedo(){
+    PM()->searchIndex()->invalidate(mPart);
     Part* part = PM()->getPart(mPart);
     mOldProperties = part->properties;
     part->properties = mProperties;
+    part->propertiesCache = PropertiesCache();
 
-    MainWindow::Instance()->partPropertiesUpdated(mPart);
+    GetProjectListener()->partPropertiesUpdated(mPart);
 }
 
 CChangeCompProperties::CChangeCompProperties(AssetRef comp, QString properties)
@@ -1218,18 +1394,22 @@ CChangeCompProperties::CChangeCompProperties(AssetRef comp, QString properties)
     ok = PM()->hasComposite(mComp);
 }
 
-void CChangeCompProperties::undo(){
+void CChangeCompProperties::doUndo(){
+    PM()->searchIndex()->invalidate(mComp);
     Composite* comp = PM()->getComposite(mComp);
     comp->properties = mOldProperties;
+    comp->propertiesCache = PropertiesCache();
 
-    MainWindow::Instance()->compPropertiesUpdated(mComp);
+    GetProjectListener()->compPropertiesUpdated(mComp);
 }
 
-void CChangeCompProperties::redo(){
+void CChangeCompProperties::doRedo(){
+    PM()->searchIndex()->invalidate(mComp);
     Composite* comp = PM()->getComposite(mComp);
     mOldProperties = comp->properties;
     comp->properties = mProperties;
+    comp->propertiesCache = PropertiesCache();
 
-    MainWindow::Instance()->compPropertiesUpdated(mComp);
+    GetProjectListener()->compPropertiesUpdated(mComp);
 }
 
@@ -2,9 +2,12 @@
 #define COMMANDS_H
 
 #include <QUndoCommand>
+#include <QUndoStack>
 #include <QMap>
 #include <QDebug>
 #include "projectmodel.h"
+#include "imageops.h"
+#include "bake.h"
 
 // TODO: Can compress the undo stack by implementing mergesWith() for some commands
 // Example command execution: TryCommand(new CRenamePart(ref, "New part name"));
@@ -12,16 +15,62 @@
 class Command: public QUndoCommand {
 public:
     bool ok; // is true if command can be processed    
+    virtual qint64 memoryBytes() const {return 0;} // roughly, the image data kept for undo/redo
+
+    // Traced (see trace.h), commands implement doUndo and doRedo
+    void undo() override final;
+    void redo() override final;
+
+protected:
+    virtual void doUndo() = 0;
+    virtual void doRedo() = 0;
 };
 
 bool TryCommand(Command* command); // execute a command if its ok. takes ownership.
 
+// Commands notify the listener that something has changed in the project.
+// The editor (MainWindow) is the listener, headless tools don't need one.
+class ProjectListener {
+public:
+    virtual ~ProjectListener(){}
+
+    // Commands are pushed onto this stack, or just executed if there is none
+    virtual QUndoStack* undoStack(){return nullptr;}
+
+    virtual void partListChanged(){}
+    virtual void newAssetCreated(AssetRef){}
+
+    // Fine-grained changes to the asset hierarchy, so the asset list doesn't have to be rebuilt
+    virtual void assetInserted(AssetRef){}
+    virtual void assetRemoved(AssetRef){}
+    virtual void assetMoved(AssetRef){}
+
+    virtual void partRenamed(AssetRef, const QString&){}
+    // pixels is the part of the frame that was drawn on (empty if only the anchor or pivots changed)
+    virtual void partFrameUpdated(AssetRef, const QString&, int, const QRect& /*pixels*/){}
+    virtual void partFramesUpdated(AssetRef, const QString&){}
+    virtual void partNumPivotsUpdated(AssetRef, const QString&){}
+    virtual void partPropertiesUpdated(AssetRef){}
+    virtual void partModesChanged(AssetRef){}
+    virtual void partModeRenamed(AssetRef, const QString&, const QString&){}
+
+    virtual void compositeRenamed(AssetRef, const QString&){}
+    virtual void compositeUpdated(AssetRef){}
+    virtual void compositeUpdatedMinorChanges(AssetRef){}
+    virtual void compPropertiesUpdated(AssetRef){}
+
+    virtual void folderRenamed(AssetRef, const QString&){}
+};
+
+void SetProjectListener(ProjectListener* listener);
+ProjectListener* GetProjectListener(); // never null
+
 class CNewPart: public Command
 {
 public:
     CNewPart();
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mRef;
@@ -31,8 +80,8 @@ class CCopyPart: public Command
 {
 public:
     CCopyPart(AssetRef ref);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mOriginal;
@@ -44,8 +93,9 @@ private:
 class CDeletePart: public Command {
 public:    
     CDeletePart(AssetRef ref);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
+    qint64 memoryBytes() const;
 
 private:
     AssetRef mRef;
@@ -55,8 +105,8 @@ private:
 class CRenamePart: public Command {
 public:
     CRenamePart(AssetRef ref, QString newName);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mRef;
@@ -70,8 +120,8 @@ class CNewComposite: public Command
 {
 public:
     CNewComposite();
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mRef;
@@ -82,8 +132,8 @@ class CCopyComposite: public Command
 {
 public:
     CCopyComposite(AssetRef ref);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mOriginal;
@@ -91,11 +141,23 @@ private:
     QString mNewCompositeName;
 };
 
+// Bakes a composite into a new part
+class CBakeComposite: public Command
+{
+public:
+    CBakeComposite(AssetRef ref, const BakeSettings& settings, QStringList* log);
+    void doUndo();
+    void doRedo();
+
+private:
+    QSharedPointer<Part> mPart;
+};
+
 class CDeleteComposite: public Command {
 public:
     CDeleteComposite(AssetRef ref);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mRef;
@@ -105,8 +167,8 @@ private:
 class CRenameComposite: public Command {
 public:
     CRenameComposite(AssetRef ref, QString newName);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mRef;
@@ -119,8 +181,8 @@ class CNewFolder: public Command
 {
 public:
     CNewFolder();
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mRef;
@@ -129,8 +191,8 @@ private:
 class CDeleteFolder: public Command {
 public:
     CDeleteFolder(AssetRef ref);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mRef;
@@ -140,8 +202,8 @@ private:
 class CRenameFolder: public Command {
 public:
     CRenameFolder(AssetRef ref, QString newName);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mRef;
@@ -152,8 +214,8 @@ private:
 class CMoveAsset: public Command {
 public:
     CMoveAsset(AssetRef ref, AssetRef newParent);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 private:
     AssetRef mRef, mOldParent, mNewParent;
 };
@@ -167,8 +229,8 @@ class CNewMode: public Command
 {
 public:
     CNewMode(AssetRef part, const QString& copyModeName);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mPart;
@@ -180,8 +242,9 @@ class CDeleteMode: public Command
 {
 public:
     CDeleteMode(AssetRef part, const QString& modeName);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
+    qint64 memoryBytes() const;
 
 private:
     AssetRef mPart;
@@ -193,8 +256,9 @@ class CResetMode: public Command
 {
 public:
     CResetMode(AssetRef part, const QString& modeName);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
+    qint64 memoryBytes() const;
 
 private:
     AssetRef mPart;
@@ -206,8 +270,8 @@ class CCopyMode: public Command
 {
 public:
     CCopyMode(AssetRef part, const QString& modeName);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mPart;
@@ -219,8 +283,8 @@ class CRenameMode: public Command
 {
 public:
     CRenameMode(AssetRef part, const QString& oldModeName, const QString& newModeName);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mPart;
@@ -236,37 +300,41 @@ private:
 class CDrawOnPart: public Command {
 public:
     CDrawOnPart(AssetRef part, QString mode, int frame, QImage data, QPoint offset);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
+    qint64 memoryBytes() const;
 private:
     AssetRef mPart;
     QString mMode;
     int mFrame;
-    QImage mData;
+    QImage mData; // NB: Cropped to the stroke
     QPoint mOffset;
-    QImage mOldFrame;
+    QList<QRect> mTiles; // The tiles the stroke touches
+    SavedTiles mOldTiles;
 };
 
 class CEraseOnPart: public Command {
 public:
     CEraseOnPart(AssetRef part, QString mode, int frame, QImage data, QPoint offset);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
+    qint64 memoryBytes() const;
 private:
     AssetRef mPart;
     QString mMode;
     int mFrame;
-    QImage mData;
+    QImage mData; // NB: Cropped to the stroke
     QPoint mOffset;
-    QImage mOldFrame;
+    QList<QRect> mTiles; // The tiles the stroke touches
+    SavedTiles mOldTiles;
 };
 
 
 class CNewFrame: public Command {
 public:
     CNewFrame(AssetRef part, QString modeName, int index);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mPart;
@@ -277,8 +345,8 @@ private:
 class CCopyFrame: public Command {
 public:
     CCopyFrame(AssetRef part, QString modeName, int index);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mPart;
@@ -289,8 +357,9 @@ private:
 class CDeleteFrame: public Command {
 public:
     CDeleteFrame(AssetRef part, QString modeName, int index);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
+    qint64 memoryBytes() const;
 
 private:
     AssetRef mPart;
@@ -308,8 +377,8 @@ private:
 class CUpdateAnchorAndPivots: public Command {
 public:
     CUpdateAnchorAndPivots(AssetRef part, QString modeName, int index, QPoint anchor, QPoint p1, QPoint p2, QPoint p3, QPoint p4);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mPart;
@@ -322,8 +391,8 @@ private:
 class CChangeNumPivots: public Command {
 public:
     CChangeNumPivots(AssetRef part, QString modeName, int numPivots);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mPart;
@@ -336,8 +405,9 @@ private:
 class CChangeModeSize: public Command {
 public:
     CChangeModeSize(AssetRef part, QString modeName, int width, int height, int offsetX, int offsetY);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
+    qint64 memoryBytes() const;
 
 private:
     AssetRef mPart;
@@ -350,8 +420,8 @@ private:
 class CChangeModeFPS: public Command {
 public:
     CChangeModeFPS(AssetRef part, QString modeName, int fps);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mPart;
@@ -366,8 +436,8 @@ private:
 class CEditCompositeChild: public Command {
 public:
     CEditCompositeChild(AssetRef comp, const QString& childName, AssetRef newPart, int newZ, int newParent, int newParentPivot);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mComp;
@@ -382,8 +452,8 @@ private:
 class CNewCompositeChild: public Command {
 public:
     CNewCompositeChild(AssetRef comp);
-    void redo();
-    void undo();
+    void doRedo();
+    void doUndo();
 
 private:
     AssetRef mComp;
@@ -393,8 +463,8 @@ private:
 class CEditCompositeChildName: public Command {
 public:
     CEditCompositeChildName(AssetRef comp, const QString& child, const QString& newChildName);
-    void redo();
-    void undo();
+    void doRedo();
+    void doUndo();
 
 private:
     AssetRef mComp;
@@ -404,8 +474,8 @@ private:
 class CDeleteCompositeChild: public Command {
 public:
     CDeleteCompositeChild(AssetRef comp, const QString& childName);
-    void redo();
-    void undo();
+    void doRedo();
+    void doUndo();
 
 private:
     AssetRef mComp;
@@ -417,8 +487,8 @@ private:
 class CChangePartProperties: public Command {
 public:
     CChangePartProperties(AssetRef part, QString properties);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mPart;
@@ -429,8 +499,8 @@ private:
 class CChangeCompProperties: public Command {
 public:
     CChangeCompProperties(AssetRef comp, QString properties);
-    void undo();
-    void redo();
+    void doUndo();
+    void doRedo();
 
 private:
     AssetRef mComp;
@@ -296,7 +296,7 @@ void CompositeToolsWidget::targetCompPropertiesChanged(){
         if (comp){
             int cursorPos = mTextEditProperties->textCursor().position();
             mTextEditProperties->blockSignals(true);
-            mTextEditProperties->setPlainText(comp->properties);
+            mTextEditProperties->setPlainText(FormattedProperties(comp));
             mTextEditProperties->blockSignals(false);
 
             QTextCursor cursor = mTextEditProperties->textCursor();
@@ -354,6 +354,10 @@ void CompositeToolsWidget::cellChanged(int row, int /*column*/){
             const Composite::Child& child = comp->childrenMap.value(childName);
 
             Part* p = PM()->findPartByName(partName);
+            if (p==nullptr){
+                // NB: "library/part" (see Library)
+                p = PM()->getPart(PM()->findLibraryPart(partName));
+            }
             if (p==nullptr){
                 mTableWidgetParts->blockSignals(true);
                 mTableWidgetParts->item(row, 1)->setText("");
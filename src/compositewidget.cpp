@@ -1,7 +1,11 @@
 #include "compositewidget.h"
+#include "animationclock.h"
 #include "commands.h"
+#include "dropshadow.h"
 #include "mainwindow.h"
+#include "trace.h"
 
+#include <algorithm>
 #include <cmath>
 #include <QUndoStack>
 #include <QCloseEvent>
@@ -11,8 +15,6 @@
 #include <QDebug>
 #include <QRgb>
 #include <QMdiSubWindow>
-#include <QGraphicsDropShadowEffect>
-#include <QTimer>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
@@ -24,14 +26,12 @@ CompositeWidget::CompositeWidget(AssetRef ref, QWidget *parent) :
     mCompView(nullptr),
     mZoom(4),
     mPosition(0,0),
-    mAnimationTimer(nullptr),
     mIsPlaying(false),
     mMovingCanvas(false),
     mSecondsPassedSinceLastFrame(0),
     mPlaybackSpeedMultiplierIndex(-1),
     mPlaybackSpeedMultiplier(1),
-    mBoundsRect(),
-    mProperties()
+    mBoundsRect()
 {
     // Customise window
     setMinimumSize(64,64);
@@ -45,11 +45,13 @@ CompositeWidget::CompositeWidget(AssetRef ref, QWidget *parent) :
 }
 
 void CompositeWidget::updateCompFrames(){
+    TRACE_SCOPE("CompositeWidget::updateCompFrames");
     //////////////////////
     // Load all frames of all modes of all parts
     //////////////////////
 
     Composite* comp = PM()->getComposite(mCompRef);
+    const DropShadow shadow = compositeDropShadow();
     Q_ASSERT(comp);
     mCompName = comp->name;
 
@@ -85,7 +87,6 @@ void CompositeWidget::updateCompFrames(){
     if (comp != nullptr){
         mChildren = comp->children;
         mRoot = comp->root;
-        mProperties = comp->properties;
 
         for(const QString& childName: mChildren){
             ChildDriver cd;
@@ -106,7 +107,6 @@ void CompositeWidget::updateCompFrames(){
             cd.loop = true;
             cd.accumulator = 0;
             cd.frame = 0;
-            cd.updated = false;
             cd.valid = false;
 
             if (PM()->hasPart(cd.part)){
@@ -125,7 +125,7 @@ void CompositeWidget::updateCompFrames(){
                     mode.numFrames = m.numFrames;
                     mode.numPivots = m.numPivots;
                     mode.fps = m.framesPerSecond;
-                    mode.spf = 1./mode.fps;
+                    mode.spf = mode.fps > 0 ? 1./mode.fps : 0; // NB: A loaded file can have 0 fps
                     mode.width = m.width;
                     mode.height = m.height;
 
@@ -152,10 +152,9 @@ void CompositeWidget::updateCompFrames(){
                         // qDebug() << "img: " << img;
                         if (img){
                             QGraphicsPixmapItem* pi = mCompView->scene()->addPixmap(QPixmap::fromImage(*img));
-                            QGraphicsDropShadowEffect* effect = new QGraphicsDropShadowEffect();
-                            pi->setGraphicsEffect(effect);
                             pi->setZValue(cd.z);
                             mode.pixmapItems.push_back(pi);
+                            mode.shadowItems.push_back(AddDropShadowItem(pi, *img, shadow));
 
                             if (fullBounds.isNull()) fullBounds = pi->boundingRect();
                             else fullBounds = fullBounds.united(pi->boundingRect());
@@ -166,6 +165,7 @@ void CompositeWidget::updateCompFrames(){
                             QGraphicsPixmapItem* pi = mCompView->scene()->addPixmap(QPixmap::fromImage(img));
                             pi->setZValue(cd.z);
                             mode.pixmapItems.push_back(pi);
+                            mode.shadowItems.push_back(nullptr);
 
                             if (fullBounds.isNull()) fullBounds = pi->boundingRect();
                             else fullBounds = fullBounds.united(pi->boundingRect());
@@ -191,11 +191,14 @@ void CompositeWidget::updateCompFrames(){
     // setPosition(fullBounds.topLeft()/mZoom);
     setZoom(mZoom);
     updateDropShadow();
+    compilePose();
     updateFrame();
     updatePropertiesOverlays();
+    if (mIsPlaying) AnimationClock::Instance()->wake(this); // fps may have changed
 }
 
 void CompositeWidget::updateCompFramesMinorChanges(){
+    TRACE_SCOPE("CompositeWidget::updateCompFramesMinorChanges");
     //////////////////////
     // Update all frames of all modes of all parts, assume no new children have been added etc
     //////////////////////
@@ -208,10 +211,10 @@ void CompositeWidget::updateCompFramesMinorChanges(){
 
     // Update all children
     Composite* comp = PM()->getComposite(mCompRef);
+    const DropShadow shadow = compositeDropShadow();
     QRectF fullBounds;
     if (comp){
         mRoot = comp->root;
-        mProperties = comp->properties;
 
         for(const QString& childName: mChildren){
             ChildDriver& cd = mChildrenMap[childName];
@@ -267,7 +270,7 @@ void CompositeWidget::updateCompFramesMinorChanges(){
                     mode.numFrames = m.numFrames;
                     mode.numPivots = m.numPivots;
                     mode.fps = m.framesPerSecond;
-                    mode.spf = 1./mode.fps;
+                    mode.spf = mode.fps > 0 ? 1./mode.fps : 0; // NB: A loaded file can have 0 fps
                     mode.width = m.width;
                     mode.height = m.height;
 
@@ -296,11 +299,12 @@ void CompositeWidget::updateCompFramesMinorChanges(){
                         if (img){
                             if (hasMode) mCompView->scene()->removeItem(mode.pixmapItems.at(i));
                             QGraphicsPixmapItem* pi = mCompView->scene()->addPixmap(QPixmap::fromImage(*img));
-                            QGraphicsDropShadowEffect* effect = new QGraphicsDropShadowEffect();
-                            pi->setGraphicsEffect(effect);
                             pi->setZValue(cd.z);
+                            QGraphicsPixmapItem* si = AddDropShadowItem(pi, *img, shadow);
                             if (hasMode) mode.pixmapItems.replace(i, pi);
                             else mode.pixmapItems.push_back(pi);
+                            if (hasMode) mode.shadowItems.replace(i, si);
+                            else mode.shadowItems.push_back(si);
 
 
                             if (fullBounds.isNull()) fullBounds = pi->boundingRect();
@@ -315,6 +319,8 @@ void CompositeWidget::updateCompFramesMinorChanges(){
                             pi->setZValue(cd.z);
                             if (hasMode) mode.pixmapItems.replace(i, pi);
                             else mode.pixmapItems.push_back(pi);
+                            if (hasMode) mode.shadowItems.replace(i, nullptr);
+                            else mode.shadowItems.push_back(nullptr);
 
                             if (fullBounds.isNull()) fullBounds = pi->boundingRect();
                             else fullBounds = fullBounds.united(pi->boundingRect());
@@ -336,111 +342,122 @@ void CompositeWidget::updateCompFramesMinorChanges(){
     // setPosition(fullBounds.topLeft()/mZoom);
     setZoom(mZoom);
     updateDropShadow();
+    compilePose();
     updateFrame();
     updatePropertiesOverlays();
+    if (mIsPlaying) AnimationClock::Instance()->wake(this); // fps may have changed
 }
 
 
-void CompositeWidget::updateFrame(){
-    // First, recursivley compute the absolute positions of things...
-    QMutableMapIterator<QString,ChildDriver> it(mChildrenMap);
-    while (it.hasNext()){        
-        it.next();
-        ChildDriver& cd = it.value();
-        cd.updated = false;
-        cd.parentPivotOffset = QPointF(0,0);
-    }
+void CompositeWidget::compilePose(){
+    TRACE_SCOPE("CompositeWidget::compilePose");
+    const int numChildren = mChildren.size();
+    mPose.order.clear();
+    mPose.parent.clear();
+    mPose.parentPivot.clear();
+    mPose.drivers.fill(nullptr, numChildren);
+    mPose.modes.fill(nullptr, numChildren);
+    mPose.offsets.fill(QPointF(0,0), numChildren);
+    mPose.shownItems.fill(nullptr, numChildren);
+    mPose.shownBounds.fill(nullptr, numChildren);
 
-    it.toFront();
-    while (it.hasNext()){
-        it.next();
+    for(int i=0;i<numChildren;i++){
+        auto it = mChildrenMap.find(mChildren.at(i));
+        if (it==mChildrenMap.end()) continue;
         ChildDriver& cd = it.value();
+        mPose.drivers[i] = &cd;
+
+        auto mit = cd.modes.find(cd.mode);
+        if (cd.valid && mit!=cd.modes.end()) mPose.modes[i] = &mit.value();
 
-        if (cd.parent==-1 && cd.valid){
-            if (cd.modes.contains(cd.mode)){
-                QPoint anchor = cd.modes[cd.mode].anchors[cd.frame];
-                updateChildRecursively(cd.index, -anchor);
+        // Everything starts hidden, updateFrame only shows and hides what changes
+        for(const ChildDriver::Mode& mode: cd.modes){
+            for(QGraphicsPixmapItem* pi: mode.pixmapItems) pi->hide();
+            if (mode.boundsItem) mode.boundsItem->hide();
+        }
+    }
+
+    // Breadth first from the roots, so parents are always posed before their children
+    QVector<bool> visited(numChildren, false);
+    for(int i=0;i<numChildren;i++){
+        const ChildDriver* cd = mPose.drivers.at(i);
+        if (cd && cd->parent==-1 && cd->valid){
+            visited[i] = true;
+            mPose.order.push_back(i);
+            mPose.parent.push_back(-1);
+            mPose.parentPivot.push_back(-1);
+        }
+    }
+    for(int k=0;k<mPose.order.size();k++){
+        const int index = mPose.order.at(k);
+        if (mPose.modes.at(index)==nullptr) continue;
+        for(int childIndex: mPose.drivers.at(index)->children){
+            if (childIndex<0 || childIndex>=numChildren || visited.at(childIndex)) continue; // Whoops, something wrong in the tree
+            const ChildDriver* child = mPose.drivers.at(childIndex);
+            if (child && child->valid && mPose.modes.at(childIndex)){
+                visited[childIndex] = true;
+                mPose.order.push_back(childIndex);
+                mPose.parent.push_back(index);
+                mPose.parentPivot.push_back(child->parentPivot);
             }
-            else {
-                updateChildRecursively(cd.index, QPointF(0,0));
+        }
+    }
+}
+
+void CompositeWidget::updateFrame(){
+    // First compute the absolute positions of things...
+    PoseProgram& pose = mPose;
+    std::fill(pose.offsets.begin(), pose.offsets.end(), QPointF(0,0));
+    for(int k=0;k<pose.order.size();k++){
+        const int index = pose.order.at(k);
+        const int parent = pose.parent.at(k);
+        const ChildDriver::Mode* mode = pose.modes.at(index);
+        const int frame = pose.drivers.at(index)->frame;
+
+        if (parent==-1){
+            pose.offsets[index] = mode ? -QPointF(mode->anchors.at(frame)) : QPointF(0,0);
+        }
+        else {
+            const ChildDriver::Mode* parentMode = pose.modes.at(parent);
+            const int pivot = pose.parentPivot.at(k);
+            QPointF pp = pose.offsets.at(parent);
+            if (pivot>=0 && pivot<parentMode->numPivots){
+                pp += (parentMode->pivots[pivot][pose.drivers.at(parent)->frame] - mode->anchors.at(frame));
             }
+            pose.offsets[index] = pp;
         }
     }
 
     //  update the positions and visibility of all the pixmaps and bounds..
 
     mBoundsRect = QRectF();
-
-    it = QMutableMapIterator<QString,ChildDriver>(mChildrenMap);
-    while (it.hasNext()){
-        it.next();
-        ChildDriver& cd = it.value();
-        if (!cd.valid) continue;
-
-        QMutableMapIterator<QString,ChildDriver::Mode> mit(cd.modes);
-        while (mit.hasNext()){
-            mit.next();
-            ChildDriver::Mode& mode = mit.value();
-            bool correctMode = (mit.key()==cd.mode);
-            if (mode.boundsItem){
-                if (correctMode) mode.boundsItem->show();
-                else mode.boundsItem->hide();
-            }
-
-            for(int f=0;f<mode.numFrames;f++){                
-                mode.pixmapItems[f]->hide();
-                if (mode.pixmapItems[f]->graphicsEffect())
-                    mode.pixmapItems[f]->graphicsEffect()->setEnabled(false);
-                if (mode.boundsItem) mode.boundsItem->setPos(cd.parentPivotOffset);                
-                if (cd.visible && f==cd.frame && correctMode){
-                    mode.pixmapItems[f]->setPos(cd.parentPivotOffset);
-                    mode.pixmapItems[f]->show();
-
-                    if (mode.pixmapItems[f]->graphicsEffect())
-                        mode.pixmapItems[f]->graphicsEffect()->setEnabled(true);
-
-                    /*
-                    if (mBoundsRect.isNull())
-                        mBoundsRect = mode.pixmapItems[f]->boundingRect().translated(cd.parentPivotOffset.x(),cd.parentPivotOffset.y());
-                    else
-                        mBoundsRect.united(mode.pixmapItems[f]->boundingRect()).translated(cd.parentPivotOffset.x(),cd.parentPivotOffset.y());
-                    */
-
-                    if (mBoundsRect.isNull())
-                        mBoundsRect = mode.pixmapItems[f]->boundingRect();
-                    else
-                        mBoundsRect.united(mode.pixmapItems[f]->boundingRect());
-                }
-            }
+    for(int index=0;index<pose.drivers.size();index++){
+        const ChildDriver* cd = pose.drivers.at(index);
+        const ChildDriver::Mode* mode = pose.modes.at(index);
+        if (cd==nullptr || !cd->valid) continue;
+
+        QGraphicsRectItem* bounds = mode ? mode->boundsItem : nullptr;
+        if (bounds!=pose.shownBounds.at(index)){
+            if (pose.shownBounds.at(index)) pose.shownBounds.at(index)->hide();
+            if (bounds) bounds->show();
+            pose.shownBounds[index] = bounds;
         }
-    }
-}
+        if (bounds) bounds->setPos(pose.offsets.at(index));
 
-void CompositeWidget::updateChildRecursively(int index, const QPointF& parentPivotPos){
-    if (index==-1) return;
-    const QString& name = mChildren.at(index);
-    if (mChildrenMap.contains(name)){
-        ChildDriver& cd = mChildrenMap[name];
-
-        if (!cd.valid) return;
-        if (cd.updated) return; // Whoops, already updated, mustve been something wrong in the tree
-
-        cd.parentPivotOffset = parentPivotPos;
-        cd.updated = true;
-        if (cd.modes.contains(cd.mode)){
-            auto& mode = cd.modes[cd.mode];
-            for(int childIndex: cd.children){
-                const QString& childName = mChildren.at(childIndex);
-                ChildDriver& child = mChildrenMap[childName];
-                if (child.modes.contains(child.mode) && child.valid){
-                    ChildDriver::Mode& chmode = child.modes[child.mode];
-                    QPointF pp = parentPivotPos;
-                    if (child.parentPivot>=0 && child.parentPivot<mode.numPivots){
-                        pp += (mode.pivots[child.parentPivot][cd.frame] - chmode.anchors[child.frame]);
-                    }
-                    updateChildRecursively(childIndex, pp);
-                }
-            }
+        QGraphicsPixmapItem* item = nullptr;
+        if (mode && cd->visible && cd->frame>=0 && cd->frame<mode->numFrames){
+            item = mode->pixmapItems.at(cd->frame);
+        }
+        if (item!=pose.shownItems.at(index)){
+            if (pose.shownItems.at(index)) pose.shownItems.at(index)->hide();
+            if (item) item->show();
+            pose.shownItems[index] = item;
+        }
+        if (item){
+            item->setPos(pose.offsets.at(index));
+            // NB: In scene coordinates, so it includes the offset just set
+            const QRectF rect = item->sceneBoundingRect();
+            mBoundsRect = mBoundsRect.isNull() ? rect : mBoundsRect.united(rect);
         }
     }
 }
@@ -454,11 +471,9 @@ void CompositeWidget::updatePropertiesOverlays(){
     }
     mRectItems.clear();
 
-    QJsonParseError error;
-    QJsonDocument propDoc = QJsonDocument::fromJson(QByteArray(mProperties.toStdString().c_str()), &error);
-    // QJsonDocument prefsDoc = QJsonDocument::fromJson(QByteArray(mProperties.buffer, mProperties.length), &error);
-
-    if (error.error!=QJsonParseError::NoError || propDoc.isNull() || propDoc.isEmpty() || !propDoc.isObject()){
+    Composite* comp = PM()->getComposite(mCompRef);
+    const PropertiesCache* props = comp ? &ParseProperties(comp) : nullptr;
+    if (props == nullptr || !props->error.isEmpty() || props->object.isEmpty()){
         // couldn't parse.. (or not object)
     }
     else {
@@ -466,8 +481,8 @@ void CompositeWidget::updatePropertiesOverlays(){
         static const QColor COLOURS[NUM_COLOURS] = {QColor(255,0,255), QColor(150,100,255), QColor(255,100,150), QColor(200,150,200)};
 
         int index = 0;
-        QJsonObject propObj = propDoc.object();
-        for(QJsonObject::iterator it = propObj.begin(); it!=propObj.end(); it++){
+        const QJsonObject& propObj = props->object;
+        for(QJsonObject::const_iterator it = propObj.begin(); it!=propObj.end(); it++){
             QString key = it.key();
 
             if (key.endsWith("_rect") && it.value().isArray()){
@@ -492,6 +507,7 @@ void CompositeWidget::updatePropertiesOverlays(){
             }
         }
     }
+    mCompView->stats().sceneChanged(mCompView->scene());
 }
 
 void CompositeWidget::partNameChanged(AssetRef, const QString&){
@@ -554,7 +570,6 @@ void CompositeWidget::setZoom(int z){
     mZoom = z;
     mCompView->setTransform(QTransform::fromScale(mZoom,mZoom));
     mCompView->setSceneRect(mCompView->scene()->sceneRect().translated(mPosition.x()/mZoom, mPosition.y()/mZoom));
-    updateDropShadow();
     mCompView->update();
 }
 
@@ -569,8 +584,6 @@ void CompositeWidget::compNameChanged(AssetRef ref){
 void CompositeWidget::compPropertiesChanged(AssetRef ref){
     if (ref==mCompRef){
         // update ..
-        Composite* comp = PM()->getComposite(mCompRef);
-        mProperties = comp->properties;
         updatePropertiesOverlays();
         mCompView->update();
     }
@@ -584,6 +597,7 @@ void CompositeWidget::setChildMode(const QString& child, const QString& mode){
     if (it!=mChildrenMap.end()){
         it->mode = mode;
     }
+    compilePose();
 
     if (wasPlaying) play(true);
     else updateFrame();
@@ -617,6 +631,12 @@ void CompositeWidget::setChildVisible(const QString& child, bool visible){
 void CompositeWidget::setPlaybackSpeedMultiplier(int index, float value){
     mPlaybackSpeedMultiplierIndex = index;
     mPlaybackSpeedMultiplier = value;
+    if (mIsPlaying) AnimationClock::Instance()->wake(this);
+}
+
+QString CompositeWidget::properties() const {
+    Composite* comp = PM()->getComposite(mCompRef);
+    return comp ? FormattedProperties(comp) : QString();
 }
 
 QString CompositeWidget::modeForCurrentSet(const QString& child) const {
@@ -750,13 +770,10 @@ void CompositeWidget::compViewKeyPressEvent(QKeyEvent *event){
     }
 }
 
-static float S_PER_UPDATE = 1.f/60;
 void CompositeWidget::play(bool play){
     if (!play){
         mIsPlaying = false;
-        if (mAnimationTimer){
-            mAnimationTimer->stop();
-        }
+        AnimationClock::Instance()->stop(this);
 
         // Reset everything to start state..
         QMutableMapIterator<QString,ChildDriver> it(mChildrenMap);
@@ -769,11 +786,6 @@ void CompositeWidget::play(bool play){
         updateFrame();
     }
     else {
-        if (mAnimationTimer==nullptr){
-            mAnimationTimer=new QTimer(this);
-            connect(mAnimationTimer, SIGNAL(timeout()), this, SLOT(updateAnimation()));
-        }
-
         QMutableMapIterator<QString,ChildDriver> it(mChildrenMap);
         while (it.hasNext()){
             it.next();
@@ -781,73 +793,82 @@ void CompositeWidget::play(bool play){
             cd.accumulator = 0;
             cd.frame = 0;
         }
-        mAnimationTimer->start(S_PER_UPDATE*1000);
+        AnimationClock::Instance()->start(this, [this](double seconds){ return updateAnimation(seconds); });
         mIsPlaying = true;
     }
 }
 
-void CompositeWidget::updateAnimation(){
-    bool hasChildFrameChanged = false;
-    float ds = mPlaybackSpeedMultiplier*S_PER_UPDATE;
-    QMutableMapIterator<QString,ChildDriver> it(mChildrenMap);
-    while (it.hasNext()){
-        it.next();
-        ChildDriver& cd = it.value();
-        cd.accumulator += ds;
-        if (!cd.valid) continue;
+double CompositeWidget::updateAnimation(double seconds){
+    TRACE_SCOPE("CompositeWidget::updateAnimation");
+    if (mPlaybackSpeedMultiplier <= 0) return -1;
 
-        const ChildDriver::Mode& mode = cd.modes.value(cd.mode);
-        bool updated = false;
-        while (cd.accumulator > mode.spf){
-            updated = true;
+    bool hasChildFrameChanged = false;
+    double nextFrame = -1;
+    float ds = mPlaybackSpeedMultiplier*seconds;
+    for(int index=0;index<mPose.drivers.size();index++){
+        ChildDriver* cd = mPose.drivers.at(index);
+        const ChildDriver::Mode* mode = mPose.modes.at(index);
+        if (cd==nullptr) continue;
+        cd->accumulator += ds;
+        if (mode==nullptr || mode->numFrames<=0 || mode->fps<=0) continue;
+
+        while (cd->accumulator > mode->spf){
             hasChildFrameChanged = true;
-            cd.accumulator -= mode.spf;
-            if (cd.loop)
-                cd.frame = (cd.frame+1)%mode.numFrames;
+            cd->accumulator -= mode->spf;
+            if (cd->loop)
+                cd->frame = (cd->frame+1)%mode->numFrames;
             else
-                cd.frame = std::min<int>(cd.frame+1, mode.numFrames-1);
+                cd->frame = std::min<int>(cd->frame+1, mode->numFrames-1);
         }
 
-        if (updated){
-            // just do a brute force update below for now ..
+        // A non-looping child that has reached its last frame doesn't need waking
+        if (cd->loop || cd->frame < mode->numFrames-1){
+            const double childNextFrame = (mode->spf - cd->accumulator)/mPlaybackSpeedMultiplier;
+            if (nextFrame < 0 || childNextFrame < nextFrame) nextFrame = std::max(0.0, childNextFrame);
         }
     }
 
     if (hasChildFrameChanged){
         updateFrame();
     }
+    mCompView->stats().animationTick(seconds, nextFrame);
+    return nextFrame;
 }
 
 void CompositeWidget::updateDropShadow(){
-	const auto& prefs = GlobalPreferences();
-	float opacity = prefs.showDropShadow ? prefs.dropShadowOpacity : 0.0f;
-	float blur = prefs.dropShadowBlurRadius;
-	float dx = prefs.dropShadowOffsetH;
-	float dy = prefs.dropShadowOffsetV;
-	QColor dropShadowColour = prefs.dropShadowColour;
-
     if (mCompView){
+        // NB: Shadows are cached, so this only re-renders if the preferences or frames changed
+        const DropShadow shadow = compositeDropShadow();
         QMutableMapIterator<QString,ChildDriver> it(mChildrenMap);
         while (it.hasNext()){
             it.next();
             ChildDriver& cd = it.value();
-            if (!cd.valid) continue;
+            if (!cd.valid || !PM()->hasPart(cd.part)) continue;
+            Part* part = PM()->getPart(cd.part);
 
             QMutableMapIterator<QString,ChildDriver::Mode> mit(cd.modes);
             while (mit.hasNext()){
                 mit.next();
-               auto& m = mit.value();
-                for(auto* it: m.pixmapItems){
-                    QGraphicsDropShadowEffect* effect = (QGraphicsDropShadowEffect*) it->graphicsEffect();
-                    effect->setOffset(dx*2*mZoom/4.,dy*2*mZoom/2.);
-                    effect->setColor(QColor(dropShadowColour.red(),dropShadowColour.green(),dropShadowColour.blue(),opacity*255));
-                    effect->setBlurRadius(blur*2*mZoom*2.);
+                auto& m = mit.value();
+                const auto& frames = part->modes.value(mit.key()).frames;
+                for(int i=0;i<m.shadowItems.size() && i<frames.size();i++){
+                    if (m.shadowItems.at(i) && frames.at(i)){
+                        UpdateDropShadowItem(m.shadowItems.at(i), *frames.at(i), shadow);
+                    }
                 }
             }
         }
     }
 }
 
+DropShadow CompositeWidget::compositeDropShadow() const {
+    // Composites have always used a tighter horizontal offset and a wider blur than parts
+    DropShadow shadow = DropShadowFromPreferences();
+    shadow.offset.rx() /= 2;
+    shadow.blurRadius *= 4;
+    return shadow;
+}
+
 void CompositeWidget::updateBackgroundBrushes(){
 
 	const auto& prefs = GlobalPreferences();
@@ -914,21 +935,42 @@ CompositeView::CompositeView(CompositeWidget *parent, QGraphicsScene *scene)
 }
 
 void CompositeView::mousePressEvent(QMouseEvent *event){
+    mStats.input();
     cw->compViewMousePressEvent(event);
 }
 
 void CompositeView::mouseMoveEvent(QMouseEvent *event){
+    mStats.input();
     cw->compViewMouseMoveEvent(event);
 }
 
 void CompositeView::mouseReleaseEvent(QMouseEvent *event){
+    mStats.input();
     cw->compViewMouseReleaseEvent(event);
 }
 
 void CompositeView::wheelEvent(QWheelEvent *event){
+    mStats.input();
     cw->compViewWheelEvent(event);
 }
 
+void CompositeView::paintEvent(QPaintEvent *event){
+    mStats.beginPaint(event->rect());
+    QGraphicsView::paintEvent(event);
+    if (mStats.endPaint()) viewport()->update(mStats.overlayRect());
+}
+
+void CompositeView::scrollContentsBy(int dx, int dy){
+    QGraphicsView::scrollContentsBy(dx, dy);
+    // NB: The scroll moves the overlay's pixels too
+    if (ViewStats::isVisible()) viewport()->update(mStats.overlayRect().translated(dx, dy));
+}
+
+void CompositeView::drawForeground(QPainter *painter, const QRectF &rect){
+    QGraphicsView::drawForeground(painter, rect);
+    if (ViewStats::isVisible()) mStats.draw(painter);
+}
+
 void CompositeView::keyPressEvent(QKeyEvent *event){
     cw->compViewKeyPressEvent(event);
 }
@@ -2,6 +2,7 @@
 #define COMPOSITEWIDGET_H
 
 #include "projectmodel.h"
+#include "viewstats.h"
 
 #include <QMdiSubWindow>
 #include <QGraphicsScene>
@@ -14,22 +15,28 @@
 
 // TODO: This needs a big cleanup!!
 class CompositeWidget;
+struct DropShadow;
 class CompositeView: public QGraphicsView {
     Q_OBJECT
     friend class PartWidget;
 public:
     CompositeView(CompositeWidget* parent, QGraphicsScene* scene);
+    ViewStats& stats(){return mStats;}
 protected:
     // Forwards these to parent
     void mousePressEvent(QMouseEvent *mouseEvent);
     void mouseMoveEvent(QMouseEvent *mouseEvent);
     void mouseReleaseEvent(QMouseEvent *mouseEvent);
     void wheelEvent(QWheelEvent *event);
+    void paintEvent(QPaintEvent *event);
     void drawBackground(QPainter *painter, const QRectF &rect);
+    void drawForeground(QPainter *painter, const QRectF &rect);
     void keyPressEvent(QKeyEvent *event);
+    void scrollContentsBy(int dx, int dy);
 
 protected:
     CompositeWidget* cw;
+    ViewStats mStats;
 };
 
 class CompositeWidget : public QMdiSubWindow
@@ -43,7 +50,7 @@ public:
 
     void updatePropertiesOverlays(); // update overlays
     void updateFrame(); // updates the visible parts
-    void updateChildRecursively(int index, const QPointF& parentPivotPos);
+    void compilePose(); // rebuilds mPose, call whenever children or their modes change
 
     // part updates..
     void partNameChanged(AssetRef part, const QString& newPartName);
@@ -76,7 +83,7 @@ public:
     bool isPlaying() const {return mIsPlaying;}
     int playbackSpeedMultiplierIndex() const {return mPlaybackSpeedMultiplierIndex;}
 
-    QString properties() const {return mProperties;}
+    QString properties() const;
 
 signals:
     void zoomChanged();
@@ -94,7 +101,9 @@ public slots:
     void setPosition(QPointF);
 
     void play(bool);
-    void updateAnimation();
+
+public:
+    double updateAnimation(double seconds); // Returns the seconds until the next frame
 
 protected:
     void closeEvent(QCloseEvent *event);
@@ -106,16 +115,16 @@ protected:
     void compViewWheelEvent(QWheelEvent *event);
     void compViewKeyPressEvent(QKeyEvent *event);
 
+    DropShadow compositeDropShadow() const;
+
 protected:
     AssetRef mCompRef;
     QString mCompName;
     Composite* mComp;
     CompositeView* mCompView;
-    QString mProperties;
 
     float mZoom;
     QPointF mPosition;
-    QTimer* mAnimationTimer;
     double mSecondsPassedSinceLastFrame; // TODO: change to seconds since frame?
     bool mIsPlaying;
     QRectF mBoundsRect;
@@ -132,6 +141,7 @@ protected:
             QVector<QPoint> anchors;
             QVector<QPoint> pivots[Part::MaxPivots];
             QVector<QGraphicsPixmapItem*> pixmapItems;
+            QVector<QGraphicsPixmapItem*> shadowItems; // Children of pixmapItems (nullptr if no image)
             int fps;
             float spf;
             QGraphicsRectItem* boundsItem;
@@ -150,15 +160,27 @@ protected:
         int z;
         QList<int> children; // list of children (indices)
 
-        // derived data..
-        bool updated;
-        QPointF parentPivotOffset;
-
         // TODO: Also show anchors and pivots as QGraphicsSimpleTextItem* or just dots
     };
 
     QMap<QString, ChildDriver> mChildrenMap;
     QList<QString> mChildren;
+
+    // The child hierarchy flattened into arrays, so a frame can be posed in one pass
+    // without any name lookups. Arrays marked (index) are indexed by child index,
+    // the others by position in order.
+    struct PoseProgram {
+        QVector<int> order; // valid children, parents before their children
+        QVector<int> parent; // child index of the parent, or -1 for roots
+        QVector<int> parentPivot;
+
+        QVector<ChildDriver*> drivers; // (index) nullptr if missing
+        QVector<ChildDriver::Mode*> modes; // (index) current mode, nullptr if missing
+        QVector<QPointF> offsets; // (index) computed by updateFrame
+        QVector<QGraphicsPixmapItem*> shownItems; // (index) currently visible frame
+        QVector<QGraphicsRectItem*> shownBounds; // (index)
+    };
+    PoseProgram mPose;
     int mRoot;
 
     int mPlaybackSpeedMultiplierIndex;
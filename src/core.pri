@@ -0,0 +1,32 @@
+# The project model, file formats and commands, shared by the editor and mqsprite-cli.
+# Nothing in here may depend on the editor's widgets.
+
+INCLUDEPATH += $$PWD
+
+HEADERS += \
+    $$PWD/assetindex.h \
+    $$PWD/atlas.h \
+    $$PWD/commands.h \
+    $$PWD/generator.h \
+    $$PWD/imageops.h \
+    $$PWD/journal.h \
+    $$PWD/projectmodel.h \
+    $$PWD/projectstats.h \
+    $$PWD/bake.h \
+    $$PWD/trace.h \
+    $$PWD/validate.h \
+    $$PWD/zip.h
+
+SOURCES += \
+    $$PWD/assetindex.cpp \
+    $$PWD/atlas.cpp \
+    $$PWD/commands.cpp \
+    $$PWD/generator.cpp \
+    $$PWD/imageops.cpp \
+    $$PWD/journal.cpp \
+    $$PWD/projectmodel.cpp \
+    $$PWD/projectstats.cpp \
+    $$PWD/bake.cpp \
+    $$PWD/trace.cpp \
+    $$PWD/validate.cpp \
+    $$PWD/zip.cpp
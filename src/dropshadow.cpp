@@ -0,0 +1,129 @@
+#include "dropshadow.h"
+#include "projectmodel.h"
+
+#include <QGraphicsPixmapItem>
+#include <QPixmapCache>
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+
+// Shadows are rendered at a higher resolution than the sprite so sub-pixel offsets
+// and blurs look right when zoomed in, but the shadow image is capped in size
+static const int MaxShadowScale = 4;
+static const int MaxShadowSize = 2048;
+static const int ShadowCacheLimitKB = 64 * 1024;
+
+DropShadow DropShadowFromPreferences() {
+	const auto& prefs = GlobalPreferences();
+	DropShadow shadow;
+	shadow.colour = prefs.dropShadowColour;
+	shadow.colour.setAlphaF(prefs.showDropShadow ? prefs.dropShadowOpacity : 0.0f);
+	shadow.offset = QPointF(prefs.dropShadowOffsetH, prefs.dropShadowOffsetV);
+	shadow.blurRadius = prefs.dropShadowBlurRadius;
+	return shadow;
+}
+
+// A single box blur pass of radius r along count lines of an 8-bit buffer
+static void BoxBlurPass(const uchar* src, uchar* dst, int length, int count, int stride, int step, int r) {
+	const int window = 2 * r + 1;
+	for (int line = 0; line < count; ++line) {
+		const uchar* in = src + line * stride;
+		uchar* out = dst + line * stride;
+		int sum = 0;
+		for (int k = 0; k < std::min(r, length); ++k) {
+			sum += in[k * step];
+		}
+		for (int k = 0; k < length; ++k) {
+			if (k + r < length) sum += in[(k + r) * step];
+			if (k - r - 1 >= 0) sum -= in[(k - r - 1) * step];
+			out[k * step] = (uchar)(sum / window);
+		}
+	}
+}
+
+QPixmap RenderDropShadow(const QImage& image, const DropShadow& shadow, QPointF* topLeft, qreal* scale) {
+	static const bool cacheLimitSet = [](){
+		QPixmapCache::setCacheLimit(std::max(QPixmapCache::cacheLimit(), ShadowCacheLimitKB));
+		return true;
+	}();
+	Q_UNUSED(cacheLimitSet);
+
+	const int maxDimension = std::max(1, std::max(image.width(), image.height()));
+	const int s = std::max(1, std::min(MaxShadowScale, MaxShadowSize / maxDimension));
+	const int r = std::max(0, (int) std::round(shadow.blurRadius * s / 3)); // Three box blurs approximate a gaussian
+	const int pad = 3 * r;
+	*topLeft = shadow.offset - QPointF(pad, pad) / s;
+	*scale = s;
+
+	if (image.isNull()) return QPixmap();
+
+	const QString key = QString("mqs-shadow:%1:%2:%3").arg(image.cacheKey()).arg(shadow.colour.rgba()).arg(r);
+	QPixmap pixmap;
+	if (QPixmapCache::find(key, &pixmap)) {
+		return pixmap;
+	}
+
+	// Build the (upscaled) alpha mask of the image
+	const int w = image.width() * s + 2 * pad;
+	const int h = image.height() * s + 2 * pad;
+	QVector<uchar> alpha(w * h, 0);
+	QVector<uchar> temp(w * h, 0);
+	const QImage src = image.convertToFormat(QImage::Format_ARGB32);
+	for (int y = 0; y < src.height(); ++y) {
+		const QRgb* line = reinterpret_cast<const QRgb*>(src.constScanLine(y));
+		for (int x = 0; x < src.width(); ++x) {
+			const uchar a = (uchar) qAlpha(line[x]);
+			if (a == 0) continue;
+			for (int sy = 0; sy < s; ++sy) {
+				uchar* dst = alpha.data() + (pad + y * s + sy) * w + pad + x * s;
+				std::fill(dst, dst + s, a);
+			}
+		}
+	}
+
+	if (r > 0) {
+		for (int pass = 0; pass < 3; ++pass) {
+			BoxBlurPass(alpha.constData(), temp.data(), w, h, w, 1, r);
+			BoxBlurPass(temp.constData(), alpha.data(), h, w, 1, w, r);
+		}
+	}
+
+	// Tint it
+	const int red = shadow.colour.red();
+	const int green = shadow.colour.green();
+	const int blue = shadow.colour.blue();
+	const int opacity = shadow.colour.alpha();
+	QImage result(w, h, QImage::Format_ARGB32_Premultiplied);
+	for (int y = 0; y < h; ++y) {
+		QRgb* line = reinterpret_cast<QRgb*>(result.scanLine(y));
+		const uchar* in = alpha.constData() + y * w;
+		for (int x = 0; x < w; ++x) {
+			line[x] = qPremultiply(qRgba(red, green, blue, in[x] * opacity / 255));
+		}
+	}
+
+	pixmap = QPixmap::fromImage(result);
+	QPixmapCache::insert(key, pixmap);
+	return pixmap;
+}
+
+QGraphicsPixmapItem* AddDropShadowItem(QGraphicsItem* parent, const QImage& image, const DropShadow& shadow) {
+	auto* item = new QGraphicsPixmapItem(parent);
+	item->setFlag(QGraphicsItem::ItemStacksBehindParent);
+	item->setTransformationMode(Qt::SmoothTransformation);
+	UpdateDropShadowItem(item, image, shadow);
+	return item;
+}
+
+void UpdateDropShadowItem(QGraphicsPixmapItem* item, const QImage& image, const DropShadow& shadow) {
+	if (!shadow.isVisible()) {
+		item->setPixmap(QPixmap());
+		return;
+	}
+
+	QPointF topLeft;
+	qreal scale = 1;
+	item->setPixmap(RenderDropShadow(image, shadow, &topLeft, &scale));
+	item->setPos(topLeft);
+	item->setScale(1 / scale);
+}
@@ -0,0 +1,36 @@
+#ifndef DROPSHADOW_H
+#define DROPSHADOW_H
+
+#include <QColor>
+#include <QImage>
+#include <QPixmap>
+#include <QPointF>
+
+class QGraphicsItem;
+class QGraphicsPixmapItem;
+
+// Pre-rendered drop shadows
+// The shadow of a frame is rendered once into a pixmap (in sprite pixel units) and
+// cached in QPixmapCache, keyed by the frame's QImage::cacheKey() and the shadow
+// parameters. It is therefore only re-rendered if the frame or the preferences change,
+// and costs a single pixmap blit per paint at any zoom level.
+
+struct DropShadow {
+	QColor colour {};		// alpha is the shadow opacity
+	QPointF offset {};		// in sprite pixels
+	qreal blurRadius = 0;	// in sprite pixels
+	bool isVisible() const { return colour.alpha() > 0; }
+};
+
+// The drop shadow described by GlobalPreferences()
+DropShadow DropShadowFromPreferences();
+
+// Returns the (cached) shadow pixmap of image.
+// The pixmap is drawn at topLeft (relative to the image) scaled by 1/scale.
+QPixmap RenderDropShadow(const QImage& image, const DropShadow& shadow, QPointF* topLeft, qreal* scale);
+
+// Creates an item that draws the shadow of image (behind parent, if there is one)
+QGraphicsPixmapItem* AddDropShadowItem(QGraphicsItem* parent, const QImage& image, const DropShadow& shadow);
+void UpdateDropShadowItem(QGraphicsPixmapItem* shadowItem, const QImage& image, const DropShadow& shadow);
+
+#endif // DROPSHADOW_H
@@ -0,0 +1,172 @@
+#include "generator.h"
+#include "commands.h"
+#include "projectmodel.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QVector>
+#include <algorithm>
+
+namespace {
+
+// A tiny portable PRNG (xorshift32), so projects don't depend on the standard library's distributions
+class Random {
+public:
+    explicit Random(quint32 seed):mState(seed ? seed : 0x9E3779B9u){}
+
+    quint32 next(){
+        mState ^= mState << 13;
+        mState ^= mState >> 17;
+        mState ^= mState << 5;
+        return mState;
+    }
+
+    int range(int n){ return n > 0 ? (int)(next() % (quint32) n) : 0; } // [0, n)
+    double unit(){ return (next() & 0xFFFFFF) / (double) 0x1000000; } // [0, 1)
+
+private:
+    quint32 mState;
+};
+
+const char* ModeNames[] = {"icon", "side", "walk", "idle", "attk", "jump", "hurt", "dead"};
+
+QString ModeName(int index){
+    const int numNames = sizeof(ModeNames) / sizeof(ModeNames[0]);
+    if (index < numNames) return ModeNames[index];
+    return QString("m%1").arg(index, 3, 10, QChar('0'));
+}
+
+// A blob with a darker outline, like a typical sprite
+QSharedPointer<QImage> MakeFrame(Random& random, int size){
+    auto image = QSharedPointer<QImage>::create(size, size, QImage::Format_ARGB32);
+    image->fill(0x00FFFFFF);
+
+    const QRgb colour = qRgba(40 + random.range(200), 40 + random.range(200), 40 + random.range(200), 255);
+    const QRgb outline = qRgba(qRed(colour) / 3, qGreen(colour) / 3, qBlue(colour) / 3, 255);
+    const int cx = size / 2 + random.range(size / 8 + 1) - size / 16;
+    const int cy = size / 2 + random.range(size / 8 + 1) - size / 16;
+    const int rx = std::max(1, size / 4 + random.range(size / 4 + 1));
+    const int ry = std::max(1, size / 4 + random.range(size / 4 + 1));
+    for (int y = 0; y < size; y++){
+        for (int x = 0; x < size; x++){
+            const double dx = (double)(x - cx) / rx, dy = (double)(y - cy) / ry;
+            const double d = dx * dx + dy * dy;
+            if (d < 1) image->setPixel(x, y, d > 0.7 ? outline : colour);
+        }
+    }
+    return image;
+}
+
+void AddFolders(Random& random, AssetRef parent, int depth, const GeneratorSettings& settings, const QString& prefix, QList<AssetRef>* leaves){
+    for (int i = 0; i < settings.foldersPerLevel; i++){
+        auto folder = QSharedPointer<Folder>::create();
+        folder->ref = PM()->createAssetRef(AssetType::Folder);
+        folder->name = QString("%1%2").arg(prefix).arg(i);
+        PM()->folders.insert(folder->ref, folder);
+        if (!parent.isNull()) TryCommand(new CMoveAsset(folder->ref, parent));
+
+        if (depth > 1) AddFolders(random, folder->ref, depth - 1, settings, folder->name + "_", leaves);
+        else leaves->append(folder->ref);
+    }
+}
+
+}
+
+bool GenerateProject(const GeneratorSettings& settings, QStringList* log){
+    if (settings.numParts < 0 || settings.modesPerPart <= 0 || settings.framesPerMode <= 0 || settings.frameSize <= 0
+        || settings.folderDepth < 0 || settings.foldersPerLevel <= 0 || settings.numComposites < 0 || settings.compositeSize < 0
+        || settings.duplicateRatio < 0 || settings.duplicateRatio > 1){
+        log->append("Invalid generator settings");
+        return false;
+    }
+    if (settings.numComposites > 0 && settings.compositeSize > 0 && settings.numParts == 0){
+        log->append("Composites need some sprites");
+        return false;
+    }
+
+    PM()->clear();
+    Random random(settings.seed);
+
+    QList<AssetRef> folders;
+    if (settings.folderDepth > 0){
+        AddFolders(random, AssetRef(), settings.folderDepth, settings, "folder_", &folders);
+    }
+
+    // NB: Assets are added directly rather than with CNewPart, etc, as finding unique default names is quadratic
+    QVector<AssetRef> parts;
+    QVector<AssetRef> originals; // the parts that aren't duplicates
+    const int size = settings.frameSize;
+    for (int i = 0; i < settings.numParts; i++){
+        auto part = QSharedPointer<Part>::create();
+        part->ref = PM()->createAssetRef(AssetType::Part);
+        part->name = QString("sprite_%1").arg(i, 5, 10, QChar('0'));
+
+        const bool duplicate = !originals.isEmpty() && random.unit() < settings.duplicateRatio;
+        if (duplicate){
+            const Part* original = PM()->getPart(originals.at(random.range(originals.size())));
+            for (auto it = original->modes.begin(); it != original->modes.end(); ++it){
+                Part::Mode mode = it.value();
+                mode.frames.clear();
+                for (const auto& img: it.value().frames){
+                    mode.frames.push_back(QSharedPointer<QImage>::create(*img));
+                }
+                part->modes.insert(it.key(), mode);
+            }
+        }
+        else {
+            for (int m = 0; m < settings.modesPerPart; m++){
+                Part::Mode mode;
+                mode.width = size;
+                mode.height = size;
+                mode.numFrames = settings.framesPerMode;
+                mode.numPivots = 1 + random.range(Part::MaxPivots);
+                mode.framesPerSecond = 4 + random.range(12);
+                for (int f = 0; f < settings.framesPerMode; f++){
+                    mode.frames.push_back(MakeFrame(random, size));
+                    mode.anchor.push_back(QPoint(size / 2, size - 1 - random.range(size / 8 + 1)));
+                    for (int p = 0; p < Part::MaxPivots; p++){
+                        mode.pivots[p].push_back(p < mode.numPivots ? QPoint(random.range(size), random.range(size)) : QPoint(0, 0));
+                    }
+                }
+                part->modes.insert(ModeName(m), mode);
+            }
+        }
+
+        QJsonObject properties;
+        properties.insert("id", i);
+        properties.insert("group", QString("group_%1").arg(random.range(16)));
+        properties.insert("health", 1 + random.range(100));
+        // NB: Properties are stored without the outer braces (see ProjectModel::partToJson)
+        const QString json = QString::fromUtf8(QJsonDocument(properties).toJson(QJsonDocument::Compact));
+        part->properties = json.mid(1, json.size() - 2);
+
+        PM()->parts.insert(part->ref, part);
+        if (!folders.isEmpty()) TryCommand(new CMoveAsset(part->ref, folders.at(random.range(folders.size()))));
+        parts.append(part->ref);
+        if (!duplicate) originals.append(part->ref);
+    }
+
+    for (int c = 0; c < settings.numComposites; c++){
+        auto comp = QSharedPointer<Composite>::create();
+        comp->ref = PM()->createAssetRef(AssetType::Composite);
+        comp->name = QString("comp_%1").arg(c, 5, 10, QChar('0'));
+        PM()->composites.insert(comp->ref, comp);
+        if (!folders.isEmpty()) TryCommand(new CMoveAsset(comp->ref, folders.at(random.range(folders.size()))));
+
+        // Each child hangs off a random pivot of a random earlier child
+        for (int i = 0; i < settings.compositeSize; i++){
+            TryCommand(new CNewCompositeChild(comp->ref));
+            const QString childName = comp->children.last();
+            const AssetRef partRef = parts.at(random.range(parts.size()));
+            int parent = -1, parentPivot = -1;
+            if (i > 0){
+                parent = random.range(i);
+                const Part* parentPart = PM()->getPart(comp->childrenMap.value(comp->children.at(parent)).part);
+                parentPivot = random.range(parentPart->modes.first().numPivots);
+            }
+            TryCommand(new CEditCompositeChild(comp->ref, childName, partRef, random.range(8) - 4, parent, parentPivot));
+        }
+    }
+
+    return true;
+}
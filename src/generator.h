@@ -0,0 +1,25 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <QStringList>
+
+// Generates deterministic synthetic projects (the same settings always give the same project),
+// for benchmarks and stress tests that need more data than the examples.
+
+struct GeneratorSettings {
+    quint32 seed = 1;
+    int numParts = 100;
+    int modesPerPart = 2;
+    int framesPerMode = 4;
+    int frameSize = 32; // width and height of every frame
+    int folderDepth = 0; // folders nested this deep, 0 for no folders
+    int foldersPerLevel = 2; // subfolders of each folder
+    int numComposites = 0;
+    int compositeSize = 4; // children per composite
+    double duplicateRatio = 0; // fraction of sprites with exactly the same frames as an earlier sprite
+};
+
+// Replaces the project in PM() with a generated one
+bool GenerateProject(const GeneratorSettings& settings, QStringList* log);
+
+#endif // GENERATOR_H
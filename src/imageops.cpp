@@ -0,0 +1,172 @@
+#include "imageops.h"
+#include "projectmodel.h"
+#include "trace.h"
+
+#include <QPainter>
+#include <QQueue>
+#include <QStringList>
+
+QImage PartIconImage(Part* part) {
+	TRACE_SCOPE("PartIconImage");
+	Q_ASSERT(part);
+
+	QStringList modeList{ "icon", "side", "wrld" };
+	modeList.append(part->modes.keys());
+	for (const auto& mode : modeList) {
+		if (part->modes.contains(mode)) {
+			auto img = part->modes[mode].frames[0];
+			// Extract a subregion from it
+			// Auto-crop?								
+			int cropLeft = img->width();
+			int cropTop = img->height();
+			int cropRight = 0;
+			int cropBottom = 0;
+			for (int x = 0; x < img->width(); ++x) {
+				for (int y = 0; y < img->height(); ++y) {
+					const bool opaque = (img->pixelColor(x, y).alpha() > 0);
+					if (opaque) {
+						if (cropLeft > x) cropLeft = x;
+						if (cropRight < x) cropRight = x;
+						if (cropTop > y) cropTop = y;
+						if (cropBottom < y) cropBottom = y;
+					}
+				}
+			}
+
+			/*
+			// TODO: Use the anchor to refine the crop selection
+			QPoint anchor = part->modes[mode].anchor[0];
+
+			int left = img->width() / 2 - 16;
+			int top = img->height() / 2 - 16;
+			int width = 32;
+			int height = 32;
+			if (mode == "side" || mode == "wrld") {
+				left = anchor.x() - width / 2;
+				top = anchor.y() - height;
+			}*/
+
+			int left = cropLeft;
+			int top = cropTop;
+			int width = 1 + cropRight - cropLeft;
+			int height = 1 + cropBottom - cropTop;
+
+			if (width < 8) {
+				int expand = 8 - width;
+				left -= expand / 2;
+				width += expand;
+			}
+
+			if (height < 8) {
+				int expand = 8 - height;
+				top -= expand / 2;
+				height += expand;
+			}
+
+			if (width > 2 && height > 2) {
+				QImage copy = img->copy(left, top, width, height);
+				int opaquePixelCount = 0;
+				for (int x = 0; x < copy.width(); ++x) {
+					for (int y = 0; y < copy.height(); ++y) {
+						opaquePixelCount += (int)(copy.pixelColor(x, y).alpha() > 0);
+					}
+				}
+				if (opaquePixelCount > 0.1 * copy.width() * copy.height()) {
+					return copy.scaled(QSize(16, 16));
+				}
+			}
+		}
+	}
+
+	return {};
+}
+
+QImage FloodFill(const QImage& image, QPoint start, QRgb colour) {
+	TRACE_SCOPE("FloodFill");
+	QImage fillPattern = image.copy();
+	if (start.x() < 0 || start.x() >= fillPattern.width() || start.y() < 0 || start.y() >= fillPattern.height()) return fillPattern;
+
+	QRgb targetColour = fillPattern.pixel(start.x(), start.y());
+	if (targetColour == colour) return fillPattern;
+
+	QQueue<QPoint> q;
+	q.enqueue(start);
+	while (!q.isEmpty()) {
+		QPoint p = q.dequeue();
+		if (p.x() >= 0 && p.x() < fillPattern.width() && p.y() >= 0 && p.y() < fillPattern.height()) {
+			QRgb c = fillPattern.pixel(p);
+			if (c == targetColour) {
+				fillPattern.setPixel(p, colour);
+				q.enqueue(QPoint(p.x() + 1, p.y()));
+				q.enqueue(QPoint(p.x() - 1, p.y()));
+				q.enqueue(QPoint(p.x(), p.y() + 1));
+				q.enqueue(QPoint(p.x(), p.y() - 1));
+			}
+		}
+	}
+	return fillPattern;
+}
+
+QList<QRect> TilesIn(const QRect& rect, const QSize& size) {
+	QList<QRect> tiles;
+	const QRect clipped = rect & QRect(QPoint(0, 0), size);
+	if (clipped.isEmpty()) return tiles;
+	for (int ty = clipped.top() / TileSize; ty <= clipped.bottom() / TileSize; ty++) {
+		for (int tx = clipped.left() / TileSize; tx <= clipped.right() / TileSize; tx++) {
+			tiles.append(QRect(tx * TileSize, ty * TileSize, TileSize, TileSize) & QRect(QPoint(0, 0), size));
+		}
+	}
+	return tiles;
+}
+
+bool IsTransparent(const QImage& image, const QRect& rect) {
+	if (!image.hasAlphaChannel()) return rect.isEmpty();
+	if (image.format() != QImage::Format_ARGB32 && image.format() != QImage::Format_ARGB32_Premultiplied) {
+		return IsTransparent(image.copy(rect).convertToFormat(QImage::Format_ARGB32), QRect(QPoint(0, 0), rect.size()));
+	}
+	// NB: Stops at the first opaque pixel
+	const QRect clipped = rect & image.rect();
+	for (int y = clipped.top(); y <= clipped.bottom(); y++) {
+		const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+		for (int x = clipped.left(); x <= clipped.right(); x++) {
+			if (qAlpha(line[x]) != 0) return false;
+		}
+	}
+	return true;
+}
+
+QList<QRect> OpaqueTiles(const QImage& overlay, QPoint offset, const QSize& size) {
+	TRACE_SCOPE("OpaqueTiles");
+	QList<QRect> tiles;
+	for (const QRect& tile : TilesIn(QRect(offset, overlay.size()), size)) {
+		if (!IsTransparent(overlay, tile.translated(-offset))) tiles.append(tile);
+	}
+	return tiles;
+}
+
+QRect SavedTiles::bounds() const {
+	QRect bounds;
+	for (const QRect& rect : rects) bounds |= rect;
+	return bounds;
+}
+
+qint64 SavedTiles::bytes() const {
+	qint64 bytes = 0;
+	for (const QImage& image : images) bytes += image.byteCount();
+	return bytes;
+}
+
+SavedTiles SaveTiles(const QImage& image, const QList<QRect>& tiles) {
+	SavedTiles saved;
+	saved.rects = tiles;
+	for (const QRect& tile : tiles) saved.images.append(image.copy(tile));
+	return saved;
+}
+
+void RestoreTiles(QImage* image, const SavedTiles& tiles) {
+	QPainter painter(image);
+	painter.setCompositionMode(QPainter::CompositionMode_Source);
+	for (int i = 0; i < tiles.rects.size(); i++) {
+		painter.drawImage(tiles.rects.at(i).topLeft(), tiles.images.at(i));
+	}
+}
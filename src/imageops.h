@@ -0,0 +1,44 @@
+#ifndef IMAGEOPS_H
+#define IMAGEOPS_H
+
+#include <QImage>
+#include <QList>
+#include <QPoint>
+#include <QRect>
+
+struct Part;
+
+// Image operations shared by the editor widgets and mqsprite-cli (e.g., for benchmarking)
+
+// A 16x16 icon cropped from the first frame of the part's icon, side or wrld mode (or any mode)
+// Returns a null image if no frame has enough opaque pixels.
+QImage PartIconImage(Part* part);
+
+// Returns a copy of image with the 4-connected region of the colour at start replaced by colour
+QImage FloodFill(const QImage& image, QPoint start, QRgb colour);
+
+// Large frames are edited and drawn in tiles, so the cost of a stroke depends on the size
+// of the stroke rather than the size of the frame
+const int TileSize = 64;
+
+// The tiles of an image of the given size that rect touches (clipped to the image)
+QList<QRect> TilesIn(const QRect& rect, const QSize& size);
+
+// Whether every pixel of image in rect is fully transparent (e.g., to skip drawing a tile)
+bool IsTransparent(const QImage& image, const QRect& rect);
+
+// The tiles of an image of the given size that have an opaque pixel of overlay drawn at offset
+QList<QRect> OpaqueTiles(const QImage& overlay, QPoint offset, const QSize& size);
+
+// The pixels of some tiles of a frame (e.g., to undo a stroke)
+struct SavedTiles {
+	QList<QRect> rects;
+	QList<QImage> images;
+	QRect bounds() const;
+	qint64 bytes() const;
+};
+
+SavedTiles SaveTiles(const QImage& image, const QList<QRect>& tiles);
+void RestoreTiles(QImage* image, const SavedTiles& tiles);
+
+#endif // IMAGEOPS_H
@@ -0,0 +1,356 @@
+#include "journal.h"
+#include "assetindex.h"
+#include "trace.h"
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QPainter>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+
+const quint32 JournalMagic = 0x4D514A4E; // "MQJN"
+const quint32 JournalVersion = 2; // 2 added RecordFramePixels
+const int StreamVersion = QDataStream::Qt_5_6;
+const int MaxJournals = 16; // i.e., editors running at once
+
+enum RecordType {
+    RecordAsset = 1, // the new state of an asset
+    RecordFrame = 2, // the new image, anchor and pivots of a frame
+    RecordRemoved = 3,
+    RecordFramePixels = 4, // the anchor and pivots of a frame and the part of its image that changed
+};
+
+QByteArray EncodePng(const QImage& image){
+    QByteArray png;
+    QBuffer buffer(&png);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "PNG");
+    return png;
+}
+
+bool ReadHeader(QDataStream& in, QString* baseline){
+    quint32 magic = 0, version = 0;
+    in >> magic >> version;
+    if (in.status() != QDataStream::Ok || magic != JournalMagic || version < 1 || version > JournalVersion) return false;
+    in >> *baseline;
+    return in.status() == QDataStream::Ok;
+}
+
+bool TryLock(const QString& fileName, QScopedPointer<QLockFile>& fileLock){
+    fileLock.reset(new QLockFile(fileName + ".lock"));
+    // NB: Only stale if the editor that holds it isn't running anymore
+    fileLock->setStaleLockTime(0);
+    if (fileLock->tryLock(0)) return true;
+    fileLock.reset();
+    return false;
+}
+
+void ResetImageCache(Part* part){
+    for (const auto& mode : part->modes) {
+        for (const auto& frame : mode.frames) PM()->resetImageCache(frame.get());
+    }
+}
+
+}
+
+Journal::Journal(){
+    const QDir dir { QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) };
+    dir.mkpath(".");
+    // NB: Keeps the first free one locked while it looks for one to recover, so another editor can't take it
+    QString firstFree;
+    QScopedPointer<QLockFile> firstFreeLock;
+    for (int i = 0; i < MaxJournals; i++){
+        const QString fileName = dir.absoluteFilePath(i == 0 ? QString("journal.mqj") : QString("journal-%1.mqj").arg(i));
+        QScopedPointer<QLockFile> fileLock;
+        if (!TryLock(fileName, fileLock)) continue;
+        QString baseline;
+        if (HasChanges(fileName, &baseline)){
+            mFileName = fileName;
+            mLock.swap(fileLock);
+            break;
+        }
+        if (!firstFreeLock){
+            firstFree = fileName;
+            firstFreeLock.swap(fileLock);
+        }
+    }
+    if (!mLock && firstFreeLock){
+        mFileName = firstFree;
+        mLock.swap(firstFreeLock);
+    }
+    if (!mLock) qWarning() << "Couldn't lock a journal in " << dir.absolutePath();
+    mFile.setFileName(mFileName);
+}
+
+Journal::Journal(const QString& fileName):mFileName(fileName), mFile(fileName){
+    if (!TryLock(fileName, mLock)) qWarning() << "Journal " << fileName << " is held by another editor";
+}
+
+Journal::~Journal(){
+    mFile.close();
+}
+
+bool Journal::writeHeader(const QString& baseline){
+    QDataStream out(&mFile);
+    out.setVersion(StreamVersion);
+    out << JournalMagic << JournalVersion << baseline;
+    mFile.flush();
+    return out.status() == QDataStream::Ok;
+}
+
+bool Journal::start(const QString& baseline){
+    mFile.close();
+    mChangedAssets.clear();
+    mChangedFrames.clear();
+    if (!mLock) return false;
+    if (!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)){
+        qWarning() << "Couldn't open journal " << mFileName;
+        return false;
+    }
+    return writeHeader(baseline);
+}
+
+bool Journal::resume(){
+    mFile.close();
+    mChangedAssets.clear();
+    mChangedFrames.clear();
+    return mLock && mFile.open(QIODevice::WriteOnly | QIODevice::Append);
+}
+
+void Journal::discard(){
+    mFile.close();
+    mChangedAssets.clear();
+    mChangedFrames.clear();
+    if (mLock) QFile::remove(mFileName);
+}
+
+void Journal::assetChanged(const AssetRef& ref, bool framesChanged){
+    if (!mFile.isOpen()) return;
+    bool& frames = mChangedAssets[ref];
+    frames = frames || framesChanged;
+}
+
+void Journal::frameChanged(const AssetRef& ref, const QString& mode, int frame, const QRect& pixels){
+    if (!mFile.isOpen()) return;
+    QRect& rect = mChangedFrames[FrameKey {ref, mode, frame}];
+    rect = rect.united(pixels);
+}
+
+void Journal::writeRecord(int type, const QByteArray& payload){
+    QDataStream out(&mFile);
+    out.setVersion(StreamVersion);
+    out << qint8(type) << payload;
+}
+
+void Journal::flush(){
+    if (!mFile.isOpen() || (mChangedAssets.isEmpty() && mChangedFrames.isEmpty())) return;
+    TRACE_SCOPE("Journal::flush");
+
+    for (auto it = mChangedAssets.begin(); it != mChangedAssets.end(); ++it){
+        const AssetRef& ref = it.key();
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(StreamVersion);
+        out << qint32(ref.id) << qint32(ref.type);
+        if (!PM()->hasAsset(ref)){
+            writeRecord(RecordRemoved, payload);
+            continue;
+        }
+
+        QMap<QString, QSharedPointer<QImage>> imageMap;
+        const QJsonObject obj = PM()->assetToJson(ref, &imageMap);
+        QMap<QString, QByteArray> pngs;
+        if (it.value()){
+            for (auto img = imageMap.begin(); img != imageMap.end(); ++img){
+                if (img.value()) pngs.insert(img.key(), EncodePng(*img.value()));
+            }
+        }
+        out << QJsonDocument(obj).toJson(QJsonDocument::Compact) << pngs;
+        writeRecord(RecordAsset, payload);
+    }
+
+    for (auto it = mChangedFrames.constBegin(); it != mChangedFrames.constEnd(); ++it){
+        const FrameKey& key = it.key();
+        if (mChangedAssets.value(key.ref, false)) continue; // Already written with the rest of its frames
+        Part* part = PM()->getPart(key.ref);
+        if (part == nullptr) continue;
+        auto mit = part->modes.constFind(key.mode);
+        if (mit == part->modes.constEnd() || key.frame < 0 || key.frame >= mit->frames.size() || !mit->frames.at(key.frame)) continue;
+        const QImage& image = *mit->frames.at(key.frame);
+
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(StreamVersion);
+        out << qint32(key.ref.id) << qint32(key.ref.type) << key.mode << qint32(key.frame);
+        out << mit->anchor.value(key.frame);
+        for (int p = 0; p < Part::MaxPivots; p++) out << mit->pivots[p].value(key.frame);
+
+        // NB: A stroke only writes the pixels it touched, anything else writes the whole frame
+        const QRect pixels = it.value() & image.rect();
+        if (pixels.isEmpty()){
+            out << EncodePng(image);
+            writeRecord(RecordFrame, payload);
+        }
+        else {
+            out << pixels.topLeft() << EncodePng(image.copy(pixels));
+            writeRecord(RecordFramePixels, payload);
+        }
+    }
+
+    // NB: So it survives a crash
+    mFile.flush();
+    mChangedAssets.clear();
+    mChangedFrames.clear();
+}
+
+bool Journal::rebase(const QString& baseline, qint64 position){
+    TRACE_SCOPE("Journal::rebase");
+    if (!mFile.isOpen()) return false;
+    flush();
+    mFile.close();
+
+    QByteArray records;
+    {
+        QFile file(mFileName);
+        if (file.open(QIODevice::ReadOnly) && file.seek(position)) records = file.readAll();
+    }
+
+    QSaveFile file(mFileName);
+    if (file.open(QIODevice::WriteOnly)){
+        QDataStream out(&file);
+        out.setVersion(StreamVersion);
+        out << JournalMagic << JournalVersion << baseline;
+        file.write(records);
+        file.commit();
+    }
+    return resume();
+}
+
+bool Journal::HasChanges(const QString& fileName, QString* baseline){
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    QDataStream in(&file);
+    in.setVersion(StreamVersion);
+    return ReadHeader(in, baseline) && !in.atEnd();
+}
+
+int Journal::Replay(const QString& fileName, QSet<AssetRef>* changed){
+    TRACE_SCOPE("Journal::Replay");
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return 0;
+    QDataStream in(&file);
+    in.setVersion(StreamVersion);
+    QString baseline;
+    if (!ReadHeader(in, &baseline)) return 0;
+
+    int count = 0;
+    while (!in.atEnd()){
+        qint8 type = 0;
+        QByteArray payload;
+        in >> type >> payload;
+        if (in.status() != QDataStream::Ok) break; // NB: The last record is incomplete if it crashed while writing it
+
+        QDataStream record(payload);
+        record.setVersion(StreamVersion);
+        qint32 id = 0, assetType = 0;
+        record >> id >> assetType;
+        AssetRef ref;
+        ref.id = id;
+        ref.type = static_cast<AssetType>(assetType);
+
+        switch (type){
+        case RecordRemoved: {
+            if (Part* part = PM()->getPart(ref)) ResetImageCache(part);
+            PM()->parts.remove(ref);
+            PM()->composites.remove(ref);
+            PM()->folders.remove(ref);
+            PM()->searchIndex()->invalidate(ref);
+            if (changed) changed->insert(ref);
+            count++;
+            break;
+        }
+        case RecordAsset: {
+            QByteArray json;
+            QMap<QString, QByteArray> pngs;
+            record >> json >> pngs;
+            const QJsonObject obj = QJsonDocument::fromJson(json).object();
+
+            QMap<QString, QSharedPointer<QImage>> imageMap;
+            for (auto it = pngs.begin(); it != pngs.end(); ++it){
+                auto image = QSharedPointer<QImage>::create();
+                if (image->loadFromData(it.value(), "PNG")) imageMap.insert(it.key(), image);
+            }
+
+            Part* oldPart = PM()->getPart(ref);
+            if (oldPart && pngs.isEmpty()){
+                // Only the metadata changed, so it keeps the frames it has
+                for (const auto& modeValue : obj["modes"].toArray()){
+                    const QJsonObject mode = modeValue.toObject();
+                    auto mit = oldPart->modes.constFind(mode["name"].toString());
+                    if (mit == oldPart->modes.constEnd()) continue;
+                    const QJsonArray frames = mode["frames"].toArray();
+                    for (int frame = 0; frame < frames.size() && frame < mit->frames.size(); frame++){
+                        imageMap.insert(frames.at(frame).toObject().value("image").toString(), mit->frames.at(frame));
+                    }
+                }
+            }
+            else if (oldPart){
+                ResetImageCache(oldPart);
+            }
+
+            if (PM()->assetFromJson(ref, obj, imageMap)){
+                if (changed) changed->insert(ref);
+                count++;
+            }
+            break;
+        }
+        case RecordFrame:
+        case RecordFramePixels: {
+            QString modeName;
+            qint32 frame = 0;
+            QPoint anchor;
+            QPoint pivots[Part::MaxPivots];
+            QByteArray png;
+            record >> modeName >> frame >> anchor;
+            for (int p = 0; p < Part::MaxPivots; p++) record >> pivots[p];
+            QPoint offset;
+            if (type == RecordFramePixels) record >> offset;
+            record >> png;
+
+            Part* part = PM()->getPart(ref);
+            if (part == nullptr || !part->modes.contains(modeName)) break;
+            Part::Mode& mode = part->modes[modeName];
+            auto image = QSharedPointer<QImage>::create();
+            if (frame < 0 || frame >= mode.frames.size() || !image->loadFromData(png, "PNG")) break;
+
+            PM()->resetImageCache(mode.frames.at(frame).get());
+            if (type == RecordFramePixels){
+                if (!mode.frames.at(frame)) break;
+                // NB: Source, so erased pixels are replaced rather than blended
+                QPainter painter(mode.frames.at(frame).data());
+                painter.setCompositionMode(QPainter::CompositionMode_Source);
+                painter.drawImage(offset, *image);
+            }
+            else {
+                mode.frames[frame] = image;
+            }
+            if (frame < mode.anchor.size()) mode.anchor[frame] = anchor;
+            for (int p = 0; p < Part::MaxPivots; p++){
+                if (frame < mode.pivots[p].size()) mode.pivots[p][frame] = pivots[p];
+            }
+            if (changed) changed->insert(ref);
+            count++;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    return count;
+}
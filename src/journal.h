@@ -0,0 +1,76 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "projectmodel.h"
+
+#include <QFile>
+#include <QHash>
+#include <QLockFile>
+#include <QRect>
+#include <QScopedPointer>
+#include <QSet>
+#include <QString>
+
+// An append-only log of the changes made to the project since it was last saved, so the
+// edits since then can be recovered after a crash (see Replay).
+// The editor tells it what each command changed and calls flush() when the command is
+// done, which appends the new state of just those things: the pixels a brush stroke touched,
+// the metadata of a sprite for a rename, and so on. Each record is a few KB, so it
+// can be kept up to date after every edit, unlike a full save.
+// Each editor holds a lock on its journal, so a second editor never writes to or
+// recovers the journal of one that's still running.
+class Journal {
+public:
+    // Takes the first journal in the app data directory that no running editor holds,
+    // preferring one with changes (i.e., left by an editor that crashed)
+    Journal();
+    explicit Journal(const QString& fileName);
+    ~Journal();
+
+    const QString& fileName() const {return mFileName;}
+
+    // Starts an empty journal of changes to baseline (a project file, or empty for a new project)
+    bool start(const QString& baseline);
+    // Carries on appending to the journal in the file (e.g., after replaying it)
+    bool resume();
+    // Removes the journal (e.g., on a normal exit)
+    void discard();
+    bool isOpen() const {return mFile.isOpen();}
+
+    // framesChanged is false if only the metadata of a part changed (e.g., its name)
+    void assetChanged(const AssetRef& ref, bool framesChanged = true);
+    // pixels is the part of the frame image that changed (empty if only its anchor or pivots did)
+    void frameChanged(const AssetRef& ref, const QString& mode, int frame, const QRect& pixels);
+    void flush();
+
+    // The end of the records so far
+    qint64 position() const {return mFile.pos();}
+    // The project was saved to baseline with the changes up to position (see ProjectModel::snapshot),
+    // so only the records after position are kept
+    bool rebase(const QString& baseline, qint64 position);
+
+    // Reads the baseline of the journal in fileName. Returns false if there's no journal or no changes.
+    static bool HasChanges(const QString& fileName, QString* baseline);
+    // Applies the changes in the journal in fileName to PM(). Returns the number of changes applied.
+    static int Replay(const QString& fileName, QSet<AssetRef>* changed = nullptr);
+
+private:
+    struct FrameKey {
+        AssetRef ref;
+        QString mode;
+        int frame;
+        bool operator==(const FrameKey& other) const {return ref == other.ref && mode == other.mode && frame == other.frame;}
+    };
+    friend uint qHash(const FrameKey& key){return qHash(key.ref) ^ qHash(key.mode) ^ uint(key.frame);}
+
+    bool writeHeader(const QString& baseline);
+    void writeRecord(int type, const QByteArray& payload);
+
+    QString mFileName;
+    QFile mFile;
+    QScopedPointer<QLockFile> mLock; // null if every journal is held by another editor
+    QHash<AssetRef, bool> mChangedAssets; // -> frames changed
+    QHash<FrameKey, QRect> mChangedFrames; // -> pixels changed
+};
+
+#endif // JOURNAL_H
@@ -1,4 +1,5 @@
 #include "mainwindow.h"
+#include "trace.h"
 #include <QApplication>
 #include <QSettings>
 #include <QStyleFactory>
@@ -62,6 +63,7 @@ int main(int argc, char *argv[])
     QCoreApplication::setOrganizationDomain("playmoonquest.com");
     QCoreApplication::setApplicationName("MQ Sprite");
     QApplication a(argc, argv);
+	Trace::startFromEnvironment();
 	
 	auto paths = QCoreApplication::libraryPaths();
 	paths.append("plugins");
@@ -87,5 +89,7 @@ int main(int argc, char *argv[])
     MainWindow w;
     w.show();
     
-    return a.exec();
+    const int result = a.exec();
+	Trace::stop();
+	return result;
 }
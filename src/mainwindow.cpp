@@ -8,6 +8,11 @@
 #include "animationwidget.h"
 #include "propertieswidget.h"
 #include "optionswidget.h"
+#include "projectstatswidget.h"
+#include "spritebrowser.h"
+#include "autosave.h"
+#include "savetask.h"
+#include "trace.h"
 
 #include <QSortFilterProxyModel>
 #include <QDebug>
@@ -20,6 +25,10 @@
 
 static MainWindow* sWindow = nullptr;
 
+// Where Help > Record Performance Trace writes to (MQSPRITE_TRACE overrides it)
+static QString defaultTraceFileName() {
+	return QDir::temp().absoluteFilePath("mqsprite_trace.json");
+}
 
 static QString makeWindowTitle(QString filename = {}, bool saved = true) {
 	static const QString appName { "MQ Sprite" };
@@ -36,6 +45,7 @@ MainWindow::MainWindow(QWidget *parent) :
     ui(new Ui::MainWindow)
 {
     sWindow = this;
+    SetProjectListener(this);
     mProjectModel = new ProjectModel();	
     // mProjectModel->loadTestData();
 
@@ -45,6 +55,9 @@ MainWindow::MainWindow(QWidget *parent) :
 
 	// Load preferences
 	loadPreferences();
+	if (GlobalPreferences().recordTrace && !Trace::isEnabled()) {
+		Trace::start(defaultTraceFileName());
+	}
 	
     mPartList = findChild<PartList*>("partList");
     connect(mPartList, SIGNAL(assetDoubleClicked(AssetRef)), this, SLOT(assetDoubleClicked(AssetRef)));
@@ -89,6 +102,19 @@ MainWindow::MainWindow(QWidget *parent) :
 	
     mUndoStack = new QUndoStack(this);
 	connect(mUndoStack, SIGNAL(indexChanged(int)), this, SLOT(undoStackIndexChanged(int)));
+	mAutosave = new Autosave(this);
+
+	mReloadTimer.setSingleShot(true);
+	mReloadTimer.setInterval(500);
+	connect(&mProjectWatcher, SIGNAL(fileChanged(QString)), &mReloadTimer, SLOT(start()));
+	connect(&mReloadTimer, SIGNAL(timeout()), this, SLOT(reloadChangedAssets()));
+	mSavePool.setMaxThreadCount(1);
+
+	mSaveProgress = new QProgressBar(this);
+	mSaveProgress->setRange(0, 100);
+	mSaveProgress->setMaximumWidth(160);
+	mSaveProgress->hide();
+	statusBar()->addPermanentWidget(mSaveProgress);
 
 	{
 		auto* dock = new QDockWidget("Composite Tools", this);
@@ -133,6 +159,33 @@ MainWindow::MainWindow(QWidget *parent) :
 		this->addDockWidget(Qt::LeftDockWidgetArea, dock);
 	}
 
+	{
+		auto* dock = new QDockWidget("Project Statistics", this);
+		dock->setObjectName("ProjectStatisticsDock");
+		dock->setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Preferred);
+		mProjectStatsWidget = new ProjectStatsWidget(mUndoStack, dock);
+		dock->setWidget(mProjectStatsWidget);
+		dock->setAllowedAreas(Qt::DockWidgetArea::LeftDockWidgetArea | Qt::DockWidgetArea::RightDockWidgetArea);
+		this->addDockWidget(Qt::RightDockWidgetArea, dock);
+		connect(dock, &QDockWidget::visibilityChanged, [this](bool visible) {
+			if (visible) mProjectStatsWidget->refresh();
+		});
+		dock->hide();
+	}
+
+	{
+		auto* dock = new QDockWidget("Sprite Browser", this);
+		dock->setObjectName("SpriteBrowserDock");
+		dock->setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Preferred);
+		mSpriteBrowser = new SpriteBrowser(dock);
+		dock->setWidget(mSpriteBrowser);
+		dock->setAllowedAreas(Qt::AllDockWidgetAreas);
+		this->addDockWidget(Qt::BottomDockWidgetArea, dock);
+		connect(mSpriteBrowser, SIGNAL(assetDoubleClicked(AssetRef)), this, SLOT(assetDoubleClicked(AssetRef)));
+		connect(mSpriteBrowser, SIGNAL(assetSelected(AssetRef)), this, SLOT(assetSelected(AssetRef)));
+		dock->hide();
+	}
+
     createActions();
     createMenus();
    
@@ -154,6 +207,18 @@ MainWindow::MainWindow(QWidget *parent) :
 		mViewMenu->addAction(action);
 	}
 
+	{
+		auto* action = dynamic_cast<QDockWidget*>(mProjectStatsWidget->parentWidget())->toggleViewAction();
+		action->setText("Project Statistics Window");
+		mViewMenu->addAction(action);
+	}
+
+	{
+		auto* action = dynamic_cast<QDockWidget*>(mSpriteBrowser->parentWidget())->toggleViewAction();
+		action->setText("Sprite Browser Window");
+		mViewMenu->addAction(action);
+	}
+
 	{
 		auto* action = dynamic_cast<QDockWidget*>(mCompositeToolsWidget->parentWidget())->toggleViewAction();
 		action->setText("Composite Tools Window");
@@ -169,10 +234,19 @@ MainWindow::MainWindow(QWidget *parent) :
 		restoreGeometry(settings.value("main_window_geometry").toByteArray());
 		restoreState(settings.value("main_window_state").toByteArray());
 	}
+
+	QString journalBaseline;
+	if (Journal::HasChanges(mJournal.fileName(), &journalBaseline) || QFile::exists(Autosave::RecoveryFileName())) {
+		QTimer::singleShot(0, this, SLOT(recoverProject()));
+	}
+	else {
+		mJournal.start(QString());
+	}
 }
 
 MainWindow::~MainWindow()
 {
+    SetProjectListener(nullptr);
     delete ui;
     delete mUndoStack;
     // delete ProjectModel last
@@ -328,6 +402,9 @@ void MainWindow::createMenus(){
 		mMdiArea->closeAllSubWindows();
 	});
     connect(reloadProjectAction, SIGNAL(triggered()), this, SLOT(reloadProject()));
+
+    QAction* mountLibraryAction = mFileMenu->addAction("Mount Library...");
+    connect(mountLibraryAction, SIGNAL(triggered()), this, SLOT(mountLibrary()));
 		
 	mFileMenu->addSeparator();
 
@@ -344,6 +421,17 @@ void MainWindow::createMenus(){
 	QAction* exportProjectActionAs = mFileMenu->addAction("Export As...");	
 	connect(exportProjectActionAs, SIGNAL(triggered()), this, SLOT(exportProjectAs()));
 
+	QAction* exportAtlasActionAs = mFileMenu->addAction("Export Atlas As...");
+	connect(exportAtlasActionAs, SIGNAL(triggered()), this, SLOT(exportAtlasAs()));
+
+	QAction* trimOnExportAction = mFileMenu->addAction("Trim Transparent Borders On Export");
+	trimOnExportAction->setCheckable(true);
+	trimOnExportAction->setChecked(GlobalPreferences().trimOnExport);
+	connect(trimOnExportAction, &QAction::toggled, this, [this](bool checked) {
+		GlobalPreferences().trimOnExport = checked;
+		savePreferences();
+	});
+
 	mFileMenu->addSeparator();
 
     QAction* quitAction = mFileMenu->addAction("&Quit");
@@ -401,12 +489,26 @@ void MainWindow::createMenus(){
 	});
 	action->setChecked(GlobalPreferences().tabbedView);
 	mViewMenu->addSeparator();
+	action = mViewMenu->addAction("Performance Overlay");
+	action->setCheckable(true);
+	action->setChecked(GlobalPreferences().showPerformanceOverlay);
+	connect(action, &QAction::toggled, [&](bool checked) {
+		GlobalPreferences().showPerformanceOverlay = checked;
+		this->updatePreferences();
+	});
 
 	auto* spriteMenu = menuBar()->addMenu(tr("&Sprite"));
 	mResizePartAction = spriteMenu->addAction("Resize...");
 	connect(mResizePartAction, SIGNAL(triggered()), mAnimationWidget, SLOT(resizeMode()));
 	mResizePartAction->setEnabled(false);
 
+	auto* compositeMenu = menuBar()->addMenu(tr("&Composite"));
+	mBakeCompositeAction = compositeMenu->addAction("Bake to Sprite");
+	connect(mBakeCompositeAction, &QAction::triggered, [&]() { bakeActiveComposite(false); });
+	mBakeCompositeAction->setEnabled(false);
+	mBakeCompositeToPngAction = compositeMenu->addAction("Bake to PNG Sequence...");
+	connect(mBakeCompositeToPngAction, &QAction::triggered, [&]() { bakeActiveComposite(true); });
+	mBakeCompositeToPngAction->setEnabled(false);
 	
 	auto toCamelCase = [](const QString& s) -> QString {
 		QStringList parts = s.split(' ', QString::SkipEmptyParts);
@@ -434,6 +536,22 @@ void MainWindow::createMenus(){
 	}
 
     mHelpMenu = menuBar()->addMenu(tr("Help"));
+	QAction* traceAction = mHelpMenu->addAction("Record Performance Trace");
+	traceAction->setCheckable(true);
+	traceAction->setChecked(Trace::isEnabled());
+	connect(traceAction, &QAction::toggled, this, [this](bool checked) {
+		GlobalPreferences().recordTrace = checked;
+		savePreferences();
+		if (checked) {
+			if (!Trace::isEnabled()) Trace::start(defaultTraceFileName());
+			showMessage("Recording a performance trace to " + Trace::fileName());
+		}
+		else {
+			const QString fileName = Trace::fileName();
+			if (Trace::stop()) showMessage("Wrote performance trace " + fileName);
+		}
+	});
+	mHelpMenu->addSeparator();
     mHelpMenu->addAction(mAboutAction);
 }
 
@@ -442,6 +560,9 @@ void MainWindow::showMessage(const QString& msg, int timeout){
 }
 
 void MainWindow::closeEvent(QCloseEvent*){
+    waitForSave();
+    mJournal.discard();
+
     // Save window layout..
     QSettings settings;
     settings.setValue("main_window_geometry", saveGeometry());
@@ -467,6 +588,10 @@ void MainWindow::loadPreferences() {
 
 	prefs.showOnionSkinning = settings.value("prefs.showOnionSkinning", prefs.showOnionSkinning).toBool();
 	prefs.onionSkinningOpacity = settings.value("prefs.onionSkinningOpacity", prefs.onionSkinningOpacity).toFloat();
+
+	prefs.trimOnExport = settings.value("prefs.trimOnExport", prefs.trimOnExport).toBool();
+	prefs.recordTrace = settings.value("prefs.recordTrace", prefs.recordTrace).toBool();
+	prefs.showPerformanceOverlay = settings.value("prefs.showPerformanceOverlay", prefs.showPerformanceOverlay).toBool();
 }
 
 void MainWindow::savePreferences() {
@@ -488,6 +613,10 @@ void MainWindow::savePreferences() {
 
 	settings.setValue("prefs.showOnionSkinning", prefs.showOnionSkinning);
 	settings.setValue("prefs.onionSkinningOpacity", prefs.onionSkinningOpacity);
+
+	settings.setValue("prefs.trimOnExport", prefs.trimOnExport);
+	settings.setValue("prefs.recordTrace", prefs.recordTrace);
+	settings.setValue("prefs.showPerformanceOverlay", prefs.showPerformanceOverlay);
 }
 
 void MainWindow::updatePreferences() {
@@ -609,6 +738,8 @@ void MainWindow::openCompositeWidget(AssetRef ref){
 
 void MainWindow::subWindowActivated(QMdiSubWindow* win){
 	mResizePartAction->setEnabled(false);
+	mBakeCompositeAction->setEnabled(false);
+	mBakeCompositeToPngAction->setEnabled(false);
 	
     if (win == nullptr){
         mCompositeToolsWidget->setTargetCompWidget(nullptr);
@@ -636,6 +767,8 @@ void MainWindow::subWindowActivated(QMdiSubWindow* win){
 			mDrawingTools->setTargetPartWidget(nullptr);
 			mAnimationWidget->setTargetPartWidget(nullptr);
 			mPropertiesWidget->setTargetPartWidget(nullptr);
+			mBakeCompositeAction->setEnabled(true);
+			mBakeCompositeToPngAction->setEnabled(true);
 
 			mPartList->selectAsset(cw->compRef());
         }
@@ -653,7 +786,7 @@ CompositeWidget* MainWindow::activeCompositeWidget(){
 }
 
 void MainWindow::partListChanged(){
-    mPartList->updateList();
+    // NB: The asset list is kept up to date by assetInserted, etc
 
     // Delete any part widgets that don't exist anymore
     QMutableMapIterator<AssetRef,PartWidget*> i(mPartWidgets);
@@ -675,8 +808,6 @@ void MainWindow::partListChanged(){
 }
 
 void MainWindow::newAssetCreated(AssetRef ref) {
-	mPartList->updateList();
-
 	if (ref.type == AssetType::Part) {
 		openPartWidget(ref);
 		mPartList->selectAsset(ref);
@@ -690,8 +821,27 @@ void MainWindow::newAssetCreated(AssetRef ref) {
 	}
 }
 
+void MainWindow::assetInserted(AssetRef ref) {
+	mJournal.assetChanged(ref);
+	mPartList->assetInserted(ref);
+	mSpriteBrowser->assetInserted(ref);
+}
+
+void MainWindow::assetRemoved(AssetRef ref) {
+	mJournal.assetChanged(ref);
+	mPartList->assetRemoved(ref);
+	mSpriteBrowser->assetRemoved(ref);
+}
+
+void MainWindow::assetMoved(AssetRef ref) {
+	mJournal.assetChanged(ref, false);
+	mPartList->assetMoved(ref);
+}
+
 void MainWindow::partRenamed(AssetRef ref, const QString& newName){
-    mPartList->updateList();
+    mJournal.assetChanged(ref, false);
+    mPartList->assetRenamed(ref);
+    mSpriteBrowser->assetRenamed(ref);
     for(PartWidget* p: mPartWidgets.values(ref)){
         p->partNameChanged(newName);
     }
@@ -713,10 +863,11 @@ void MainWindow::partRenamed(AssetRef ref, const QString& newName){
     }
 }
 
-void MainWindow::partFrameUpdated(AssetRef ref, const QString& mode, int frame){
+void MainWindow::partFrameUpdated(AssetRef ref, const QString& mode, int frame, const QRect& pixels){
+    mJournal.frameChanged(ref, mode, frame, pixels);
     if (mPartWidgets.contains(ref)){
         for(PartWidget* p: mPartWidgets.values(ref)){
-            p->partFrameUpdated(ref, mode, frame);
+            p->partFrameUpdated(ref, mode, frame, pixels);
         }
     }
 
@@ -725,9 +876,11 @@ void MainWindow::partFrameUpdated(AssetRef ref, const QString& mode, int frame){
     }
 
 	mPartList->updateIcon(ref);
+	mSpriteBrowser->spriteChanged(ref);
 }
 
 void MainWindow::partFramesUpdated(AssetRef ref, const QString& mode){
+    mJournal.assetChanged(ref);
     for(PartWidget* p: mPartWidgets.values(ref)){
         p->partFramesUpdated(ref, mode);
     }
@@ -744,9 +897,11 @@ void MainWindow::partFramesUpdated(AssetRef ref, const QString& mode){
     }
 
 	mPartList->updateIcon(ref);
+	mSpriteBrowser->spriteChanged(ref);
 }
 
 void MainWindow::partNumPivotsUpdated(AssetRef ref, const QString& mode){
+    mJournal.assetChanged(ref, false);
     for(PartWidget* p: mPartWidgets.values(ref)){
         p->partNumPivotsUpdated(ref, mode);
     }
@@ -763,6 +918,7 @@ void MainWindow::partNumPivotsUpdated(AssetRef ref, const QString& mode){
 }
 
 void MainWindow::partPropertiesUpdated(AssetRef ref){
+    mJournal.assetChanged(ref, false);
     for(PartWidget* p: mPartWidgets.values(ref)){
         p->partPropertiesChanged(ref);
     }
@@ -775,6 +931,7 @@ void MainWindow::partPropertiesUpdated(AssetRef ref){
 }
 
 void MainWindow::compPropertiesUpdated(AssetRef comp){
+    mJournal.assetChanged(comp);
     for(CompositeWidget* cw: mCompositeWidgets.values(comp)){
         cw->updateCompFrames();
     }
@@ -786,6 +943,7 @@ void MainWindow::compPropertiesUpdated(AssetRef comp){
 }
 
 void MainWindow::partModesChanged(AssetRef ref){
+    mJournal.assetChanged(ref);
     const Part* part = PM()->getPart(ref);
     for(PartWidget* p: mPartWidgets.values(ref)){
         if (!part->modes.contains(p->modeName())){
@@ -803,6 +961,8 @@ void MainWindow::partModesChanged(AssetRef ref){
 		}
 	}
 
+	mSpriteBrowser->spriteChanged(ref);
+
     // TODO: Tell composite widgets
     // for(CompositeWidget* cw: mCompositeWidgets.values()){
         // cw->partModesChanged(part);
@@ -813,6 +973,7 @@ void MainWindow::partModesChanged(AssetRef ref){
 }
 
 void MainWindow::partModeRenamed(AssetRef ref, const QString& oldModeName, const QString& newModeName){
+    mJournal.assetChanged(ref);
     for(PartWidget* p: mPartWidgets.values(ref)){
         if (p->modeName()==oldModeName){
            p->setMode(newModeName);
@@ -829,7 +990,8 @@ void MainWindow::partModeRenamed(AssetRef ref, const QString& oldModeName, const
 }
 
 void MainWindow::compositeRenamed(AssetRef ref, const QString& newName){
-    mPartList->updateList();
+    mJournal.assetChanged(ref);
+    mPartList->assetRenamed(ref);
     for(CompositeWidget* cw: mCompositeWidgets.values(ref)){
         cw->compNameChanged(ref);
     }
@@ -840,6 +1002,7 @@ void MainWindow::compositeRenamed(AssetRef ref, const QString& newName){
 }
 
 void MainWindow::compositeUpdated(AssetRef ref){
+    mJournal.assetChanged(ref);
     for(CompositeWidget* cw: mCompositeWidgets.values(ref)){
         cw->updateCompFrames();
     }
@@ -850,6 +1013,7 @@ void MainWindow::compositeUpdated(AssetRef ref){
 }
 
 void MainWindow::compositeUpdatedMinorChanges(AssetRef ref){
+    mJournal.assetChanged(ref);
     for(CompositeWidget* cw: mCompositeWidgets.values(ref)){
         cw->updateCompFramesMinorChanges();
     }
@@ -860,7 +1024,8 @@ void MainWindow::compositeUpdatedMinorChanges(AssetRef ref){
 }
 
 void MainWindow::folderRenamed(AssetRef ref, const QString& newName){
-    mPartList->updateList();
+    mJournal.assetChanged(ref);
+    mPartList->assetRenamed(ref);
     qDebug() << "TODO: Update the visual names/refs of parts and comps that are in this folder";
 }
 
@@ -953,6 +1118,8 @@ void MainWindow::resetSettings(){
 void MainWindow::newProject(){
     QMessageBox::StandardButton button = QMessageBox::question(this, "Close Project?", "Really close the current project? All unsaved changes will be lost.");
     if (button==QMessageBox::Yes){
+        waitForSave();
+
         // Close all windows and deactivate
         mCompositeToolsWidget->setTargetCompWidget(nullptr);
 		mDrawingTools->setTargetPartWidget(nullptr);
@@ -967,13 +1134,18 @@ void MainWindow::newProject(){
         ProjectModel::Instance()->clear();
 		mPartList->resetIcons();
         mPartList->updateList();
+        mSpriteBrowser->updateList();
 
+        mAutosave->discard();
+        mJournal.start(QString());
+        watchProjectFile();
         setWindowTitle(makeWindowTitle());
         qInfo() << "New Project";
     }
 }
 
 void MainWindow::loadProject(const QString& fileName){
+    waitForSave();
     mCompositeToolsWidget->setTargetCompWidget(nullptr);
 	mDrawingTools->setTargetPartWidget(nullptr);
 	mAnimationWidget->setTargetPartWidget(nullptr);
@@ -986,6 +1158,7 @@ void MainWindow::loadProject(const QString& fileName){
     ProjectModel::Instance()->clear();
 	mPartList->resetIcons();
     mPartList->updateList();
+    mSpriteBrowser->updateList();
 	
 	/*
 	QMessageBox* loadingMessage = new QMessageBox(this);
@@ -1000,6 +1173,9 @@ void MainWindow::loadProject(const QString& fileName){
 	
 	QString reason;
     bool result = ProjectModel::Instance()->load(fileName, reason);
+    mAutosave->discard();
+    mJournal.start(result ? fileName : QString());
+    watchProjectFile();
 
 	// loadingMessage->done(QDialog::Accepted);
     if (!result){
@@ -1012,10 +1188,12 @@ void MainWindow::loadProject(const QString& fileName){
 		mProjectModel->clear();
 		mPartList->resetIcons();
         mPartList->updateList();
+        mSpriteBrowser->updateList();
     }
     else {
 		mPartList->resetIcons();
         mPartList->updateList();
+        mSpriteBrowser->updateList();
 
         // Update last loaded project location
         QDir lastOpenedPath = QFileInfo(fileName).absoluteDir();
@@ -1067,6 +1245,182 @@ void MainWindow::reloadProject(){
     }
 }
 
+void MainWindow::mountLibrary(){
+    QSettings settings;
+    QString dir = settings.value("last_save_dir", QDir::currentPath()).toString();
+
+    QString fileName = QFileDialog::getOpenFileName(this, "Mount Library...", dir, "MQ Sprite File (*.mqs)");
+    if (fileName.isNull() || fileName.isEmpty()) return;
+    if (QFileInfo(fileName) == QFileInfo(PM()->fileName)){
+        QMessageBox::warning(this, "Error mounting library", tr("A project can't be a library of itself"));
+        return;
+    }
+
+    QString reason;
+    if (!PM()->mountLibrary(fileName, reason)){
+        QMessageBox::warning(this, "Error mounting library", tr("Couldn't mount ") + fileName + tr("\nReason: ") + reason);
+        return;
+    }
+
+    // The project refers to the library, so it needs saving
+    mProjectModifiedSinceLastSave = true;
+    mAutosave->projectModified();
+    setWindowTitle(makeWindowTitle(PM()->fileName, false));
+    showMessage("Mounted " + PM()->libraries().back()->name + ", its sprites can be used in composites as " + PM()->libraries().back()->name + "/<name>", 5000);
+}
+
+void MainWindow::watchProjectFile(){
+    if (!mProjectWatcher.files().isEmpty()) mProjectWatcher.removePaths(mProjectWatcher.files());
+    const QString& fileName = PM()->fileName;
+    if (!fileName.isEmpty() && QFileInfo(fileName).isFile()) mProjectWatcher.addPath(fileName);
+}
+
+void MainWindow::reloadChangedAssets(){
+    TRACE_SCOPE("MainWindow::reloadChangedAssets");
+    // NB: Some programs replace the file rather than write to it, which stops it being watched
+    watchProjectFile();
+    const QString fileName = PM()->fileName;
+    if (fileName.isEmpty() || !QFileInfo(fileName).isFile()) return;
+
+    // Our own save (see saveFinished)
+    if (mSaveTask != nullptr || !PM()->hasFileChanged()) return;
+
+    if (mProjectModifiedSinceLastSave){
+        QMessageBox::StandardButton button = QMessageBox::question(this, "Reload Changes?",
+            fileName + " was changed by another program. Reload the assets that changed? Unsaved changes to them will be lost.");
+        if (button!=QMessageBox::Yes) return;
+    }
+
+    QString reason;
+    ProjectReload changes;
+    if (!PM()->reloadChanges(reason, &changes)){
+        qWarning() << "Error while reloading " << fileName << "! Reason: " << reason;
+        showMessage("Couldn't reload " + fileName + ": " + reason, 5000);
+        return;
+    }
+    if (changes.isEmpty() && mProjectModel->importLog.isEmpty()) return;
+
+    // The undo history may refer to frames and modes that no longer exist
+    if (!changes.updated.isEmpty() || !changes.removed.isEmpty()){
+        const bool modified = mProjectModifiedSinceLastSave;
+        mUndoStack->clear();
+        mProjectModifiedSinceLastSave = modified;
+    }
+
+    // Parents before children when inserting, and children before parents when removing
+    auto foldersFirst = [](const AssetRef& a, const AssetRef& b){ return a.type == AssetType::Folder && b.type != AssetType::Folder; };
+    std::stable_sort(changes.inserted.begin(), changes.inserted.end(), foldersFirst);
+    std::stable_sort(changes.removed.begin(), changes.removed.end(), [&](const AssetRef& a, const AssetRef& b){ return foldersFirst(b, a); });
+
+    for (const AssetRef& ref: changes.removed){
+        for (PartWidget* p: mPartWidgets.values(ref)) p->close();
+        for (CompositeWidget* cw: mCompositeWidgets.values(ref)) cw->close();
+        assetRemoved(ref);
+    }
+    for (const AssetRef& ref: changes.inserted){
+        assetInserted(ref);
+    }
+    for (const AssetRef& ref: changes.updated){
+        switch (ref.type){
+        case AssetType::Part: {
+            const Part* part = PM()->getPart(ref);
+            partRenamed(ref, part->name);
+            assetMoved(ref);
+            partModesChanged(ref);
+            for (const QString& mode: part->modes.keys()) partFramesUpdated(ref, mode);
+            partPropertiesUpdated(ref);
+            break;
+        }
+        case AssetType::Composite: {
+            compositeRenamed(ref, PM()->getComposite(ref)->name);
+            assetMoved(ref);
+            compositeUpdated(ref);
+            compPropertiesUpdated(ref);
+            break;
+        }
+        case AssetType::Folder: {
+            folderRenamed(ref, PM()->getFolder(ref)->name);
+            assetMoved(ref);
+            break;
+        }
+        default: break;
+        }
+    }
+    mJournal.flush();
+
+    const int numChanges = changes.inserted.size() + changes.updated.size() + changes.removed.size();
+    showMessage(QString("Reloaded %1 changed assets from ").arg(numChanges) + QFileInfo(fileName).fileName(), 5000);
+    if (!mProjectModel->importLog.isEmpty()) {
+        QMessageBox::warning(this, "Import issues", mProjectModel->importLog.join("\n"));
+        mProjectModel->importLog.clear();
+    }
+}
+
+void MainWindow::recoverProject(){
+    // The journal has every edit up to the crash, so try it before the autosave
+    QString baseline;
+    const QString journalFileName = mJournal.fileName();
+    if (Journal::HasChanges(journalFileName, &baseline) && (baseline.isEmpty() || QFileInfo(baseline).isFile())) {
+        QMessageBox::StandardButton button = QMessageBox::question(this, "Recover Project?",
+            "MQ Sprite didn't close properly. Recover the unsaved changes to " + (baseline.isEmpty() ? QString("the untitled project") : baseline) + "?");
+        if (button==QMessageBox::Yes){
+            // NB: Loading the project starts a new journal
+            const QString replayFileName = journalFileName + ".replay";
+            QFile::remove(replayFileName);
+            QFile::rename(journalFileName, replayFileName);
+            if (!baseline.isEmpty()) {
+                loadProject(baseline);
+            }
+            else {
+                mJournal.start(QString());
+            }
+
+            QSet<AssetRef> changed;
+            const int numChanges = Journal::Replay(replayFileName, &changed);
+            QFile::remove(replayFileName);
+            for (const AssetRef& ref: changed) mJournal.assetChanged(ref);
+            mJournal.flush();
+            mAutosave->discard();
+
+            mPartList->resetIcons();
+            mPartList->updateList();
+            mSpriteBrowser->updateList();
+            PM()->fileName = baseline;
+            mProjectModifiedSinceLastSave = true;
+            mAutosave->projectModified();
+            setWindowTitle(makeWindowTitle(baseline, false));
+            showMessage(QString("Recovered %1 changes").arg(numChanges));
+            return;
+        }
+    }
+    mJournal.start(QString());
+    if (!QFile::exists(Autosave::RecoveryFileName())) return;
+
+    const QString projectName = Autosave::RecoveredProjectName();
+    QMessageBox::StandardButton button = QMessageBox::question(this, "Recover Project?",
+        "MQ Sprite didn't close properly. Open the autosaved copy of " + (projectName.isEmpty() ? QString("the untitled project") : projectName) + "?");
+    if (button!=QMessageBox::Yes){
+        mAutosave->discard();
+        return;
+    }
+
+    QSettings settings;
+    const QVariant lastSaveDir = settings.value("last_save_dir");
+    loadProject(Autosave::RecoveryFileName());
+    settings.setValue("last_save_dir", lastSaveDir);
+
+    // NB: The recovery file is gone, so the journal starts again at the next save
+    mJournal.discard();
+
+    // Saving goes back to the original project, and the recovered changes are still unsaved
+    PM()->fileName = projectName;
+    if (!projectName.isEmpty()) PM()->readFileState(projectName);
+    watchProjectFile();
+    mProjectModifiedSinceLastSave = true;
+    mAutosave->projectModified();
+    setWindowTitle(makeWindowTitle(projectName, false));
+}
+
 void MainWindow::saveProject(){    
     QString fileName = ProjectModel::Instance()->fileName;
 
@@ -1074,23 +1428,7 @@ void MainWindow::saveProject(){
         saveProjectAs();
     }
     else {
-        bool result = ProjectModel::Instance()->save(fileName);
-        if (!result){
-			qWarning() << "Error during save";
-			qWarning() << mProjectModel->exportLog.join("\n");
-            QMessageBox::warning(this, "Error during save", tr("Couldn't save ") + fileName + "!\n" + mProjectModel->exportLog.mid(0, 10).join("\n"));
-        }
-        else {
-            mProjectModifiedSinceLastSave = false;
-			setWindowTitle(makeWindowTitle(fileName, true));
-            MainWindow::Instance()->showMessage("Successfully saved");
-
-			if (!mProjectModel->exportLog.isEmpty()) {
-				qWarning() << "Error during save";
-				qWarning() << mProjectModel->exportLog.join("\n");
-				QMessageBox::warning(this, "Export issues", mProjectModel->exportLog.mid(0, 10).join("\n"));
-			}
-        }
+        startSave(fileName);
     }
 }
 
@@ -1106,36 +1444,124 @@ void MainWindow::saveProjectAs(){
         fileName = saveDialog.selectedFiles().first();
     }
     if (!fileName.isNull()){
-        bool result = ProjectModel::Instance()->save(fileName);
-        if (!result){
-			qWarning() << "Error during save";
-			qWarning() << mProjectModel->exportLog.join("\n");
-			QMessageBox::warning(this, "Error during save", tr("Couldn't save ") + fileName + "!\n" + mProjectModel->exportLog.mid(0, 10).join("\n"));
-        }
-        else {
-            // Update last saved project location
-            QDir lastOpenedPath = QFileInfo(fileName).absoluteDir();
-            settings.setValue("last_save_dir", lastOpenedPath.absolutePath());
+        startSave(fileName);
+    }
+}
 
-            mProjectModifiedSinceLastSave = false;
-			setWindowTitle(makeWindowTitle(fileName, true));
-            MainWindow::Instance()->showMessage("Successfully saved");
+void MainWindow::startSave(const QString& fileName){
+    if (mSaveTask != nullptr){
+        showMessage("Already saving " + mSaveTask->fileName());
+        return;
+    }
+
+    // Edits made from now on are not in this save, and mark the project as modified again
+    mProjectModifiedSinceLastSave = false;
+
+    mJournal.flush();
+    mSaveJournalPosition = mJournal.position();
+    mSaveTask = new SaveTask(PM()->snapshot(), fileName);
+    const int generation = ++mSaveGeneration;
+    connect(mSaveTask, &SaveTask::progress, mSaveProgress, &QProgressBar::setValue, Qt::QueuedConnection);
+    connect(mSaveTask, &SaveTask::finished, this, [this, generation](){
+        if (generation == mSaveGeneration && mSaveTask != nullptr) saveFinished();
+    }, Qt::QueuedConnection);
+    mSaveProgress->setValue(0);
+    mSaveProgress->show();
+    statusBar()->showMessage("Saving " + fileName + "...");
+    mSavePool.start(mSaveTask);
+}
+
+void MainWindow::waitForSave(){
+    if (mSaveTask == nullptr) return;
+    mSavePool.waitForDone();
+    saveFinished();
+}
 
+void MainWindow::saveFinished(){
+    SaveTask* task = mSaveTask;
+    mSaveTask = nullptr;
+    task->deleteLater();
+    mSaveProgress->hide();
+    statusBar()->clearMessage();
+
+    const QString& fileName = task->fileName();
+    if (!task->success()){
+        mProjectModifiedSinceLastSave = true;
+        setWindowTitle(makeWindowTitle(PM()->fileName, false));
+        qWarning() << "Error during save";
+        qWarning() << task->log().join("\n");
+        QMessageBox::warning(this, "Error during save", tr("Couldn't save ") + fileName + "!\n" + task->log().mid(0, 10).join("\n"));
+        return;
+    }
+
+    PM()->fileName = fileName;
+    PM()->readFileState(fileName);
+    watchProjectFile();
+
+    // Only the edits made during the save are needed to recover from here on
+    if (mJournal.isOpen()){
+        mJournal.rebase(fileName, mSaveJournalPosition);
+    }
+    else {
+        mJournal.start(fileName);
+    }
+
+    // Update last saved project location
+    QSettings settings;
+    QDir lastOpenedPath = QFileInfo(fileName).absoluteDir();
+    settings.setValue("last_save_dir", lastOpenedPath.absolutePath());
+
+    if (!mProjectModifiedSinceLastSave){
+        mAutosave->discard();
+    }
+    setWindowTitle(makeWindowTitle(fileName, !mProjectModifiedSinceLastSave));
+    MainWindow::Instance()->showMessage("Successfully saved");
+
+    if (!task->log().isEmpty()) {
+        qWarning() << "Error during save";
+        qWarning() << task->log().join("\n");
+        QMessageBox::warning(this, "Export issues", task->log().mid(0, 10).join("\n"));
+    }
+}
+
+void MainWindow::exportProjectAs() {
+	QSettings settings;
+	QString dir = settings.value("last_export_dir", QDir::currentPath()).toString();
+	QString dirName = QFileDialog::getExistingDirectory(this, "Export To...", dir);
+	if (!dirName.isNull()) {
+		bool result = ProjectModel::Instance()->exportSimple(dirName, GlobalPreferences().trimOnExport);
+		if (!result) {
+			qWarning() << "Error during export";
+			qWarning() << mProjectModel->exportLog.join("\n");
+			QMessageBox::warning(this, "Error during export", tr("Couldn't export to ") + dirName + "!\n" + mProjectModel->exportLog.mid(0, 10).join("\n"));
+		}
+		else {
+			settings.setValue("last_export_dir", QDir(dirName).absolutePath());
+			MainWindow::Instance()->showMessage("Successfully exported");
 			if (!mProjectModel->exportLog.isEmpty()) {
-				qWarning() << "Error during save";
+				qWarning() << "Error during export";
 				qWarning() << mProjectModel->exportLog.join("\n");
 				QMessageBox::warning(this, "Export issues", mProjectModel->exportLog.mid(0, 10).join("\n"));
 			}
-        }
-    }
+		}
+	}
 }
 
-void MainWindow::exportProjectAs() {
+void MainWindow::exportAtlasAs() {
 	QSettings settings;
 	QString dir = settings.value("last_export_dir", QDir::currentPath()).toString();
-	QString dirName = QFileDialog::getExistingDirectory(this, "Export To...", dir);
+	QString dirName = QFileDialog::getExistingDirectory(this, "Export Atlas To...", dir);
 	if (!dirName.isNull()) {
-		bool result = ProjectModel::Instance()->exportSimple(dirName);
+		AtlasSettings atlasSettings;
+		atlasSettings.maxPageSize = settings.value("atlas_page_size", atlasSettings.maxPageSize).toInt();
+		atlasSettings.maxPages = settings.value("atlas_max_pages", atlasSettings.maxPages).toInt();
+		atlasSettings.padding = settings.value("atlas_padding", atlasSettings.padding).toInt();
+		atlasSettings.trim = GlobalPreferences().trimOnExport;
+
+		mProjectModel->exportLog.clear();
+		QApplication::setOverrideCursor(Qt::WaitCursor);
+		bool result = ProjectModel::Instance()->exportAtlas(dirName, atlasSettings);
+		QApplication::restoreOverrideCursor();
 		if (!result) {
 			qWarning() << "Error during export";
 			qWarning() << mProjectModel->exportLog.join("\n");
@@ -1153,7 +1579,51 @@ void MainWindow::exportProjectAs() {
 	}
 }
 
+void MainWindow::bakeActiveComposite(bool toPngSequence){
+	CompositeWidget* cw = activeCompositeWidget();
+	Composite* comp = cw ? PM()->getComposite(cw->compRef()) : nullptr;
+	if (comp == nullptr) return;
+
+	// Bake what is currently being previewed
+	BakeSettings bakeSettings;
+	for (const QString& child : comp->children) {
+		bakeSettings.childModes.insert(child, cw->modeForCurrentSet(child));
+		bakeSettings.childLoops.insert(child, cw->loopForCurrentSet(child));
+		bakeSettings.childVisible.insert(child, cw->visibleForCurrentSet(child));
+	}
+
+	QStringList log;
+	if (!toPngSequence) {
+		if (!TryCommand(new CBakeComposite(cw->compRef(), bakeSettings, &log))) {
+			QMessageBox::warning(this, "Error during bake", tr("Couldn't bake ") + comp->name + "!\n" + log.mid(0, 10).join("\n"));
+		}
+		return;
+	}
+
+	QSettings settings;
+	QString dir = settings.value("last_export_dir", QDir::currentPath()).toString();
+	QString dirName = QFileDialog::getExistingDirectory(this, "Bake To...", dir);
+	if (dirName.isNull()) return;
+
+	BakedComposite baked;
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	bool result = BakeComposite(*comp, bakeSettings, &baked, &log) && ExportBakedComposite(baked, dirName, comp->name, &log);
+	QApplication::restoreOverrideCursor();
+	if (!result) {
+		qWarning() << "Error during bake";
+		qWarning() << log.join("\n");
+		QMessageBox::warning(this, "Error during bake", tr("Couldn't bake ") + comp->name + "!\n" + log.mid(0, 10).join("\n"));
+	}
+	else {
+		settings.setValue("last_export_dir", QDir(dirName).absolutePath());
+		showMessage(QString("Baked %1 frames").arg(baked.frames.size()));
+	}
+}
+
 void MainWindow::undoStackIndexChanged(int){
+    // NB: The command has notified us of everything it changed by now
+    mJournal.flush();
     mProjectModifiedSinceLastSave = true;
+    mAutosave->projectModified();
 	setWindowTitle(makeWindowTitle(PM()->fileName, false));
 }
@@ -7,22 +7,32 @@
 #include <QUndoStack>
 #include <QMdiArea>
 #include <QStackedWidget>
+#include <QThreadPool>
+#include <QFileSystemWatcher>
+#include <QTimer>
 
 #include "projectmodel.h"
+#include "commands.h"
 #include "partwidget.h"
 #include "compositewidget.h"
 #include "partlist.h"
+#include "journal.h"
 
 class CompositeToolsWidget;
 class DrawingTools;
 class PropertiesWidget;
 class AnimationWidget;
+class ProjectStatsWidget;
+class SpriteBrowser;
+class Autosave;
+class SaveTask;
+class QProgressBar;
 
 namespace Ui {
 class MainWindow;
 }
 
-class MainWindow : public QMainWindow
+class MainWindow : public QMainWindow, public ProjectListener
 {
     Q_OBJECT
     
@@ -39,9 +49,12 @@ public:
     // Notifications from commands that something has changed in the project
     void partListChanged();
 	void newAssetCreated(AssetRef ref);
+	void assetInserted(AssetRef ref);
+	void assetRemoved(AssetRef ref);
+	void assetMoved(AssetRef ref);
 
     void partRenamed(AssetRef ref, const QString& newName);
-    void partFrameUpdated(AssetRef ref, const QString& mode, int frame);
+    void partFrameUpdated(AssetRef ref, const QString& mode, int frame, const QRect& pixels);
     void partFramesUpdated(AssetRef ref, const QString& mode);
     void partNumPivotsUpdated(AssetRef ref, const QString& mode);
     void partPropertiesUpdated(AssetRef ref);
@@ -60,6 +73,8 @@ public:
 
 protected:
     void closeEvent(QCloseEvent* event);
+    void saveFinished();
+    void watchProjectFile();
 	void loadPreferences();
 	void savePreferences();
 	void updatePreferences();
@@ -86,6 +101,7 @@ public slots:
     void setDropShadowYOffset(int);
     void changeDropShadowColour();
     void setOnionSkinningTransparency(int);
+    void bakeActiveComposite(bool toPngSequence);
 
     void showAbout();
     void resetSettings();
@@ -94,9 +110,15 @@ public slots:
     void loadProject(const QString& fileName);
     void loadProject();
     void reloadProject();
+    void reloadChangedAssets(); // Re-reads only the assets that another program changed in the project file
+    void mountLibrary(); // Lets composites use the sprites of another project (see Library)
+    void recoverProject(); // Recover the unsaved changes of the last session (see Journal and Autosave)
     void saveProject();
     void saveProjectAs();
+    void startSave(const QString& fileName); // Saves in the background
+    void waitForSave(); // Finishes a save in progress (e.g., before the project is replaced)
 	void exportProjectAs();
+	void exportAtlasAs();
 
     void undoStackIndexChanged(int);
 
@@ -109,6 +131,17 @@ private:
 	DrawingTools* mDrawingTools = nullptr;
 	PropertiesWidget* mPropertiesWidget = nullptr;
 	AnimationWidget* mAnimationWidget = nullptr;
+	ProjectStatsWidget* mProjectStatsWidget = nullptr;
+	SpriteBrowser* mSpriteBrowser = nullptr;
+	Autosave* mAutosave = nullptr;
+	SaveTask* mSaveTask = nullptr; // The save in progress
+	qint64 mSaveJournalPosition = 0; // The journal up to here is in the save in progress
+	Journal mJournal;
+	int mSaveGeneration = 0;
+	QThreadPool mSavePool;
+	QProgressBar* mSaveProgress = nullptr;
+	QFileSystemWatcher mProjectWatcher;
+	QTimer mReloadTimer; // Waits for the other program to finish writing
     QDockWidget *mViewOptionsDockWidget = nullptr;
     QMultiMap<AssetRef,PartWidget*> mPartWidgets;
     QMultiMap<AssetRef,CompositeWidget*> mCompositeWidgets;
@@ -128,6 +161,8 @@ private:
 	QAction* mCompositeToolsWindowAction = nullptr;
 
 	QAction* mResizePartAction = nullptr;
+	QAction* mBakeCompositeAction = nullptr;
+	QAction* mBakeCompositeToPngAction = nullptr;
 	QAction* mDuplicateAssetAction = nullptr;
 
     bool mProjectModifiedSinceLastSave = false;
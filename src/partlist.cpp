@@ -36,10 +36,24 @@ void PartList::updateIcon(AssetRef ref) {
 	mAssetTreeWidget->updateIcon(ref);
 }
 
+void PartList::assetInserted(AssetRef ref) {
+	mAssetTreeWidget->assetInserted(ref);
+}
+
+void PartList::assetRemoved(AssetRef ref) {
+	mAssetTreeWidget->assetRemoved(ref);
+}
+
+void PartList::assetMoved(AssetRef ref) {
+	mAssetTreeWidget->assetMoved(ref);
+}
+
+void PartList::assetRenamed(AssetRef ref) {
+	mAssetTreeWidget->assetRenamed(ref);
+}
+
 void PartList::deselectAsset() {
-	for (auto* item : mAssetTreeWidget->selectedItems()) {
-		mAssetTreeWidget->setItemSelected(item, false);
-	}
+	mAssetTreeWidget->clearSelection();
 }
 
 void PartList::selectAsset(AssetRef ref) {
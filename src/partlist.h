@@ -21,6 +21,10 @@ public:
 	void deselectAsset();
 	void selectAsset(AssetRef ref);
 	void updateIcon(AssetRef ref);
+	void assetInserted(AssetRef ref);
+	void assetRemoved(AssetRef ref);
+	void assetMoved(AssetRef ref);
+	void assetRenamed(AssetRef ref);
 
 signals:
     void assetDoubleClicked(AssetRef ref);
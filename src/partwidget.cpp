@@ -1,8 +1,12 @@
 #include "partwidget.h"
 
+#include "animationclock.h"
 #include "commands.h"
+#include "dropshadow.h"
+#include "imageops.h"
 #include "mainwindow.h"
 #include "spritezoomwidget.h"
+#include "trace.h"
 
 #include <cmath>
 #include <QUndoStack>
@@ -13,9 +17,7 @@
 #include <QDebug>
 #include <QRgb>
 #include <QMdiSubWindow>
-#include <QGraphicsDropShadowEffect>
 #include <QSlider>
-#include <QTimer>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
@@ -23,7 +25,6 @@
 #include <QClipboard>
 #include <QMimeData>
 #include <QBuffer>
-#include <QQueue>
 #include <QToolButton>
 
 PartWidget::PartWidget(AssetRef ref, QWidget *parent) :
@@ -33,22 +34,23 @@ PartWidget::PartWidget(AssetRef ref, QWidget *parent) :
     mModeName("icon"),
     mPart(nullptr),
     mPartView(nullptr),
-    mOverlayPixmapItem(nullptr),
+    mCanvasItem(nullptr),
     mZoom(4),
     mViewportCenter(0,0),
     mPenSize(1),
     mPenColour(QColor(0,0,0)),
     mDrawToolType(kDrawToolPaint),
-    mAnimationTimer(nullptr),
     mFrameNumber(0),
     mSecondsPassedSinceLastFrame(0),
     mIsPlaying(false),
-    mBoundsItem(nullptr),
+    mShownFrame(-1),
+    mOnionSkinItem(nullptr),
     mScribbling(false),
     mMovingCanvas(false),
     mPlaybackSpeedMultiplierIndex(-1),
     mPlaybackSpeedMultiplier(1),
-    mOverlayImage(nullptr),
+    mOnionSkinningOpacity(0),
+    mShadowEnabled(false),
     mClipboardItem(nullptr),
     mCopyRectItem(nullptr)
 {
@@ -85,19 +87,14 @@ PartWidget::PartWidget(AssetRef ref, QWidget *parent) :
 }
 
 void PartWidget::buildScene(){
-    if (!mPixmapItems.isEmpty()){
-        for(QGraphicsPixmapItem* pi: mPixmapItems){
-            mPartView->scene()->removeItem(pi);
-            delete pi;
-        }
-        mPixmapItems.clear();
-    }
+    TRACE_SCOPE("PartWidget::buildScene");
+    mFrames.clear();
+    mShadowItems.clear(); // NB: Deleted by scene()->clear() below
+    mShownFrame = -1;
+    mOnionSkinItem = nullptr; // NB: Deleted by scene()->clear() below
+    mOnionSkinCache.clear();
 
-    if (mOverlayPixmapItem != nullptr){
-        mPartView->scene()->removeItem(mOverlayPixmapItem);
-        delete mOverlayPixmapItem;
-        mOverlayPixmapItem = nullptr;
-    }
+    mCanvasItem = nullptr; // NB: Deleted by scene()->clear() below
 
     // get rid of any remaining text etc
     mAnchorItems.clear();
@@ -125,16 +122,12 @@ void PartWidget::buildScene(){
         mCopyRectItem = nullptr;
     }
 
-    mPartView->scene()->clear();	
-	mPartView->resetCachedContent();
-
-    mBoundsItem = nullptr;
+    mPartView->scene()->clear();
 	bool triggerFitToWindow = false;
 
     if (PM()->hasPart(mPartRef)){
         mPart = PM()->getPart(mPartRef);
         mPartName = mPart->name;
-        mProperties = "{" + mPart->properties + "}";
 
         if (mPart->modes.size() > 0){
             if (mModeName.isEmpty() || !mPart->modes.contains(mModeName)){
@@ -145,7 +138,7 @@ void PartWidget::buildScene(){
 
             mNumPivots = m.numPivots;            
             mFPS = m.framesPerSecond;
-            mSPF = 1./mFPS;
+            mSPF = mFPS > 0 ? 1./mFPS : 0; // NB: A loaded file can have 0 fps
 
             const int w = mPart->modes.value(mModeName).width;
 			const int h = mPart->modes.value(mModeName).height;
@@ -153,22 +146,35 @@ void PartWidget::buildScene(){
 
 			const int strokeAlpha = 255;
 			mBoundsColour = mBackgroundColour.lightnessF() > 0.5 ? QColor(0, 0, 0, strokeAlpha) : QColor(255, 255, 255, strokeAlpha);
-            const float boundsPenWidth = 0.05f;
-			mBoundsItem = mPartView->scene()->addRect(-boundsPenWidth/2, -boundsPenWidth/2, w+boundsPenWidth, h+boundsPenWidth, QPen(mBoundsColour, boundsPenWidth, Qt::SolidLine, Qt::SquareCap, Qt::MiterJoin), Qt::NoBrush);
 			
+			const DropShadow shadow = DropShadowFromPreferences();
 			for(int i=0;i<m.numFrames;i++){
                 auto pImg = m.frames.at(i);
                 if (pImg){
-                    auto* pi = mPartView->scene()->addPixmap(QPixmap::fromImage(*pImg));					
-                    pi->setGraphicsEffect(new QGraphicsDropShadowEffect());
-                    mPixmapItems.push_back(pi);
+                    mFrames.push_back(pImg);
+                    auto* si = AddDropShadowItem(nullptr, *pImg, shadow);
+                    mPartView->scene()->addItem(si);
+                    si->hide();
+                    mShadowItems.push_back(si);
                 }      
             }
+            mOnionSkinCache.resize(mFrames.size());
+            mOnionSkinItem = mPartView->scene()->addPixmap(QPixmap());
+            mOnionSkinItem->setZValue(-1);
+            mOnionSkinItem->hide();
 
-            if (mOverlayImage!=nullptr) delete mOverlayImage;
-            mOverlayImage = new QImage(w, h, QImage::Format_ARGB32);
+            mOverlayImage = QSharedPointer<QImage>::create(w, h, QImage::Format_ARGB32);
             mOverlayImage->fill(0x00FFFFFF);
-            mOverlayPixmapItem = mPartView->scene()->addPixmap(QPixmap::fromImage(*mOverlayImage));
+            mStrokeBounds = QRect();
+
+            // NB: Above the shadows, the frame is set in showFrame
+            mCanvasItem = new PixelCanvasItem(QSize(w, h));
+            mCanvasItem->setOverlay(mOverlayImage);
+            mCanvasItem->setBoundsColour(mBoundsColour);
+            QColor gridColour = mBoundsColour;
+            gridColour.setAlpha(48);
+            mCanvasItem->setGridColour(gridColour);
+            mPartView->scene()->addItem(mCanvasItem);
 			
 			QFont font("monospace");
             QPen pivotPen = QPen(mPropertiesColour, 0.1);
@@ -211,6 +217,7 @@ void PartWidget::buildScene(){
 						list.push_back(label);
 					}
 
+					for (auto* it : list) it->hide();
 					mAnchorItems.push_back(list);
                 }
 
@@ -249,6 +256,7 @@ void PartWidget::buildScene(){
 						list.push_back(label);
 					}
 
+					for (auto* it : list) it->hide();
 					mPivotItems[p].push_back(list);
                 }
             }
@@ -277,9 +285,18 @@ void PartWidget::buildScene(){
 
     mFrameNumber = std::min(mFrameNumber, numFrames() - 1);
     setFrame(mFrameNumber);
+    if (mIsPlaying) AnimationClock::Instance()->wake(this); // fps may have changed
 
-	// auto sceneRect = mPartView->scene()->sceneRect();
-	auto sceneRect = mPartView->scene()->itemsBoundingRect();
+	// NB: Only the canvas and the pivots, rather than the bounds of every item in the scene
+	QRectF sceneRect;
+	if (mCanvasItem) {
+		QRect bounds = mCanvasItem->canvasRect();
+		for (const QPoint& ap : mAnchors) bounds |= QRect(ap, QSize(1, 1));
+		for (int p = 0; p < Part::MaxPivots; p++) {
+			for (const QPoint& pp : mPivots[p]) bounds |= QRect(pp, QSize(1, 1));
+		}
+		sceneRect = bounds;
+	}
 	const float boundsPadding = (0.125f / 2) * std::max(sceneRect.width(), sceneRect.height());
 	sceneRect.adjust(-boundsPadding, -boundsPadding, boundsPadding, boundsPadding);
 	mPartView->setSceneRect(sceneRect);
@@ -299,6 +316,7 @@ void PartWidget::buildScene(){
 		QPen debugPen1(QColor(255, 0, 255), 0.2);
 		mPartView->scene()->addRect(mPartView->sceneRect(), debugPen1, Qt::NoBrush);
 	}
+	mPartView->stats().sceneChanged(mPartView->scene());
 }
 
 void PartWidget::setFrame(int f){
@@ -313,6 +331,7 @@ void PartWidget::setFrame(int f){
 void PartWidget::setPlaybackSpeedMultiplier(int index, float value){
     mPlaybackSpeedMultiplierIndex = index;
     mPlaybackSpeedMultiplier = value;
+    if (mIsPlaying) AnimationClock::Instance()->wake(this);
 }
 
 void PartWidget::setDrawToolType(DrawToolType type){
@@ -375,6 +394,8 @@ void PartWidget::setDrawToolType(DrawToolType type){
             break;
         }
     }
+    updatePenCursor();
+    mPartView->stats().sceneChanged(mPartView->scene());
 }
 
 void PartWidget::setMode(const QString& mode){	
@@ -394,9 +415,24 @@ void PartWidget::partNameChanged(const QString& newPartName){
 	}
 }
 
-void PartWidget::partFrameUpdated(AssetRef part, const QString& mode, int /*frame*/){
+void PartWidget::partFrameUpdated(AssetRef part, const QString& mode, int frame, const QRect& pixels){
     if (part==mPartRef && mModeName==mode){
-        buildScene();
+        // A stroke only needs its pixels redrawn, anything else rebuilds the scene
+        const Part* p = PM()->getPart(mPartRef);
+        const bool sameFrame = p && p->modes.contains(mode) && frame >= 0 && frame < mFrames.size()
+                && frame < p->modes[mode].frames.size() && p->modes[mode].frames.at(frame) == mFrames.at(frame);
+        if (pixels.isEmpty() || !sameFrame){
+            buildScene();
+            return;
+        }
+
+        TRACE_SCOPE("PartWidget::partFrameUpdated");
+        if (frame == mShownFrame && mCanvasItem) mCanvasItem->frameChanged(pixels);
+        if (frame < mShadowItems.size()){
+            UpdateDropShadowItem(mShadowItems.at(frame), *mFrames.at(frame), DropShadowFromPreferences());
+        }
+        mOnionSkinCache.fill(QPixmap());
+        showFrame(mFrameNumber);
     }
 }
 
@@ -425,9 +461,9 @@ void PartWidget::updatePropertiesOverlays(){
     }
 	mPropertyItems.clear();
 
-    QJsonParseError error;
-    QJsonDocument propDoc = QJsonDocument::fromJson(mProperties.toUtf8(), &error);
-    if (error.error != QJsonParseError::NoError || propDoc.isNull() || propDoc.isEmpty() || !propDoc.isObject()){
+    Part* part = PM()->getPart(mPartRef);
+    const PropertiesCache* props = part ? &ParseProperties(part) : nullptr;
+    if (props == nullptr || !props->error.isEmpty() || props->object.isEmpty()){
         // couldn't parse.. (or not object)
     }
     else {
@@ -444,7 +480,7 @@ void PartWidget::updatePropertiesOverlays(){
 		// font.setHintingPreference(QFont::PreferFullHinting);
 
         int index = 0;
-        QJsonObject propObj = propDoc.object();
+        const QJsonObject& propObj = props->object;
 		bool validMode = true;
 		
 		// Filter rects by valid modes
@@ -531,13 +567,12 @@ void PartWidget::updatePropertiesOverlays(){
 		mPropertyItems.append(mPartView->scene()->addRect(bounds, Qt::NoPen, QColor(0, 0, 0, 64)));
 	}
 	*/
+	mPartView->stats().sceneChanged(mPartView->scene());
 }
 
 void PartWidget::partPropertiesChanged(AssetRef part){
     if (part==mPartRef){
         // update ..
-        Part* part = PM()->getPart(mPartRef);
-        mProperties = "{" + part->properties + "}";
         updatePropertiesOverlays();
         showFrame(mFrameNumber);
     }
@@ -558,22 +593,35 @@ void PartWidget::focusInEvent(QFocusEvent *focusInEvent) {
 	mPartView->setFocus();
 }
 
-void PartWidget::updateOverlay(){
-    if (mOverlayPixmapItem){
-        mOverlayPixmapItem->setPixmap(QPixmap::fromImage(*mOverlayImage));
+void PartWidget::updateOverlay(const QRect& rect){
+    if (mCanvasItem){
+        mCanvasItem->overlayChanged(rect);
     }
 }
 
+void PartWidget::clearOverlay(){
+    // NB: Only the tiles of the stroke
+    if (mOverlayImage && !mStrokeBounds.isEmpty()){
+        QPainter painter(mOverlayImage.data());
+        painter.setCompositionMode(QPainter::CompositionMode_Clear);
+        painter.fillRect(mStrokeBounds, Qt::transparent);
+        painter.end();
+        updateOverlay(mStrokeBounds);
+    }
+    mStrokeBounds = QRect();
+}
+
 void PartWidget::setZoom(int z){
     mZoom = z;
 	QTransform tr = QTransform::fromScale(mZoom, mZoom);
     mPartView->setTransform(tr);
-    updateDropShadow();
     mPartView->update();
+    updatePenCursor();
 }
 
 void PartWidget::setPenSize(int size){
     mPenSize = size;
+    updatePenCursor();
 	// Update
 	emit(penChanged());
 }
@@ -589,7 +637,7 @@ void PartWidget::fitToWindow(){
 			mPartView->fitInView(mPart->modes[mModeName].bounds.adjusted(-boundsPadding, -boundsPadding, boundsPadding, boundsPadding), Qt::KeepAspectRatio);
 		}
 		else {
-			mPartView->fitInView(mBoundsItem, Qt::KeepAspectRatio);
+			mPartView->fitInView(mCanvasItem ? QRectF(mCanvasItem->canvasRect()) : QRectF(), Qt::KeepAspectRatio);
 		}
         QTransform transform = mPartView->transform();
         QPoint scale = transform.map(QPoint(1,1));
@@ -602,25 +650,21 @@ void PartWidget::fitToWindow(){
 }
 
 void PartWidget::updateDropShadow(){
-	const auto& prefs = GlobalPreferences();
-    float opacity = prefs.showDropShadow ? prefs.dropShadowOpacity : 0.0f;
-    float blur = prefs.dropShadowBlurRadius;
-    float dx = prefs.dropShadowOffsetH;
-	float dy = prefs.dropShadowOffsetV;
-	QColor dropShadowColour = prefs.dropShadowColour;
-	dropShadowColour.setAlphaF(opacity);
-
-    if (mPartView){		
-        for(auto* it: mPixmapItems){
-            auto* effect = (QGraphicsDropShadowEffect*) it->graphicsEffect();
-			if (effect) {
-				effect->setOffset(dx * mZoom, dy * mZoom);
-				effect->setColor(dropShadowColour);
-				effect->setBlurRadius(blur * mZoom);
+    if (mPartView){
+		// NB: Shadows are cached, so this only re-renders if the preferences or frames changed
+		const DropShadow shadow = DropShadowFromPreferences();
+		mShadowEnabled = shadow.isVisible();
+		if (mPart && mPart->modes.contains(mModeName)){
+			const auto& m = mPart->modes[mModeName];
+			int index = 0;
+			for (auto pImg : m.frames) {
+				if (pImg && index < mShadowItems.size()) {
+					UpdateDropShadowItem(mShadowItems.at(index++), *pImg, shadow);
+				}
 			}
-        }
+		}
 		
-		showFrame(mFrameNumber); // To re-enable drop shadow
+		showFrame(mFrameNumber);
     }
 }
 
@@ -628,7 +672,10 @@ void PartWidget::updateOnionSkinning(){
 	const auto& prefs = GlobalPreferences();
     if (mPartView){
 		mOnionSkinningEnabled = prefs.showOnionSkinning;
-		mOnionSkinningOpacity = prefs.onionSkinningOpacity;
+		if (mOnionSkinningOpacity != prefs.onionSkinningOpacity) {
+			mOnionSkinningOpacity = prefs.onionSkinningOpacity;
+			mOnionSkinCache.fill(QPixmap());
+		}
         mOnionSkinningEnabledDuringPlayback = false;
         showFrame(mFrameNumber);
     }
@@ -645,47 +692,44 @@ void PartWidget::updatePivots(){
     }
 }
 
-static float S_PER_UPDATE = 1.f/60;
 void PartWidget::play(bool play){
     if (!play){
         mIsPlaying = false;
-        if (mAnimationTimer){
-            mAnimationTimer->stop();
-        }
+        AnimationClock::Instance()->stop(this);
     }
     else {
-        if (mAnimationTimer==nullptr){
-            mAnimationTimer=new QTimer(this);
-            connect(mAnimationTimer, SIGNAL(timeout()), this, SLOT(updateAnimation()));
-        }
         mSecondsPassedSinceLastFrame = 0;
-        mAnimationTimer->start(S_PER_UPDATE*1000);
+        AnimationClock::Instance()->start(this, [this](double seconds){ return updateAnimation(seconds); });
         mIsPlaying = true;
     }
 }
 
 void PartWidget::stop(){
     mIsPlaying = false;
-    if (mAnimationTimer){
-        mAnimationTimer->stop();
-        mFrameNumber = 0;
-        showFrame(mFrameNumber);
-        emit(frameChanged(mFrameNumber));
-    }
+    AnimationClock::Instance()->stop(this);
+    mFrameNumber = 0;
+    showFrame(mFrameNumber);
+    emit(frameChanged(mFrameNumber));
 }
 
-void PartWidget::updateAnimation(){
-    mSecondsPassedSinceLastFrame += mPlaybackSpeedMultiplier*S_PER_UPDATE;
+double PartWidget::updateAnimation(double seconds){
+    TRACE_SCOPE("PartWidget::updateAnimation");
+    if (mFrames.isEmpty() || mPlaybackSpeedMultiplier <= 0 || mFPS <= 0) return -1;
+
+    mSecondsPassedSinceLastFrame += mPlaybackSpeedMultiplier*seconds;
     bool updated = false;
     while (mSecondsPassedSinceLastFrame > mSPF){
         updated = true;
         mSecondsPassedSinceLastFrame -= mSPF;
-        mFrameNumber = (mFrameNumber+1)%mPixmapItems.size();
+        mFrameNumber = (mFrameNumber+1)%mFrames.size();
     }
     if (updated){
         showFrame(mFrameNumber);
         emit(frameChanged(mFrameNumber));
     }
+    const double next = (mSPF - mSecondsPassedSinceLastFrame)/mPlaybackSpeedMultiplier;
+    mPartView->stats().animationTick(seconds, next);
+    return next;
 }
 
 void PartWidget::partViewMousePressEvent(QMouseEvent *event){
@@ -697,8 +741,7 @@ void PartWidget::partViewMousePressEvent(QMouseEvent *event){
     if (mScribbling && right && (mDrawToolType==kDrawToolPaint || mDrawToolType==kDrawToolEraser)){
         mScribbling = false;
         // Cancel        
-        mOverlayImage->fill(0x00FFFFFF);
-        updateOverlay();
+        clearOverlay();
     }
     else if (left && mDrawToolType==kDrawToolPaint){
         drawLineTo(mLastPoint);
@@ -718,6 +761,7 @@ void PartWidget::partViewMousePressEvent(QMouseEvent *event){
         QPen pen = QPen(QColor(255,0,255), 0.1, Qt::DashLine);
         QBrush brush = Qt::NoBrush;
         mCopyRectItem = mPartView->scene()->addRect(floor(pt.x()),floor(pt.y()),1,1,pen,brush);
+        mPartView->stats().sceneChanged(mPartView->scene());
     }
     else if (left && mDrawToolType==kDrawToolFill){
         QPointF pt = mPartView->mapToScene(event->pos().x(),event->pos().y());
@@ -727,30 +771,11 @@ void PartWidget::partViewMousePressEvent(QMouseEvent *event){
         const auto img = mPart->modes[mModeName].frames.at(mFrameNumber);
 
         if (pi.x()>=0 && pi.x()<img->width() && pi.y()>=0 && pi.y()<img->height()){
-            QImage fillPattern = img->copy(); // (QSize(img->width(),img->height()), QImage::Format_ARGB32);
-            // fillPattern.fill(0x00000000);
-
-            QRgb targetColour = fillPattern.pixel(pi.x(),pi.y());
+            QRgb targetColour = img->pixel(pi.x(),pi.y());
             QRgb replacementColour = mPenColour.rgba();
 
             if (targetColour!=replacementColour){
-                QQueue<QPoint> q;
-                q.enqueue(pi);
-                while(!q.isEmpty()){
-                    QPoint p = q.dequeue();
-                   //  qDebug() << p;
-                    if (p.x()>=0 && p.x()<fillPattern.width() && p.y()>=0 && p.y()<fillPattern.height()){
-                        QRgb c = fillPattern.pixel(p);
-                        if (c==targetColour){
-                            fillPattern.setPixel(p, replacementColour);
-                            q.enqueue(QPoint(p.x()+1,p.y()));
-                            q.enqueue(QPoint(p.x()-1,p.y()));
-                            q.enqueue(QPoint(p.x(),p.y()+1));
-                            q.enqueue(QPoint(p.x(),p.y()-1));
-                        }
-                    }
-                }
-
+                QImage fillPattern = FloodFill(*img, pi, replacementColour);
                 TryCommand(new CDrawOnPart(mPartRef, mModeName, mFrameNumber, fillPattern, QPoint(0,0)));
             }
         }
@@ -812,6 +837,7 @@ void PartWidget::partViewMouseMoveEvent(QMouseEvent *event){
         QPointF snap = QPointF(floor(pt.x()),floor(pt.y()));
         mClipboardItem->setPos(snap);
     }
+    updatePenCursor();
 }
 
 void PartWidget::partViewMouseReleaseEvent(QMouseEvent *event){
@@ -820,18 +846,17 @@ void PartWidget::partViewMouseReleaseEvent(QMouseEvent *event){
         if (mDrawToolType==kDrawToolPaint){
             drawLineTo(event->pos());
 
-            // Create the drawIntoCommand and clear the image and pixmap item
-            // TODO: clip the image to save space..
-            // Can use Pixmap->boundingRect()...
-            TryCommand(new CDrawOnPart(mPartRef, mModeName, mFrameNumber, *mOverlayImage, mOverlayPixmapItem->pos().toPoint()));
-            mOverlayImage->fill(0x00FFFFFF);
-            updateOverlay();
+            // Create the drawIntoCommand with just the part of the overlay that was drawn on, and clear it
+            // NB: copy() of an empty rect is the whole image, so an empty stroke makes no command
+            const QRect stroke = mStrokeBounds & mOverlayImage->rect();
+            if (!stroke.isEmpty()) TryCommand(new CDrawOnPart(mPartRef, mModeName, mFrameNumber, mOverlayImage->copy(stroke), stroke.topLeft()));
+            clearOverlay();
         }
         else if (mDrawToolType==kDrawToolEraser){
             eraseLineTo(event->pos());
-            TryCommand(new CEraseOnPart(mPartRef, mModeName, mFrameNumber, *mOverlayImage, mOverlayPixmapItem->pos().toPoint()));
-            mOverlayImage->fill(0x00FFFFFF);
-            updateOverlay();
+            const QRect stroke = mStrokeBounds & mOverlayImage->rect();
+            if (!stroke.isEmpty()) TryCommand(new CEraseOnPart(mPartRef, mModeName, mFrameNumber, mOverlayImage->copy(stroke), stroke.topLeft()));
+            clearOverlay();
         }
         else if (mDrawToolType==kDrawToolCopy){
             // qDebug() << "Copied rect in image to clipboard";
@@ -864,6 +889,7 @@ void PartWidget::partViewMouseReleaseEvent(QMouseEvent *event){
                 mPartView->scene()->removeItem(mCopyRectItem);
                 delete mCopyRectItem;
                 mCopyRectItem = nullptr;
+                mPartView->stats().sceneChanged(mPartView->scene());
             }
         }
     }
@@ -974,16 +1000,24 @@ void PartWidget::partViewKeyPressEvent(QKeyEvent *event){
     }
 }
 
+// The pixels that a line drawn with a square pen of the given width can touch
+static QRect StrokeRect(QPointF from, QPointF to, int penSize){
+    const int margin = penSize/2 + 1;
+    return QRectF(from, to).normalized().toAlignedRect().adjusted(-margin, -margin, margin, margin);
+}
+
 void PartWidget::drawLineTo(const QPoint &endPoint)
 {
     const float offset = penSize()/2.0f;
-    QPainter painter(mOverlayImage);
+    QRect stroke;
+    QPainter painter(mOverlayImage.data());
     painter.setPen(QPen(penColour(), penSize(), Qt::SolidLine, Qt::SquareCap, Qt::MiterJoin));
     if (endPoint == mLastPoint){
         QPointF lastPointImageCoords = mPartView->mapToScene(mLastPoint.x()+offset,mLastPoint.y()+offset);
         lastPointImageCoords.setX(floor(lastPointImageCoords.x()));
         lastPointImageCoords.setY(floor(lastPointImageCoords.y()));
         painter.drawPoint(lastPointImageCoords);
+        stroke = StrokeRect(lastPointImageCoords, lastPointImageCoords, penSize());
     }
     else {
         QPointF lastPointImageCoords = mPartView->mapToScene(mLastPoint.x()+offset,mLastPoint.y()+offset);
@@ -993,15 +1027,19 @@ void PartWidget::drawLineTo(const QPoint &endPoint)
         endPointImageCoords.setX(floor(endPointImageCoords.x()));
         endPointImageCoords.setY(floor(endPointImageCoords.y()));
         painter.drawLine(lastPointImageCoords, endPointImageCoords);
+        stroke = StrokeRect(lastPointImageCoords, endPointImageCoords, penSize());
     }
-    updateOverlay();
+    painter.end();
+    mStrokeBounds |= stroke;
+    updateOverlay(stroke);
     mLastPoint = endPoint;
 }
 
 void PartWidget::eraseLineTo(const QPoint &endPoint)
 {
     const float offset = penSize()/2.0f;
-    QPainter painter(mOverlayImage);
+    QRect stroke;
+    QPainter painter(mOverlayImage.data());
     painter.setPen(QPen(mEraserColour, penSize(), Qt::SolidLine, Qt::SquareCap, Qt::MiterJoin));
 
     // painter.setBrush(mBackgroundBrush);
@@ -1011,6 +1049,7 @@ void PartWidget::eraseLineTo(const QPoint &endPoint)
         lastPointImageCoords.setX(floor(lastPointImageCoords.x()));
         lastPointImageCoords.setY(floor(lastPointImageCoords.y()));
         painter.drawPoint(lastPointImageCoords);
+        stroke = StrokeRect(lastPointImageCoords, lastPointImageCoords, penSize());
     }
     else {
         // map the points
@@ -1021,23 +1060,40 @@ void PartWidget::eraseLineTo(const QPoint &endPoint)
         endPointImageCoords.setX(floor(endPointImageCoords.x()));
         endPointImageCoords.setY(floor(endPointImageCoords.y()));
         painter.drawLine(lastPointImageCoords, endPointImageCoords);
+        stroke = StrokeRect(lastPointImageCoords, endPointImageCoords, penSize());
     }
     // modified
-    updateOverlay();
+    painter.end();
+    mStrokeBounds |= stroke;
+    updateOverlay(stroke);
     mLastPoint = endPoint;
 }
 
+void PartWidget::updatePenCursor(){
+    if (!mCanvasItem) return;
+    const bool pen = (mDrawToolType==kDrawToolPaint || mDrawToolType==kDrawToolEraser) && mPartView->underMouse();
+    if (!pen){
+        mCanvasItem->setCursorRect(QRect());
+        return;
+    }
+    // NB: The same pixel that drawLineTo starts from
+    const float offset = penSize()/2.0f;
+    const QPointF pt = mPartView->mapToScene(mMousePos.x()+offset, mMousePos.y()+offset);
+    const QPoint pixel(floor(pt.x()), floor(pt.y()));
+    mCanvasItem->setCursorRect(QRect(pixel - QPoint(penSize()/2, penSize()/2), QSize(penSize(), penSize())));
+}
+
 void PartWidget::selectColourUnderPoint(QPointF pt){
     int px = (int) floor(pt.x());
     int py = (int) floor(pt.y());
-    QGraphicsPixmapItem* pi = mPixmapItems.at(mFrameNumber%mPixmapItems.size());
-
-    bool inBounds = px>=0 || px<pi->pixmap().width() || py>=0 || py<pi->pixmap().height();
-    if (pi!=nullptr && inBounds){
-        QImage img = pi->pixmap().toImage();
-        QImage alpha = img.alphaChannel();
-        QRgb rgb = img.pixel(pt.x(), pt.y());
-        if (QColor(alpha.pixel(pt.x(),pt.y())).red()!=0){
+    if (mFrames.isEmpty()) return;
+    const QImage& img = *mFrames.at(mFrameNumber%mFrames.size());
+
+    bool inBounds = img.rect().contains(px, py);
+    if (inBounds){
+        // NB: Just the pixel, rather than converting the whole frame
+        QRgb rgb = img.pixel(px, py);
+        if (qAlpha(rgb)!=0){
             QColor colour(rgb);
             setPenColour(colour);
             setDrawToolType(kDrawToolPaint);
@@ -1060,55 +1116,61 @@ void PartWidget::showFrame(int f){
     bool onion = mOnionSkinningEnabled && ((mIsPlaying&&mOnionSkinningEnabledDuringPlayback) || !mIsPlaying);
     bool pivots = mPivotsEnabled && ((mIsPlaying&&mPivotsEnabledDuringPlayback) || !mIsPlaying);
 
-	// Drop shadow kills perf when:
-	// - zoomed in too much
-	// - sprites are too large
-	bool zoomedInTooMuch = (mIsPlaying && mZoom > 10) || (!mIsPlaying && mZoom > 50);
-	const int maxSizeForDropShadow = 512;
-
-    for(int i=0;i<mPixmapItems.size();i++){
-        QGraphicsPixmapItem* pi = mPixmapItems.at(i);
-		auto size = pi->pixmap().size();
-
-		const bool disableDropShadow = zoomedInTooMuch || ((size.width() * mZoom) > maxSizeForDropShadow || (size.height() * mZoom) > maxSizeForDropShadow);
+    // Only touch the items of the previous and new frame, so this is independent of the number of frames
+    if (mShownFrame >= 0 && mShownFrame < mFrames.size()){
+        setFrameItemsVisible(mShownFrame, false, false);
+    }
+    mShownFrame = (f >= 0 && f < mFrames.size()) ? f : -1;
+    if (mShownFrame >= 0){
+        setFrameItemsVisible(mShownFrame, true, pivots);
+    }
+    if (mCanvasItem){
+        mCanvasItem->setFrame(mShownFrame >= 0 ? mFrames.at(mShownFrame) : QSharedPointer<QImage>());
+    }
 
-		auto* effect = pi->graphicsEffect();		
-        if (effect) effect->setEnabled(false);        
-		for (auto* it : mAnchorItems.at(i)) {
-			it->hide();
-		}
-		for (int p = 0; p < Part::MaxPivots; p++) {
-			for (auto* it : mPivotItems[p].at(i)) {
-				it->hide();
-			}
-		}
-        if (i == f){
-			pi->show();
-            pi->setOpacity(1);
-			if (!disableDropShadow && effect && static_cast<QGraphicsDropShadowEffect*>(effect)->color().alpha() > 0) effect->setEnabled(true);
-            if (pivots){
-				for (auto* it : mAnchorItems.at(i)) {
-					it->show();
-				}
-				for (int p = 0; p < mNumPivots; p++) {
-					for (auto* it : mPivotItems[p].at(i)) {
-						it->show();
-					}
-				}
-            }
+    if (mOnionSkinItem){
+        if (onion && mShownFrame >= 0){
+            mOnionSkinItem->setPixmap(onionSkinPixmap(mShownFrame));
+            mOnionSkinItem->show();
         }
-        else if (onion && ((i-f)==1 || (i-f)==-1)){
-			pi->show();
-            pi->setOpacity(mOnionSkinningOpacity);
+        else {
+            mOnionSkinItem->hide();
         }
-        else if (onion && ((i-f)==2 || (i-f)==-2)){
-			pi->show();
-            pi->setOpacity(mOnionSkinningOpacity /4);
+    }
+}
+
+void PartWidget::setFrameItemsVisible(int f, bool visible, bool pivots){
+    if (f < mShadowItems.size()){
+        mShadowItems.at(f)->setVisible(visible && mShadowEnabled);
+    }
+    for (auto* it : mAnchorItems.at(f)) {
+        it->setVisible(visible && pivots);
+    }
+    for (int p = 0; p < Part::MaxPivots; p++) {
+        for (auto* it : mPivotItems[p].at(f)) {
+            it->setVisible(visible && pivots && p < mNumPivots);
         }
-        else {
-            pi->hide();
+    }
+}
+
+QPixmap PartWidget::onionSkinPixmap(int f){
+    // Blend frames f-2..f+2 (excluding f) once and reuse it until the scene is rebuilt
+    QPixmap& cached = mOnionSkinCache[f];
+    if (cached.isNull()){
+        QSize size;
+        for (const auto& frame : mFrames) size = size.expandedTo(frame->size());
+        QImage blended(size, QImage::Format_ARGB32_Premultiplied);
+        blended.fill(Qt::transparent);
+        QPainter painter(&blended);
+        for (int i = std::max(0, f - 2); i <= std::min(mFrames.size() - 1, f + 2); i++){
+            if (i == f) continue;
+            painter.setOpacity((i - f == 1 || i - f == -1) ? mOnionSkinningOpacity : mOnionSkinningOpacity / 4);
+            painter.drawImage(0, 0, *mFrames.at(i));
         }
+        painter.end();
+        cached = QPixmap::fromImage(blended);
     }
+    return cached;
 }
 
 void PartWidget::updateBackgroundBrushes(){
@@ -1184,35 +1246,55 @@ PartView::PartView(PartWidget *parent, QGraphicsScene *scene)
 void PartView::scrollContentsBy(int sx, int sy)
 {
     QGraphicsView::scrollContentsBy(sx,sy);
+    // NB: The scroll moves the overlay's pixels too
+    if (ViewStats::isVisible()) viewport()->update(mStats.overlayRect().translated(sx, sy));
 }
 
 void PartView::mousePressEvent(QMouseEvent *event){
+    mStats.input();
     pw->partViewMousePressEvent(event);
 }
 
 void PartView::mouseMoveEvent(QMouseEvent *event){
+    mStats.input();
     pw->partViewMouseMoveEvent(event);
 }
 
 void PartView::mouseReleaseEvent(QMouseEvent *event){
+    mStats.input();
     pw->partViewMouseReleaseEvent(event);
 }
 
 void PartView::wheelEvent(QWheelEvent *event){
+    mStats.input();
     pw->partViewWheelEvent(event);
 }
 
+void PartView::paintEvent(QPaintEvent *event){
+    mStats.beginPaint(event->rect());
+    QGraphicsView::paintEvent(event);
+    if (mStats.endPaint()) viewport()->update(mStats.overlayRect());
+}
+
+void PartView::drawForeground(QPainter *painter, const QRectF &rect){
+    QGraphicsView::drawForeground(painter, rect);
+    if (ViewStats::isVisible()) mStats.draw(painter);
+}
+
 void PartView::keyPressEvent(QKeyEvent *event){
     pw->partViewKeyPressEvent(event);
 }
 
+void PartView::leaveEvent(QEvent *event){
+    QGraphicsView::leaveEvent(event);
+    if (pw->mCanvasItem) pw->mCanvasItem->setCursorRect(QRect());
+}
+
 void PartView::drawBackground(QPainter *painter, const QRectF &rect)
 {
 	painter->fillRect(rect, QBrush(pw->mOutOfBoundsColour));
-    if (pw->mBoundsItem){
-        // QPen pen = pw->mBoundsItem->pen();
-        // pen.setColor(pw->mBoundsColour);
-        pw->mBoundsItem->setPen(Qt::NoPen);
-		pw->mBoundsItem->setBrush(pw->mBackgroundBrush);
+    if (pw->mCanvasItem){
+        // NB: Drawn here rather than by the canvas so the onion skin and shadows are above it
+        painter->fillRect(rect & QRectF(pw->mCanvasItem->canvasRect()), pw->mBackgroundBrush);
     }
 }
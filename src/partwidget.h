@@ -2,6 +2,8 @@
 #define PARTWIDGET_H
 
 #include "projectmodel.h"
+#include "viewstats.h"
+#include "pixelcanvasitem.h"
 
 #include <QMdiSubWindow>
 #include <QGraphicsScene>
@@ -26,18 +28,23 @@ class PartView: public QGraphicsView {
     friend class PartWidget;
 public:
     PartView(PartWidget* parent, QGraphicsScene* scene);
+    ViewStats& stats(){return mStats;}
 protected:
     // Forwards these to parent
     void mousePressEvent(QMouseEvent *mouseEvent);
     void mouseMoveEvent(QMouseEvent *mouseEvent);
     void mouseReleaseEvent(QMouseEvent *mouseEvent);
     void wheelEvent(QWheelEvent *event);
+    void paintEvent(QPaintEvent *event);
     void drawBackground(QPainter *painter, const QRectF &rect);
+    void drawForeground(QPainter *painter, const QRectF &rect);
     void keyPressEvent(QKeyEvent *event);
+    void leaveEvent(QEvent *event);
     void scrollContentsBy(int, int);
 
 protected:
     PartWidget* pw;
+    ViewStats mStats;
 };
 
 ////////////////////////////////////////////////
@@ -55,14 +62,15 @@ public:
     void setMode(const QString& mode);
 
     void partNameChanged(const QString& newPartName);    
-    void partFrameUpdated(AssetRef part, const QString& mode, int frame);
+    void partFrameUpdated(AssetRef part, const QString& mode, int frame, const QRect& pixels);
     void partFramesUpdated(AssetRef part, const QString& mode);
     void partNumPivotsUpdated(AssetRef part, const QString& mode);
     void partPropertiesChanged(AssetRef part);
 
     // updaters
     void updatePropertiesOverlays();
-    void updateOverlay();
+    void updateOverlay(const QRect& rect = QRect()); // rect is the part of the overlay that was drawn on
+    void clearOverlay();
     void buildScene();
     void updateBackgroundBrushes();
 
@@ -77,12 +85,11 @@ public:
     QString modeName() const {return mModeName;}
     int zoom() const {return mZoom;}
     int penSize() const {return mPenSize;}
-    QString properties() const {return mProperties;}
     QColor penColour() const {return mPenColour;}
     DrawToolType drawToolType() const {return mDrawToolType;}    
     bool isPlaying() const {return mIsPlaying;}
     int frame() const {return mFrameNumber;}
-    int numFrames() const {return mPixmapItems.size();}
+    int numFrames() const {return mFrames.size();}
     int numPivots() const {return mNumPivots;}
     int playbackSpeedMultiplierIndex() const {return mPlaybackSpeedMultiplierIndex;}
 
@@ -99,6 +106,10 @@ protected:
 
     void drawLineTo(const QPoint &endPoint);
     void eraseLineTo(const QPoint &endPoint);
+    void updatePenCursor(); // Outlines the pixels under the pen
+
+    void setFrameItemsVisible(int f, bool visible, bool pivots);
+    QPixmap onionSkinPixmap(int f);
 	
 signals:
     void penChanged();
@@ -129,7 +140,8 @@ public slots:
     void play(bool);
     void stop();
 
-    void updateAnimation();
+public:
+    double updateAnimation(double seconds); // Returns the seconds until the next frame
 
 protected:
     AssetRef mPartRef;
@@ -137,7 +149,7 @@ protected:
     QString mModeName;
     Part* mPart;
     PartView* mPartView;
-    QGraphicsPixmapItem* mOverlayPixmapItem;
+    PixelCanvasItem* mCanvasItem; // Draws the shown frame and the overlay
 
     float mZoom;
     QPointF mViewportCenter;
@@ -145,15 +157,18 @@ protected:
     QColor mPenColour;
     QColor mEraserColour;
     DrawToolType mDrawToolType;
-    QTimer* mAnimationTimer;
     int mFrameNumber;
     double mSecondsPassedSinceLastFrame; // TODO: change to seconds since frame?
     bool mIsPlaying;
 
-    QGraphicsRectItem* mBoundsItem;
-
     // TODO: make this a (frame -> (layer -> image)) map
-    QVector<QGraphicsPixmapItem*> mPixmapItems;
+    QVector<QSharedPointer<QImage>> mFrames;
+    QVector<QGraphicsPixmapItem*> mShadowItems; // Cached drop shadows
+    int mShownFrame; // The frame whose items are currently visible (-1 if none)
+
+    // Onion skins are the neighbouring frames pre-blended into a single pixmap per frame
+    QGraphicsPixmapItem* mOnionSkinItem;
+    QVector<QPixmap> mOnionSkinCache;
 
     // Frames
     QVector< QList<QAbstractGraphicsShapeItem*>> mAnchorItems;
@@ -163,7 +178,6 @@ protected:
     QVector<QPoint> mAnchors;
     QVector<QPoint> mPivots[Part::MaxPivots];
     int mNumPivots;
-    QString mProperties;
     int mFPS;
     double mSPF;
     int mPlaybackSpeedMultiplierIndex;
@@ -175,10 +189,12 @@ protected:
 	QPointF mLastViewportCenter;
     bool mScribbling;
     bool mMovingCanvas;
-    QImage* mOverlayImage; // TODO: resize this when change mode
+    QSharedPointer<QImage> mOverlayImage; // The stroke being drawn
+    QRect mStrokeBounds; // The part of mOverlayImage drawn on
     float mOnionSkinningOpacity;
     bool mOnionSkinningEnabled;
     bool mOnionSkinningEnabledDuringPlayback;
+    bool mShadowEnabled;
 
     bool mPivotsEnabled;
     bool mPivotsEnabledDuringPlayback;
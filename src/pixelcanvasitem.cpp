@@ -0,0 +1,152 @@
+#include "pixelcanvasitem.h"
+#include "imageops.h"
+#include "trace.h"
+
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+
+// The device pixels covered by rect (in sprite pixels)
+static QRect DeviceRect(const QRect& rect, const QPoint& origin, int zoom){
+    return QRect(origin + rect.topLeft()*zoom, rect.size()*zoom);
+}
+
+PixelCanvasItem::PixelCanvasItem(const QSize& size, QGraphicsItem* parent)
+    :QGraphicsItem(parent), mSize(size){
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption); // for exposedRect
+}
+
+void PixelCanvasItem::resetLayer(Layer& layer, QSharedPointer<QImage> image){
+    layer.image = image;
+    layer.columns = image ? (image->width() + TileSize - 1) / TileSize : 0;
+    const int rows = image ? (image->height() + TileSize - 1) / TileSize : 0;
+    layer.states.fill(Dirty, layer.columns * rows);
+    update();
+}
+
+void PixelCanvasItem::layerChanged(Layer& layer, const QRect& rect){
+    if (!layer.image) return;
+    const QRect changed = rect.isNull() ? layer.image->rect() : rect;
+    for (const QRect& tile : TilesIn(changed, layer.image->size())){
+        layer.states[(tile.y() / TileSize) * layer.columns + tile.x() / TileSize] = Dirty;
+    }
+    update(changed);
+}
+
+void PixelCanvasItem::setFrame(QSharedPointer<QImage> image){
+    if (image != mFrame.image) resetLayer(mFrame, image);
+}
+
+void PixelCanvasItem::setOverlay(QSharedPointer<QImage> image){
+    if (image != mOverlay.image) resetLayer(mOverlay, image);
+}
+
+void PixelCanvasItem::frameChanged(const QRect& rect){
+    layerChanged(mFrame, rect);
+}
+
+void PixelCanvasItem::overlayChanged(const QRect& rect){
+    layerChanged(mOverlay, rect);
+}
+
+void PixelCanvasItem::setBoundsColour(const QColor& colour){
+    mBoundsColour = colour;
+    update();
+}
+
+void PixelCanvasItem::setGridColour(const QColor& colour){
+    mGridColour = colour;
+    update();
+}
+
+void PixelCanvasItem::setCursorRect(const QRect& rect){
+    if (rect == mCursorRect) return;
+    if (!mCursorRect.isEmpty()) update(QRectF(mCursorRect));
+    mCursorRect = rect;
+    if (!mCursorRect.isEmpty()) update(QRectF(mCursorRect));
+}
+
+QRectF PixelCanvasItem::boundingRect() const {
+    // NB: The bounds are drawn a device pixel outside the canvas
+    return QRectF(canvasRect()).adjusted(-1, -1, 1, 1);
+}
+
+void PixelCanvasItem::drawLayer(QPainter* painter, Layer& layer, const QRect& exposed, const QPoint& origin, int zoom){
+    if (!layer.image) return;
+    for (const QRect& tile : TilesIn(exposed, layer.image->size())){
+        const int index = (tile.y() / TileSize) * layer.columns + tile.x() / TileSize;
+        if (layer.states[index] == Dirty){
+            layer.states[index] = IsTransparent(*layer.image, tile) ? Empty : Ready;
+        }
+        if (layer.states[index] == Empty) continue;
+
+        const QRect source = tile & exposed;
+        const QPoint target = origin + source.topLeft()*zoom;
+        if (zoom == 1){
+            painter->drawImage(target, *layer.image, source);
+        }
+        else {
+            // NB: FastTransformation is nearest neighbour
+            painter->drawImage(target, layer.image->copy(source).scaled(source.size()*zoom, Qt::IgnoreAspectRatio, Qt::FastTransformation));
+        }
+    }
+}
+
+void PixelCanvasItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget*){
+    TRACE_SCOPE("PixelCanvasItem::paint");
+    const QRect exposed = option->exposedRect.toAlignedRect() & canvasRect();
+    const QTransform transform = painter->worldTransform();
+    const int zoom = qRound(transform.m11());
+    const bool pixelAligned = transform.type() <= QTransform::TxScale && zoom >= 1
+            && qFuzzyCompare(transform.m11(), qreal(zoom)) && qFuzzyCompare(transform.m22(), qreal(zoom));
+
+    if (!pixelAligned){
+        // NB: Only while the view is between zoom levels (e.g., in fitToWindow), so let the painter scale it
+        for (const Layer* layer : {&mFrame, &mOverlay}){
+            if (layer->image) painter->drawImage(exposed.topLeft(), *layer->image, exposed & layer->image->rect());
+        }
+        return;
+    }
+
+    const QPoint origin(qRound(transform.dx()), qRound(transform.dy()));
+    painter->save();
+    painter->resetTransform();
+
+    if (!exposed.isEmpty()){
+        drawLayer(painter, mFrame, exposed, origin, zoom);
+        drawLayer(painter, mOverlay, exposed, origin, zoom);
+
+        if (zoom >= MinGridZoom && mGridColour.alpha() > 0){
+            // NB: One line per visible row and column
+            const QRect device = DeviceRect(exposed, origin, zoom);
+            QVector<QLine> lines;
+            lines.reserve(exposed.width() + exposed.height() + 2);
+            for (int x = exposed.left(); x <= exposed.right() + 1; x++){
+                const int dx = origin.x() + x*zoom;
+                lines.append(QLine(dx, device.top(), dx, device.bottom() + 1));
+            }
+            for (int y = exposed.top(); y <= exposed.bottom() + 1; y++){
+                const int dy = origin.y() + y*zoom;
+                lines.append(QLine(device.left(), dy, device.right() + 1, dy));
+            }
+            painter->setPen(QPen(mGridColour, 0));
+            painter->drawLines(lines);
+        }
+    }
+
+    painter->setBrush(Qt::NoBrush);
+    if (mBoundsColour.alpha() > 0){
+        painter->setPen(QPen(mBoundsColour, 0));
+        painter->drawRect(DeviceRect(canvasRect(), origin, zoom).adjusted(-1, -1, 0, 0));
+    }
+
+    const QRect cursor = mCursorRect & canvasRect();
+    if (!cursor.isEmpty()){
+        const QRect rect = DeviceRect(cursor, origin, zoom).adjusted(0, 0, -1, -1);
+        painter->setPen(QPen(Qt::white, 0));
+        painter->drawRect(rect);
+        painter->setPen(QPen(Qt::black, 0, Qt::DotLine));
+        painter->drawRect(rect);
+    }
+
+    painter->restore();
+}
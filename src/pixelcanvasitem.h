@@ -0,0 +1,60 @@
+#ifndef PIXELCANVASITEM_H
+#define PIXELCANVASITEM_H
+
+#include <QColor>
+#include <QGraphicsItem>
+#include <QImage>
+#include <QSharedPointer>
+#include <QVector>
+
+// Draws the frame being edited, the stroke overlay, the pixel grid, the bounds and
+// the pen cursor of a sprite in a single paint.
+// At a whole-number zoom it draws in device pixels: only the exposed part of each
+// image is copied and scaled up (nearest neighbour), so a paint costs about the
+// same at any zoom or sprite size. Empty tiles (see imageops.h) are skipped, so
+// an unused overlay costs nothing.
+class PixelCanvasItem: public QGraphicsItem {
+public:
+    // size is the size of the sprite mode (in sprite pixels)
+    explicit PixelCanvasItem(const QSize& size, QGraphicsItem* parent = nullptr);
+
+    QRect canvasRect() const {return QRect(QPoint(0, 0), mSize);}
+
+    void setFrame(QSharedPointer<QImage> image); // null to show nothing
+    void setOverlay(QSharedPointer<QImage> image);
+    const QSharedPointer<QImage>& frame() const {return mFrame.image;}
+    // Call after drawing into the frame or overlay (a null rect means all of it)
+    void frameChanged(const QRect& rect = QRect());
+    void overlayChanged(const QRect& rect = QRect());
+
+    void setBoundsColour(const QColor& colour);
+    void setGridColour(const QColor& colour); // the grid is drawn from MinGridZoom
+    // The pixels under the pen (a null rect hides it)
+    void setCursorRect(const QRect& rect);
+
+    static const int MinGridZoom = 8;
+
+    QRectF boundingRect() const override;
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) override;
+
+private:
+    enum TileState: quint8 {Dirty, Empty, Ready};
+    struct Layer {
+        QSharedPointer<QImage> image;
+        int columns = 0;
+        QVector<TileState> states;
+    };
+
+    void resetLayer(Layer& layer, QSharedPointer<QImage> image);
+    void layerChanged(Layer& layer, const QRect& rect);
+    void drawLayer(QPainter* painter, Layer& layer, const QRect& exposed, const QPoint& origin, int zoom);
+
+    QSize mSize;
+    Layer mFrame;
+    Layer mOverlay;
+    QColor mBoundsColour;
+    QColor mGridColour;
+    QRect mCursorRect;
+};
+
+#endif // PIXELCANVASITEM_H
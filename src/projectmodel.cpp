@@ -1,6 +1,8 @@
 #include "projectmodel.h"
+#include "assetindex.h"
 
 #include "zip.h"
+#include "trace.h"
 #include <QColor>
 #include <QDebug>
 #include <QPainter>
@@ -8,14 +10,19 @@
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QFile>
+#include <QFileInfo>
 #include <QTextStream>
 #include <QTemporaryFile>
 #include <QDir>
+#include <QHash>
+#include <QSet>
+#include <QCryptographicHash>
 #include <algorithm>
 #include <cstdlib>
 #include <ctime>
 #include <cmath>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <ios>
@@ -48,6 +55,7 @@ static ProjectModel* sInstance = nullptr;
 ProjectModel* PM(){return ProjectModel::Instance();}
 
 ProjectModel::ProjectModel()
+	:mSearchIndex(new AssetIndex())
 {
 	sInstance = this;
 }
@@ -60,6 +68,10 @@ ProjectModel* ProjectModel::Instance() {
 	return sInstance;
 }
 
+AssetIndex* ProjectModel::searchIndex() {
+	return mSearchIndex.data();
+}
+
 AssetRef ProjectModel::createAssetRef(AssetType type) {
 	AssetRef ref;
 	ref.id = mNextId++;
@@ -67,6 +79,66 @@ AssetRef ProjectModel::createAssetRef(AssetType type) {
 	return ref;
 }
 
+QJsonObject ProjectModel::assetToJson(const AssetRef& ref, QMap<QString, QSharedPointer<QImage>>* imageMap) {
+	QJsonObject obj;
+	obj.insert("id", ref.id);
+	switch (ref.type) {
+	case AssetType::Folder: {
+		Folder* folder = getFolder(ref);
+		if (folder) folderToJson(folder->name, *folder, &obj);
+		break;
+	}
+	case AssetType::Part: {
+		Part* part = getPart(ref);
+		if (part) partToJson(folders, part->name, *part, &obj, imageMap);
+		break;
+	}
+	case AssetType::Composite: {
+		Composite* comp = getComposite(ref);
+		if (comp) compositeToJson(comp->name, *comp, libraryPartIds(), &obj);
+		break;
+	}
+	default: break;
+	}
+	return obj;
+}
+
+bool ProjectModel::assetFromJson(const AssetRef& ref, const QJsonObject& obj, const QMap<QString, QSharedPointer<QImage>>& imageMap) {
+	switch (ref.type) {
+	case AssetType::Folder: {
+		auto folder = QSharedPointer<Folder>::create();
+		folder->ref = ref;
+		jsonToFolder(obj, folder.get());
+		folders.insert(ref, folder);
+		break;
+	}
+	case AssetType::Part: {
+		// NB: jsonToPart expects every image
+		for (const auto& mode : obj["modes"].toArray()) {
+			for (const auto& frame : mode.toObject().value("frames").toArray()) {
+				if (!imageMap.value(frame.toObject().value("image").toString())) return false;
+			}
+		}
+		auto part = QSharedPointer<Part>::create();
+		part->ref = ref;
+		jsonToPart(obj, imageMap, part.get());
+		parts.insert(ref, part);
+		break;
+	}
+	case AssetType::Composite: {
+		auto comp = QSharedPointer<Composite>::create();
+		comp->ref = ref;
+		jsonToComposite(obj, comp.get());
+		composites.insert(ref, comp);
+		break;
+	}
+	default: return false;
+	}
+	mNextId = std::max(mNextId, ref.id + 1);
+	mSearchIndex->invalidate(ref);
+	return true;
+}
+
 Asset* ProjectModel::getAsset(const AssetRef& ref) {
 	switch (ref.type) {
 	case AssetType::Part: return getPart(ref);
@@ -81,6 +153,7 @@ bool ProjectModel::hasAsset(const AssetRef& ref) {
 }
 
 Part* ProjectModel::getPart(const AssetRef& uuid) {
+	if (IsLibraryRef(uuid)) return loadLibraryPart(uuid);
 	return parts.value(uuid).data();
 }
 
@@ -134,9 +207,8 @@ Folder* ProjectModel::findFolderByName(const QString& name) {
 void ProjectModel::resetImageCache(QImage* img) {
 	auto it = mImageCache.find(img);
 	if (it != mImageCache.end()) {
-		if (QFile::exists(it.value())) {
-			QFile::remove(it.value());
-		}
+		// NB: A snapshot that is being written may still need it
+		mJunkFiles.append(it.value());
 		mImageCache.erase(it);
 	}
 }
@@ -147,12 +219,17 @@ void ProjectModel::clear() {
 	folders.clear();
 	fileName = QString();
 	clearImageCache();
+	mSearchIndex->invalidateAll();
 	mNextId = 0;
 
 	for (auto file : mJunkFiles) {
 		QFile::remove(file);
 	}
 	mJunkFiles.clear();
+	mFileCrcs.clear();
+	mFileAssets.clear();
+	mLibraries.clear();
+	mNextLibraryId = -1;
 }
 
 static void removeAdditionalNullChars(QByteArray& arr) {
@@ -166,12 +243,159 @@ static void removeAdditionalNullChars(QByteArray& arr) {
 	if (length != 0) arr.resize(length);
 }
 
+// The json of each asset in data.json
+static bool ParseDataAssets(QByteArray data, QMap<AssetRef, QJsonObject>* assets, QString& reason) {
+	removeAdditionalNullChars(data);
+	QJsonParseError error;
+	QJsonDocument doc = QJsonDocument::fromJson(data, &error);
+	if (error.error != QJsonParseError::NoError || !doc.isObject()) {
+		reason = "Internal data.json parse error: " + error.errorString();
+		return false;
+	}
+
+	const QJsonObject dataObj = doc.object();
+	if (dataObj.value("version").toInt(0) != ProjectFileVersion) {
+		reason = "Internal data.json has an invalid version";
+		return false;
+	}
+
+	const std::pair<QString, AssetType> arrays[] = {
+		{ "folders", AssetType::Folder }, { "parts", AssetType::Part }, { "comps", AssetType::Composite }
+	};
+	for (const auto& array : arrays) {
+		for (const auto& value : dataObj.value(array.first).toArray()) {
+			const QJsonObject obj = value.toObject();
+			AssetRef ref;
+			ref.id = obj["id"].toInt();
+			ref.type = array.second;
+			assets->insert(ref, obj);
+		}
+	}
+	return true;
+}
+
+static QStringList PartImageNames(const QJsonObject& obj) {
+	QStringList images;
+	for (const auto& mode : obj["modes"].toArray()) {
+		for (const auto& frame : mode.toObject().value("frames").toArray()) {
+			images.append(frame.toObject().value("image").toString());
+		}
+	}
+	return images;
+}
+
+bool ProjectModel::mountLibrary(const QString& fileName, QString& reason, QString name) {
+	TRACE_SCOPE("ProjectModel::mountLibrary");
+	if (name.isEmpty()) name = QFileInfo(fileName).completeBaseName();
+	for (const auto& library : mLibraries) {
+		if (library->name == name) {
+			reason = "A library called " + name + " is already mounted";
+			return false;
+		}
+	}
+
+	const auto data = LoadZipEntries(fileName, { "data.json" });
+	if (data.isEmpty()) {
+		reason = "Cannot open file!";
+		return false;
+	}
+	QMap<AssetRef, QJsonObject> assets;
+	if (!ParseDataAssets(data.value("data.json"), &assets, reason)) return false;
+
+	auto library = QSharedPointer<Library>::create();
+	library->name = name;
+	library->fileName = QFileInfo(fileName).absoluteFilePath();
+	for (auto it = assets.begin(); it != assets.end(); ++it) {
+		if (it.key().type != AssetType::Part) continue;
+		AssetRef ref;
+		ref.id = mNextLibraryId--;
+		ref.type = AssetType::Part;
+		library->refs.insert(it.key().id, ref);
+		library->names.insert(name + "/" + it.value()["name"].toString(), ref);
+		library->unloaded.insert(ref, it.value());
+	}
+	mLibraries.append(library);
+	return true;
+}
+
+AssetRef ProjectModel::findLibraryPart(const QString& name) const {
+	for (const auto& library : mLibraries) {
+		auto it = library->names.constFind(name);
+		if (it != library->names.constEnd()) return it.value();
+	}
+	return AssetRef();
+}
+
+AssetRef ProjectModel::libraryRef(const QString& name, int id) const {
+	for (const auto& library : mLibraries) {
+		if (library->name == name) return library->refs.value(id);
+	}
+	return AssetRef();
+}
+
+QMap<AssetRef, LibraryPartId> ProjectModel::libraryPartIds() const {
+	QMap<AssetRef, LibraryPartId> ids;
+	for (const auto& library : mLibraries) {
+		for (auto it = library->refs.begin(); it != library->refs.end(); ++it) {
+			LibraryPartId id;
+			id.library = library->name;
+			id.id = it.key();
+			ids.insert(it.value(), id);
+		}
+	}
+	return ids;
+}
+
+Part* ProjectModel::loadLibraryPart(const AssetRef& ref) {
+	for (const auto& library : mLibraries) {
+		auto loaded = library->parts.constFind(ref);
+		if (loaded != library->parts.constEnd()) return loaded.value().data();
+
+		auto it = library->unloaded.constFind(ref);
+		if (it == library->unloaded.constEnd()) continue;
+
+		TRACE_SCOPE("ProjectModel::loadLibraryPart");
+		// NB: It stays in unloaded until it loads, so a failed load is tried again next time
+		const QJsonObject obj = it.value();
+		const QStringList images = PartImageNames(obj);
+		const auto pngs = LoadZipEntries(library->fileName, QSet<QString>::fromList(images));
+		QMap<QString, QSharedPointer<QImage>> imageMap;
+		for (auto png = pngs.begin(); png != pngs.end(); ++png) {
+			TRACE_SCOPE("Decode PNG");
+			auto img = QSharedPointer<QImage>::create();
+			if (img->loadFromData(png.value(), "PNG")) imageMap.insert(png.key(), img);
+		}
+		for (const QString& image : images) {
+			if (!imageMap.contains(image)) {
+				qWarning() << "Couldn't load " << image << " from library " << library->fileName;
+				return nullptr;
+			}
+		}
+
+		auto part = QSharedPointer<Part>::create();
+		jsonToPart(obj, imageMap, part.get());
+		part->ref = ref;
+		part->name = library->name + "/" + part->name;
+		part->parent = AssetRef(); // NB: The folders of the library aren't mounted
+		library->unloaded.remove(ref);
+		library->parts.insert(ref, part);
+		return part.data();
+	}
+	return nullptr;
+}
+
 bool ProjectModel::load(const QString& fileName, QString& reason) {
+	TRACE_SCOPE("ProjectModel::load");
 	clearImageCache();
 	importLog.clear();
 	mNextId = 0;
+	mSearchIndex->invalidateAll();
+	mFileCrcs.clear();
+	mFileAssets.clear();
+	mLibraries.clear();
+	mNextLibraryId = -1;
 	
-	auto fileMap = LoadZipToFiles(fileName);
+	auto fileMap = LoadZipToFiles(fileName, &mFileCrcs);
 	if (fileMap.isEmpty()) {
 		reason = "Cannot open file!";
 		return false;
@@ -233,6 +457,7 @@ bool ProjectModel::load(const QString& fileName, QString& reason) {
 	for (auto it = fileMap.begin(); it != fileMap.end(); it++) {
 		QString assetName = it.key();
 		if (assetName.endsWith(".png")) {
+			TRACE_SCOPE("Decode PNG");
 			auto img = QSharedPointer<QImage>::create();
 			bool res = img->load(it.value(), "PNG");
 			if (!res) {
@@ -257,6 +482,7 @@ bool ProjectModel::load(const QString& fileName, QString& reason) {
 			mNextId = std::max(mNextId, folder->ref.id + 1);
 			jsonToFolder(obj, folder.get());
 			this->folders.insert(folder->ref, folder);
+			mFileAssets.insert(folder->ref, obj);
 		}
 	}
 
@@ -269,6 +495,17 @@ bool ProjectModel::load(const QString& fileName, QString& reason) {
 			mNextId = std::max(mNextId, part->ref.id + 1);
 			jsonToPart(partObj, imageMap, part.get());
 			this->parts.insert(part->ref, part);
+			mFileAssets.insert(part->ref, partObj);
+		}
+	}
+
+	// NB: Before the composites that use them
+	const QDir projectDir = QFileInfo(fileName).absoluteDir();
+	for (const auto& value : dataObj.value("libraries").toArray()) {
+		const QJsonObject obj = value.toObject();
+		QString libraryReason;
+		if (!mountLibrary(projectDir.absoluteFilePath(obj["file"].toString()), libraryReason, obj["name"].toString())) {
+			importLog.append("Couldn't mount library " + obj["name"].toString() + ": " + libraryReason);
 		}
 	}
 
@@ -281,6 +518,7 @@ bool ProjectModel::load(const QString& fileName, QString& reason) {
 			mNextId = std::max(mNextId, composite->ref.id + 1);
 			jsonToComposite(compObj, composite.get());
 			this->composites.insert(composite->ref, composite);
+			mFileAssets.insert(composite->ref, compObj);
 		}
 	}
 
@@ -289,17 +527,197 @@ bool ProjectModel::load(const QString& fileName, QString& reason) {
 }
 
 bool ProjectModel::save(const QString& fileName) {
+	TRACE_SCOPE("ProjectModel::save");
+	if (!WriteSnapshot(snapshot(), fileName, &exportLog)) return false;
+	this->fileName = fileName;
+	readFileState(fileName);
+	return true;
+}
+
+void ProjectModel::readFileState(const QString& savedFileName) {
+	TRACE_SCOPE("ProjectModel::readFileState");
+	QString reason;
+	QMap<AssetRef, QJsonObject> assets;
+	const auto data = LoadZipEntries(savedFileName, { "data.json" });
+	if (data.isEmpty() || !ParseDataAssets(data.value("data.json"), &assets, reason)) {
+		// NB: The next reload will replace everything
+		qWarning() << "Couldn't read back " << savedFileName << reason;
+		mFileCrcs.clear();
+		mFileAssets.clear();
+		return;
+	}
+	mFileCrcs = ReadZipCrcs(savedFileName);
+	mFileAssets = assets;
+}
+
+bool ProjectModel::hasFileChanged() const {
+	const auto crcs = ReadZipCrcs(fileName);
+	return !crcs.isEmpty() && crcs != mFileCrcs;
+}
+
+bool ProjectModel::reloadChanges(QString& reason, ProjectReload* changes) {
+	TRACE_SCOPE("ProjectModel::reloadChanges");
+	const QMap<QString, quint32> crcs = ReadZipCrcs(fileName);
+	if (crcs.isEmpty()) {
+		reason = "Cannot open file!";
+		return false;
+	}
+	if (!crcs.contains("data.json")) {
+		reason = "Internal data.json is missing";
+		return false;
+	}
+
+	QSet<QString> changedEntries;
+	for (auto it = crcs.begin(); it != crcs.end(); ++it) {
+		auto old = mFileCrcs.constFind(it.key());
+		if (old == mFileCrcs.constEnd() || old.value() != it.value()) changedEntries.insert(it.key());
+	}
+	if (changedEntries.isEmpty()) return true;
+
+	// NB: If only images changed then the json is the same as before
+	QMap<AssetRef, QJsonObject> fileAssets = mFileAssets;
+	if (changedEntries.contains("data.json")) {
+		const auto data = LoadZipEntries(fileName, { "data.json" });
+		fileAssets.clear();
+		if (data.isEmpty()) {
+			reason = "Couldn't load data.json";
+			return false;
+		}
+		if (!ParseDataAssets(data.value("data.json"), &fileAssets, reason)) return false;
+	}
+
+	// Find the assets whose json or images changed, and the images that need decoding
+	ProjectReload reload;
+	QMap<QString, QSharedPointer<QImage>> imageMap;
+	QSet<QString> neededImages;
+	QSet<AssetRef> conflicts;
+	for (auto it = fileAssets.begin(); it != fileAssets.end(); ++it) {
+		const AssetRef& ref = it.key();
+		// NB: A new asset in the file with the id of an unsaved one of ours (the other program picked the same id), so ours is kept
+		if (!mFileAssets.contains(ref) && hasAsset(ref)) {
+			conflicts.insert(ref);
+			importLog.append(QString("Kept the unsaved asset %1, the file has a different asset with the same id").arg(ref.id));
+			continue;
+		}
+		const QStringList images = PartImageNames(it.value());
+		const bool imagesChanged = std::any_of(images.begin(), images.end(), [&](const QString& image) { return changedEntries.contains(image); });
+		if (!imagesChanged && it.value() == mFileAssets.value(ref)) continue;
+
+		// The frames that didn't change are kept
+		QMap<QString, QSharedPointer<QImage>> current;
+		if (hasPart(ref)) assetToJson(ref, &current);
+		for (const QString& image : images) {
+			if (!changedEntries.contains(image) && current.value(image)) imageMap.insert(image, current.value(image));
+			else neededImages.insert(image);
+		}
+		(hasAsset(ref) ? reload.updated : reload.inserted).append(ref);
+	}
+	for (auto it = mFileAssets.begin(); it != mFileAssets.end(); ++it) {
+		if (!fileAssets.contains(it.key()) && hasAsset(it.key())) reload.removed.append(it.key());
+	}
+
+	if (!neededImages.isEmpty()) {
+		const auto pngs = LoadZipEntries(fileName, neededImages);
+		if (pngs.size() != neededImages.size()) {
+			reason = "Couldn't load the changed images";
+			return false;
+		}
+		for (auto it = pngs.begin(); it != pngs.end(); ++it) {
+			TRACE_SCOPE("Decode PNG");
+			auto img = QSharedPointer<QImage>::create();
+			if (!img->loadFromData(it.value(), "PNG")) {
+				reason = "Couldn't load " + it.key();
+				return false;
+			}
+			imageMap.insert(it.key(), img);
+		}
+	}
+
+	QSet<const QImage*> keptImages;
+	for (const auto& img : imageMap) keptImages.insert(img.get());
+	auto resetPartImages = [&](const AssetRef& ref) {
+		if (Part* part = getPart(ref)) {
+			for (const auto& mode : part->modes) {
+				for (const auto& frame : mode.frames) {
+					if (frame && !keptImages.contains(frame.get())) resetImageCache(frame.get());
+				}
+			}
+		}
+	};
+
+	for (const AssetRef& ref : reload.updated + reload.inserted) {
+		resetPartImages(ref);
+		if (!assetFromJson(ref, fileAssets.value(ref), imageMap)) {
+			importLog.append("Couldn't reload asset " + QString::number(ref.id));
+		}
+	}
+	for (const AssetRef& ref : reload.removed) {
+		resetPartImages(ref);
+		parts.remove(ref);
+		composites.remove(ref);
+		folders.remove(ref);
+		mSearchIndex->invalidate(ref);
+	}
+
+	mFileCrcs = crcs;
+	mFileAssets = fileAssets;
+	// NB: So they're still conflicts at the next reload
+	for (const AssetRef& ref : conflicts) mFileAssets.remove(ref);
+	*changes = reload;
+	return true;
+}
+
+ProjectSnapshot ProjectModel::snapshot() const {
+	TRACE_SCOPE("ProjectModel::snapshot");
+	ProjectSnapshot snapshot;
+	for (auto folder : folders) {
+		snapshot.folders.insert(folder->ref, QSharedPointer<Folder>::create(*folder));
+	}
+	for (auto part : parts) {
+		auto copy = QSharedPointer<Part>::create(*part);
+		for (auto& mode : copy->modes) {
+			for (auto& frame : mode.frames) {
+				if (!frame) continue;
+				auto cacheIt = mImageCache.find(frame.get());
+				frame = QSharedPointer<QImage>::create(*frame);
+				if (cacheIt != mImageCache.end()) {
+					snapshot.pngFiles.insert(frame.get(), cacheIt.value());
+				}
+			}
+		}
+		snapshot.parts.insert(part->ref, copy);
+	}
+	for (auto comp : composites) {
+		snapshot.composites.insert(comp->ref, QSharedPointer<Composite>::create(*comp));
+	}
+	for (const auto& library : mLibraries) {
+		snapshot.libraries.insert(library->name, library->fileName);
+	}
+	snapshot.libraryParts = libraryPartIds();
+	return snapshot;
+}
+
+bool ProjectModel::WriteSnapshot(const ProjectSnapshot& snapshot, const QString& fileName, QList<QString>* log,
+	const std::function<void(int, int)>& progress) {
+	TRACE_SCOPE("ProjectModel::WriteSnapshot");
 	const QDir tempDir { QDir::tempPath() }; // tempPath() takes some time so do it once
 
 	QMap<QString, QSharedPointer<QImage>> imageMap;
 	QMap<QString, QString> fileMap;
 
+	// Everything but the cached pngs is only needed until the zip is written
+	QList<QString> tempFiles;
+	struct RemoveTempFiles {
+		QList<QString>& files;
+		~RemoveTempFiles() { for (const auto& file : files) QFile::remove(file); }
+	} removeTempFiles { tempFiles };
+
 	{
 		QJsonObject data;
 		data.insert("version", ProjectFileVersion);
 
 		QJsonArray foldersArray;
-		for (auto folder : folders) {
+		for (auto folder : snapshot.folders) {
 			QJsonObject folderObject;
 			folderObject.insert("id", folder->ref.id);
 			folderToJson(folder->name, *folder, &folderObject);
@@ -308,31 +726,42 @@ bool ProjectModel::save(const QString& fileName) {
 		data.insert("folders", foldersArray);
 
 		QJsonArray partsArray;
-		for (auto part : parts) {
+		for (auto part : snapshot.parts) {
 			QJsonObject partObject;
 			partObject.insert("id", part->ref.id);
-			partToJson(part->name, *part, &partObject, &imageMap);
+			partToJson(snapshot.folders, part->name, *part, &partObject, &imageMap);
 			partsArray.append(partObject);
 		}
 		data.insert("parts", partsArray);
 
 		QJsonArray compArray;
-		for (auto comp: composites) {
+		for (auto comp: snapshot.composites) {
 			QJsonObject compObject;
 			compObject.insert("id", comp->ref.id);
-			compositeToJson(comp->name, *comp, &compObject);
+			compositeToJson(comp->name, *comp, snapshot.libraryParts, &compObject);
 			compArray.append(compObject);
 		}
 		data.insert("comps", compArray);
 
+		// NB: Only where the libraries are, their parts are never saved with the project
+		const QDir projectDir = QFileInfo(fileName).absoluteDir();
+		QJsonArray libraryArray;
+		for (auto it = snapshot.libraries.begin(); it != snapshot.libraries.end(); ++it) {
+			QJsonObject libraryObject;
+			libraryObject.insert("name", it.key());
+			libraryObject.insert("file", projectDir.relativeFilePath(it.value()));
+			libraryArray.append(libraryObject);
+		}
+		if (!libraryArray.isEmpty()) data.insert("libraries", libraryArray);
+
 		QString pathTemplate = tempDir.absoluteFilePath("data.XXXXXX.json");
 		QTemporaryFile file(pathTemplate);
 		if (!file.open()){
-			exportLog.append("Couldn't create temporary file " + pathTemplate);
+			log->append("Couldn't create temporary file " + pathTemplate);
 			return false;
 		}
 		file.setAutoRemove(false);
-		mJunkFiles.append(file.fileName());
+		tempFiles.append(file.fileName());
 
 		QTextStream out(&file);
 		QJsonDocument doc(data);
@@ -340,21 +769,26 @@ bool ProjectModel::save(const QString& fileName) {
 		fileMap.insert("data.json", file.fileName());
 	}
 
+	// One step per image and one for the zip
+	const int numSteps = imageMap.size() + 1;
+	int step = 0;
+	if (progress) progress(step, numSteps);
+
 	{
 		for (auto it = imageMap.begin(); it != imageMap.end(); ++it) {
 			auto img = it.value();
+			if (progress) progress(++step, numSteps);
 			if (img) {
 				
 				bool res = false;
 
-				QString fileName;
-				auto cacheIt = mImageCache.find(img.get());
-				if (cacheIt != mImageCache.end()) {
+				QString fileName = snapshot.pngFiles.value(img.get());
+				if (!fileName.isEmpty() && QFile::exists(fileName)) {
 					res = true;
-					fileName = cacheIt.value();
 				}
 
 				if (!res){
+					TRACE_SCOPE("Encode PNG");
 					auto imageName = it.key();
 					imageName.replace(' ', '_');
 					imageName.replace('/', '-');
@@ -362,11 +796,11 @@ bool ProjectModel::save(const QString& fileName) {
 					QString pathTemplate = tempDir.absoluteFilePath(imageName + "-XXXXXX.png");
 					QTemporaryFile file(pathTemplate);
 					if (!file.open()) {
-						exportLog.append("Couldn't create temporary file: " + pathTemplate);
+						log->append("Couldn't create temporary file: " + pathTemplate);
 						return false;
 					}
 					file.setAutoRemove(false);
-					mJunkFiles.append(file.fileName());
+					tempFiles.append(file.fileName());
 					fileName = file.fileName();
 					res = img->save(&file, "PNG");
 				}
@@ -375,18 +809,24 @@ bool ProjectModel::save(const QString& fileName) {
 					fileMap.insert(it.key(), fileName);
 				}
 				else {
-					exportLog.append("Couldn't save image " + it.key());
+					log->append("Couldn't save image " + it.key());
 				}
 			}
 		}
 	}
 
 	{
-		QDir tempPath = QDir(QDir::tempPath());
-		QString tempFileName = tempPath.absoluteFilePath("tmp.mqs");
+		// NB: Saves on different threads mustn't share a zip
+		QTemporaryFile zipFile(tempDir.absoluteFilePath("project-XXXXXX.mqs"));
+		if (!zipFile.open()) {
+			log->append("Couldn't create temporary file for the zip!");
+			return false;
+		}
+		const QString tempFileName = zipFile.fileName();
+		zipFile.close();
 		bool success = WriteZip(tempFileName, fileMap);
 		if (!success) {
-			exportLog.append("Couldn't write zip!");
+			log->append("Couldn't write zip!");
 			return false;
 		}
 		if (QFile::exists(fileName)){
@@ -395,12 +835,107 @@ bool ProjectModel::save(const QString& fileName) {
 		QFile::copy(tempFileName, fileName);	
 	}
 
-	this->fileName = fileName;
+	if (progress) progress(numSteps, numSteps);
 	return true;
 }
 
-bool ProjectModel::exportSimple(const QString& directoryName) {
-	
+// Calls fn on every frame object in a "parts" array
+static void ForEachFrame(QJsonArray* partsArray, std::function<void(QJsonObject*)> fn) {
+	for (int i = 0; i < partsArray->size(); i++) {
+		QJsonObject partObject = partsArray->at(i).toObject();
+		QJsonArray modeArray = partObject.value("modes").toArray();
+		for (int m = 0; m < modeArray.size(); m++) {
+			QJsonObject modeObject = modeArray.at(m).toObject();
+			QJsonArray frameArray = modeObject.value("frames").toArray();
+			for (int f = 0; f < frameArray.size(); f++) {
+				QJsonObject frameObject = frameArray.at(f).toObject();
+				fn(&frameObject);
+				frameArray.replace(f, frameObject);
+			}
+			modeObject.insert("frames", frameArray);
+			modeArray.replace(m, modeObject);
+		}
+		partObject.insert("modes", modeArray);
+		partsArray->replace(i, partObject);
+	}
+}
+
+// The smallest rect containing all the non-transparent pixels (null if there are none)
+static QRect OpaqueBounds(const QImage& img) {
+	const QImage image = img.convertToFormat(QImage::Format_ARGB32);
+	int left = image.width(), right = -1, top = image.height(), bottom = -1;
+	for (int y = 0; y < image.height(); y++) {
+		const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+		for (int x = 0; x < image.width(); x++) {
+			if (qAlpha(line[x]) != 0) {
+				left = std::min(left, x);
+				right = std::max(right, x);
+				top = std::min(top, y);
+				bottom = y;
+			}
+		}
+	}
+	return right == -1 ? QRect() : QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+// Replaces every frame image with a copy trimmed to its opaque bounds.
+// Anchors and pivots are shifted into the trimmed image and the frame gets
+// trimX, trimY (the offset of the trimmed image) and originalWidth, originalHeight.
+static void TrimFrames(QJsonArray* partsArray, QMap<QString, QSharedPointer<QImage>>* imageMap) {
+	ForEachFrame(partsArray, [&](QJsonObject* frameObject) {
+		auto it = imageMap->find(frameObject->value("image").toString());
+		if (it == imageMap->end() || !it.value()) return;
+
+		const QImage& image = *it.value();
+		QRect bounds = OpaqueBounds(image);
+		if (bounds.isNull()) bounds = QRect(0, 0, 1, 1); // Keep a single pixel of empty frames
+		if (bounds != image.rect()) {
+			it.value() = QSharedPointer<QImage>::create(image.copy(bounds));
+		}
+
+		frameObject->insert("trimX", bounds.x());
+		frameObject->insert("trimY", bounds.y());
+		frameObject->insert("originalWidth", image.width());
+		frameObject->insert("originalHeight", image.height());
+		frameObject->insert("ax", frameObject->value("ax").toInt() - bounds.x());
+		frameObject->insert("ay", frameObject->value("ay").toInt() - bounds.y());
+		for (int p = 0; p < Part::MaxPivots; p++) {
+			const QString px = QString("p%1x").arg(p), py = QString("p%1y").arg(p);
+			if (frameObject->contains(px)) frameObject->insert(px, frameObject->value(px).toInt() - bounds.x());
+			if (frameObject->contains(py)) frameObject->insert(py, frameObject->value(py).toInt() - bounds.y());
+		}
+	});
+}
+
+// exportSimple keeps the content hash of every file it writes here, so the next
+// export only rewrites what changed and removes what it no longer exports
+static const char* ExportManifestName = "export_manifest.json";
+
+static QString ImageHash(const QImage& img) {
+	const QImage image = img.convertToFormat(QImage::Format_ARGB32);
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(QString("%1x%2").arg(image.width()).arg(image.height()).toLatin1());
+	for (int y = 0; y < image.height(); y++) {
+		hash.addData(reinterpret_cast<const char*>(image.constScanLine(y)), image.width() * 4);
+	}
+	return QString::fromLatin1(hash.result().toHex());
+}
+
+static QMap<QString, QString> LoadExportManifest(const QDir& exportDir) {
+	QMap<QString, QString> manifest;
+	QFile file(exportDir.absoluteFilePath(ExportManifestName));
+	if (file.open(QFile::OpenModeFlag::ReadOnly)) {
+		const QJsonObject files = QJsonDocument::fromJson(file.readAll()).object().value("files").toObject();
+		for (auto it = files.begin(); it != files.end(); ++it) {
+			manifest.insert(it.key(), it.value().toString());
+		}
+	}
+	return manifest;
+}
+
+bool ProjectModel::exportSimple(const QString& directoryName, bool trim) {
+	TRACE_SCOPE("ProjectModel::exportSimple");
+
 	const QDir exportDir { directoryName };
 	if (!exportDir.exists()) {
 		exportLog.append("Export requires a directory!");
@@ -410,6 +945,13 @@ bool ProjectModel::exportSimple(const QString& directoryName) {
 	
 	QMap<QString, QSharedPointer<QImage>> imageMap;
 	QMap<QString, QString> fileMap;
+	const QMap<QString, QString> oldManifest = LoadExportManifest(exportDir);
+	QMap<QString, QString> manifest;
+
+	// Skip files that are already exported with the same content
+	auto unchanged = [&](const QString& fileName, const QString& hash) {
+		return oldManifest.value(fileName) == hash && QFile::exists(exportDir.absoluteFilePath(fileName));
+	};
 
 	{
 		QJsonObject data;
@@ -428,35 +970,47 @@ bool ProjectModel::exportSimple(const QString& directoryName) {
 		for (auto part : parts) {
 			QJsonObject partObject;
 			partObject.insert("id", part->ref.id);
-			partToJson(part->name, *part, &partObject, &imageMap);
+			partToJson(folders, part->name, *part, &partObject, &imageMap);
 			partsArray.append(partObject);
 		}
+		if (trim) {
+			TrimFrames(&partsArray, &imageMap);
+		}
 		data.insert("parts", partsArray);
 
 		if (composites.size() > 0) {
 			exportLog.append("Simple export doesn't export composites.");
 		}
 
-		QString dataJsonFilename = exportDir.absoluteFilePath("data.json");
-		QFile file(dataJsonFilename);
-		if (!file.open(QFile::OpenModeFlag::WriteOnly)) {
-			exportLog.append("Couldn't create file " + dataJsonFilename);
-			return false;
+		const QByteArray json = QJsonDocument(data).toJson();
+		const QString jsonHash = QString::fromLatin1(QCryptographicHash::hash(json, QCryptographicHash::Sha1).toHex());
+		if (!unchanged("data.json", jsonHash)) {
+			QString dataJsonFilename = exportDir.absoluteFilePath("data.json");
+			QFile file(dataJsonFilename);
+			if (!file.open(QFile::OpenModeFlag::WriteOnly)) {
+				exportLog.append("Couldn't create file " + dataJsonFilename);
+				return false;
+			}
+			file.write(json);
 		}
-		QTextStream out(&file);
-		QJsonDocument doc(data);
-		out << doc.toJson();
+		manifest.insert("data.json", jsonHash);
 	}
 
 	{
 		for (auto it = imageMap.begin(); it != imageMap.end(); ++it) {
 			auto img = it.value();
 			if (img) {
-				bool res = false;
 				auto imageName = it.key();
 				imageName.replace(' ', '_');
 				// imageName.replace('/', '-');
-				QString imageFilename = exportDir.absoluteFilePath(imageName + ".png");
+				imageName += ".png";
+				const QString hash = ImageHash(*img);
+				if (unchanged(imageName, hash)) {
+					manifest.insert(imageName, hash);
+					continue;
+				}
+
+				QString imageFilename = exportDir.absoluteFilePath(imageName);
 				QFile file(imageFilename);
 				if (!file.open(QFile::OpenModeFlag::WriteOnly)) {
 					exportLog.append("Couldn't create file: " + imageFilename);
@@ -465,9 +1019,157 @@ bool ProjectModel::exportSimple(const QString& directoryName) {
 				if (!img->save(&file, "PNG")) {
 					exportLog.append("Couldn't save image " + it.key());
 				}
+				else {
+					manifest.insert(imageName, hash);
+				}
 			}
 		}
 	}
+
+	// Remove files from the last export that aren't exported anymore
+	// NB: Only files in the manifest are removed, anything else in the directory is left alone
+	// NB: The manifest is read from disk, so skip any key that points outside the directory
+	const QString exportRoot = QDir::cleanPath(exportDir.absolutePath()) + "/";
+	for (auto it = oldManifest.begin(); it != oldManifest.end(); ++it) {
+		if (manifest.contains(it.key()) || QDir::isAbsolutePath(it.key())) continue;
+		const QString path = QDir::cleanPath(exportDir.absoluteFilePath(it.key()));
+		if (path.startsWith(exportRoot)) {
+			QFile::remove(path);
+		}
+	}
+
+	{
+		QJsonObject files;
+		for (auto it = manifest.begin(); it != manifest.end(); ++it) {
+			files.insert(it.key(), it.value());
+		}
+		QJsonObject manifestObject;
+		manifestObject.insert("version", 1);
+		manifestObject.insert("files", files);
+
+		QString manifestFilename = exportDir.absoluteFilePath(ExportManifestName);
+		QFile file(manifestFilename);
+		if (!file.open(QFile::OpenModeFlag::WriteOnly)) {
+			exportLog.append("Couldn't create file " + manifestFilename);
+			return false;
+		}
+		file.write(QJsonDocument(manifestObject).toJson());
+	}
+	return true;
+}
+
+// Like exportSimple, but packs all the frames into a few texture atlas pages.
+// Identical frames share one rect. Writes atlas.json and atlas_N.png.
+bool ProjectModel::exportAtlas(const QString& directoryName, const AtlasSettings& settings) {
+	TRACE_SCOPE("ProjectModel::exportAtlas");
+	const QDir exportDir { directoryName };
+	if (!exportDir.exists()) {
+		exportLog.append("Export requires a directory!");
+		return false;
+	}
+
+	QMap<QString, QSharedPointer<QImage>> imageMap;
+	QJsonObject data;
+	data.insert("version", ProjectFileVersion);
+
+	QJsonArray foldersArray;
+	for (auto folder : folders) {
+		QJsonObject folderObject;
+		folderObject.insert("id", folder->ref.id);
+		folderToJson(folder->name, *folder, &folderObject);
+		foldersArray.append(folderObject);
+	}
+	data.insert("folders", foldersArray);
+
+	QJsonArray partsArray;
+	for (auto part : parts) {
+		QJsonObject partObject;
+		partObject.insert("id", part->ref.id);
+		partToJson(folders, part->name, *part, &partObject, &imageMap);
+		partsArray.append(partObject);
+	}
+
+	if (composites.size() > 0) {
+		exportLog.append("Atlas export doesn't export composites.");
+	}
+
+	if (settings.trim) {
+		TrimFrames(&partsArray, &imageMap);
+	}
+
+	// Find the unique images
+	QList<QImage> uniqueImages;
+	QMultiHash<uint, int> uniqueByHash;
+	QMap<QString, int> imageIndex;
+	for (auto it = imageMap.begin(); it != imageMap.end(); ++it) {
+		if (!it.value()) continue;
+		const QImage image = it.value()->convertToFormat(QImage::Format_ARGB32);
+		const uint hash = qHash(QByteArray::fromRawData(reinterpret_cast<const char*>(image.constBits()), image.byteCount())) ^ qHash(image.width());
+		int index = -1;
+		for (auto hit = uniqueByHash.find(hash); hit != uniqueByHash.end() && hit.key() == hash; ++hit) {
+			if (uniqueImages.at(hit.value()) == image) {
+				index = hit.value();
+				break;
+			}
+		}
+		if (index == -1) {
+			index = uniqueImages.size();
+			uniqueImages.append(image);
+			uniqueByHash.insert(hash, index);
+		}
+		imageIndex.insert(it.key(), index);
+	}
+
+	QList<QSize> sizes;
+	for (const QImage& image : uniqueImages) sizes.append(image.size());
+	QList<AtlasPlacement> placements;
+	QList<QSize> pageSizes;
+	if (!PackAtlas(sizes, settings, &placements, &pageSizes, &exportLog)) {
+		return false;
+	}
+
+	// Replace the image of each frame with its rect
+	ForEachFrame(&partsArray, [&](QJsonObject* frameObject) {
+		const int index = imageIndex.value(frameObject->take("image").toString(), -1);
+		if (index != -1) {
+			const AtlasPlacement& placement = placements.at(index);
+			const QSize& pageSize = pageSizes.at(placement.page);
+			frameObject->insert("page", placement.page);
+			frameObject->insert("x", placement.rect.x());
+			frameObject->insert("y", placement.rect.y());
+			frameObject->insert("w", placement.rect.width());
+			frameObject->insert("h", placement.rect.height());
+			frameObject->insert("u0", (double) placement.rect.x() / pageSize.width());
+			frameObject->insert("v0", (double) placement.rect.y() / pageSize.height());
+			frameObject->insert("u1", (double) (placement.rect.x() + placement.rect.width()) / pageSize.width());
+			frameObject->insert("v1", (double) (placement.rect.y() + placement.rect.height()) / pageSize.height());
+		}
+	});
+	data.insert("parts", partsArray);
+
+	QJsonArray pagesArray;
+	for (int page = 0; page < pageSizes.size(); page++) {
+		QJsonObject pageObject;
+		pageObject.insert("image", QString("atlas_%1.png").arg(page));
+		pageObject.insert("width", pageSizes.at(page).width());
+		pageObject.insert("height", pageSizes.at(page).height());
+		pagesArray.append(pageObject);
+	}
+	data.insert("pages", pagesArray);
+
+	if (!WriteAtlasPages(uniqueImages, placements, pageSizes, exportDir.absolutePath(), "atlas", &exportLog)) {
+		return false;
+	}
+
+	QString dataJsonFilename = exportDir.absoluteFilePath("atlas.json");
+	QFile file(dataJsonFilename);
+	if (!file.open(QFile::OpenModeFlag::WriteOnly)) {
+		exportLog.append("Couldn't create file " + dataJsonFilename);
+		return false;
+	}
+	QTextStream out(&file);
+	QJsonDocument doc(data);
+	out << doc.toJson();
 	return true;
 }
 
@@ -487,6 +1189,69 @@ void ProjectModel::folderToJson(const QString& name, const Folder& folder, QJson
     }
 }
 
+static const PropertiesCache& ParsePropertiesText(const QString& properties, PropertiesCache* cache) {
+	if (!cache->parsed) {
+		TRACE_SCOPE("ParseProperties");
+		cache->parsed = true;
+		cache->object = QJsonObject();
+		cache->error.clear();
+		if (!properties.trimmed().isEmpty()) {
+			QJsonParseError error;
+			auto doc = QJsonDocument::fromJson(("{" + properties + "}").toUtf8(), &error);
+			if (doc.isNull()) cache->error = error.errorString();
+			else if (!doc.isObject()) cache->error = "Not a JSON object";
+			else cache->object = doc.object();
+		}
+	}
+	return *cache;
+}
+
+static const QString& FormatPropertiesText(QString* properties, PropertiesCache* cache) {
+	if (!cache->formatted) {
+		cache->formatted = true;
+		// NB: Leave invalid properties as they are so they can be fixed
+		if (ParsePropertiesText(*properties, cache).error.isEmpty()) {
+			QString text = QString(QJsonDocument(cache->object).toJson(QJsonDocument::JsonFormat::Indented));
+			int start = text.indexOf("{");
+			int end = text.lastIndexOf("}");
+			text = text.mid(start + 1, end - (start + 1));
+			auto plist = text.split("\n");
+			for (auto& s : plist) {
+				if (s.startsWith("    ")) s = s.mid(4);
+			}
+			*properties = plist.join("\n").trimmed();
+		}
+	}
+	return *properties;
+}
+
+// Just strips the braces, the properties are parsed and formatted when they're needed
+static void ImportProperties(const QString& properties, QString* target, PropertiesCache* cache) {
+	QString text = properties.trimmed();
+	if (text.startsWith("{") && text.endsWith("}")) {
+		text = text.mid(1, text.length() - 2).trimmed();
+	}
+	*target = text;
+	*cache = PropertiesCache();
+	cache->formatted = false;
+}
+
+const PropertiesCache& ParseProperties(Part* part) {
+	return ParsePropertiesText(part->properties, &part->propertiesCache);
+}
+
+const PropertiesCache& ParseProperties(Composite* comp) {
+	return ParsePropertiesText(comp->properties, &comp->propertiesCache);
+}
+
+const QString& FormattedProperties(Part* part) {
+	return FormatPropertiesText(&part->properties, &part->propertiesCache);
+}
+
+const QString& FormattedProperties(Composite* comp) {
+	return FormatPropertiesText(&comp->properties, &comp->propertiesCache);
+}
+
 void ProjectModel::jsonToPart(const QJsonObject& obj, const QMap<QString,QSharedPointer<QImage>>& imageMap, Part* part){
 	part->name = obj["name"].toString();
 
@@ -496,7 +1261,7 @@ void ProjectModel::jsonToPart(const QJsonObject& obj, const QMap<QString,QShared
     }
 
 	if (obj.contains("properties")) {
-		part->properties = importAndFormatProperties(part->name, obj["properties"].toString());
+		ImportProperties(obj["properties"].toString(), &part->properties, &part->propertiesCache);
 	}
 
 	const auto& modeArray = obj["modes"].toArray();
@@ -551,16 +1316,16 @@ void ProjectModel::jsonToPart(const QJsonObject& obj, const QMap<QString,QShared
     }
 }
 
-static void BuildFolderList(ProjectModel* pm, Folder& folder, QStringList& list) {
+static void BuildFolderList(const QMap<AssetRef, QSharedPointer<Folder>>& folders, const Folder& folder, QStringList& list) {
 	if (!folder.parent.isNull()) {
-		Q_ASSERT(pm->getFolder(folder.parent) != nullptr);
-		BuildFolderList(pm, *pm->getFolder(folder.parent), list);
+		Q_ASSERT(folders.contains(folder.parent));
+		BuildFolderList(folders, *folders.value(folder.parent), list);
 	}
 
 	list.append(folder.name);
 }
 
-void ProjectModel::partToJson(const QString& name, const Part& part, QJsonObject* obj, QMap<QString, QSharedPointer<QImage>>* imageMap){
+void ProjectModel::partToJson(const QMap<AssetRef, QSharedPointer<Folder>>& folders, const QString& name, const Part& part, QJsonObject* obj, QMap<QString, QSharedPointer<QImage>>* imageMap){
     auto properties = part.properties.trimmed();
     if (!properties.isEmpty()){
         obj->insert("properties", "{ " + properties + " }");
@@ -569,9 +1334,9 @@ void ProjectModel::partToJson(const QString& name, const Part& part, QJsonObject
     QString imageNamePrefix = name;
 	imageNamePrefix.append(" " + QString::number(part.ref.id)); // Append id to ensure uniqueness
 	if (!part.parent.isNull()) {
-		Q_ASSERT(getFolder(part.parent) != nullptr);
+		Q_ASSERT(folders.contains(part.parent));
 		QStringList list;
-		BuildFolderList(this, *getFolder(part.parent), list);		
+		BuildFolderList(folders, *folders.value(part.parent), list);		
 		imageNamePrefix.prepend(list.join("_").append("_"));
 	}
 	imageNamePrefix.replace(' ', '_');
@@ -618,7 +1383,7 @@ void ProjectModel::partToJson(const QString& name, const Part& part, QJsonObject
 	obj->insert("modes", modeArray);
 }
 
-void ProjectModel::compositeToJson(const QString& name, const Composite& comp, QJsonObject* obj){
+void ProjectModel::compositeToJson(const QString& name, const Composite& comp, const QMap<AssetRef, LibraryPartId>& libraryParts, QJsonObject* obj){
     obj->insert("root", comp.root);
     obj->insert("name", name);
 
@@ -644,7 +1409,14 @@ void ProjectModel::compositeToJson(const QString& name, const Composite& comp, Q
 		childObject.insert("index", index++);
 		if (!child.part.isNull()) {
 			Q_ASSERT(child.part.type == AssetType::Part);
-			childObject.insert("part", child.part.id);
+			auto library = libraryParts.constFind(child.part);
+			if (library != libraryParts.constEnd()) {
+				childObject.insert("library", library->library);
+				childObject.insert("part", library->id);
+			}
+			else {
+				childObject.insert("part", child.part.id);
+			}
 		}
         QJsonArray children;
         for(int ci: child.children){
@@ -661,7 +1433,7 @@ void ProjectModel::jsonToComposite(const QJsonObject& obj, Composite* comp){
     comp->name = obj["name"].toString();
 
 	if (obj.contains("properties")) {
-		comp->properties = importAndFormatProperties(comp->name, obj["properties"].toString());
+		ImportProperties(obj["properties"].toString(), &comp->properties, &comp->propertiesCache);
 	}
 
     if (obj.contains("parent")){
@@ -681,7 +1453,14 @@ void ProjectModel::jsonToComposite(const QJsonObject& obj, Composite* comp){
         child.parent = childObject.value("parent").toInt();
         child.parentPivot = childObject.value("parentPivot").toInt();
         child.z = childObject.value("z").toInt();
-		if (childObject.contains("part")) {
+		if (childObject.contains("library")) {
+			const QString library = childObject.value("library").toString();
+			child.part = libraryRef(library, childObject.value("part").toInt());
+			if (child.part.isNull()) {
+				importLog.append(name + " refers to a missing sprite in library " + library);
+			}
+		}
+		else if (childObject.contains("part")) {
 			child.part.id = childObject.value("part").toInt();
 			child.part.type = AssetType::Part;
 		}
@@ -704,35 +1483,6 @@ void ProjectModel::jsonToComposite(const QJsonObject& obj, Composite* comp){
     }
 }
 
-QString ProjectModel::importAndFormatProperties(const QString& assetName, const QString& properties_) {
-	auto properties = properties_;
-	properties = properties.trimmed();
-	if (!properties.isEmpty()) {
-		auto doc = QJsonDocument::fromJson(properties.toUtf8());
-		if (doc.isNull()) {
-			importLog.push_back("Error reading properties of " + assetName + " (Couldn't parse JSON)");
-		}
-		else if (!doc.isObject()) {
-			importLog.push_back("Error reading properties of " + assetName + " (Not a JSON object)");
-		}
-		else {
-			properties = QString(doc.toJson(QJsonDocument::JsonFormat::Indented));
-			int start = properties.indexOf("{");
-			int end = properties.lastIndexOf("}");
-			if (start == -1 || end == -1) {
-				importLog.push_back("Properties of " + assetName + " were not surrounded by curly braces!");
-			}
-			properties = properties.mid(start + 1, end - (start + 1));
-			auto plist = properties.split("\n");
-			for (auto& s : plist) {
-				if (s.startsWith("    ")) s = s.mid(4);
-			}
-			properties = plist.join("\n").trimmed();
-		}
-	}
-	return properties;
-}
-
 void ProjectModel::clearImageCache() {
 	for (auto it = mImageCache.begin(); it != mImageCache.end(); ++it) {
 		if (QFile::exists(it.value())) {
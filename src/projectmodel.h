@@ -8,13 +8,18 @@
 #include <QPoint>
 #include <QJsonObject>
 #include <QSharedPointer>
+#include <QScopedPointer>
+#include <functional>
 
+#include "atlas.h"
 
 
 struct Asset;
 struct Part;
 struct Composite;
 struct Folder;
+struct Library;
+class AssetIndex;
 
 struct Preferences {
 	QColor backgroundColour { 255, 255, 255, 255 };
@@ -30,6 +35,9 @@ struct Preferences {
 	float dropShadowOffsetV = 0.3f;
 	bool showOnionSkinning	= false;
 	float onionSkinningOpacity = 0.2f;
+	bool trimOnExport		= false;
+	bool recordTrace		= false; // see trace.h
+	bool showPerformanceOverlay = false; // see viewstats.h
 };
 
 Preferences& GlobalPreferences();
@@ -57,6 +65,33 @@ uint qHash(const AssetRef &key);
 class ProjectModel;
 ProjectModel* PM();
 
+// A part of a library, by the ids saved in project files (see Library)
+struct LibraryPartId {
+    QString library;
+    int id = -1; // in the library file
+};
+
+// A copy of the project for saving on another thread (see ProjectModel::snapshot)
+// Taking one is cheap: the assets are copied, but each frame is a new QImage that shares
+// its pixels with the original until the original is drawn on, so no pixels are copied
+// and later edits to the project don't affect the snapshot.
+struct ProjectSnapshot {
+    QMap<AssetRef, QSharedPointer<Folder>> folders;
+    QMap<AssetRef, QSharedPointer<Part>> parts;
+    QMap<AssetRef, QSharedPointer<Composite>> composites;
+    QMap<const QImage*, QString> pngFiles; // frames that are already in the temp dir as pngs
+    QMap<QString, QString> libraries; // name -> file
+    QMap<AssetRef, LibraryPartId> libraryParts;
+};
+
+// The assets that ProjectModel::reloadChanges replaced
+struct ProjectReload {
+    QList<AssetRef> inserted;
+    QList<AssetRef> updated;
+    QList<AssetRef> removed;
+    bool isEmpty() const { return inserted.isEmpty() && updated.isEmpty() && removed.isEmpty(); }
+};
+
 // ProjectModel stores the static data of a project.
 // Access global instance with PM()
 class ProjectModel
@@ -71,10 +106,29 @@ public:
 	void clear();
 	bool load(const QString& fileName, QString& reason);
 	bool save(const QString& fileName);
-	bool exportSimple(const QString& directoryName);
+	// Re-reads only the assets whose json or images changed in the project file since it was loaded or saved
+	// (found by comparing the CRCs of the entries in the zip). Other assets are left as they are.
+	bool reloadChanges(QString& reason, ProjectReload* changes);
+	bool hasFileChanged() const;
+	// Call when the project matches fileName again, e.g., after WriteSnapshot saved it (see reloadChanges)
+	void readFileState(const QString& fileName);
+	// Take a snapshot on the main thread, then write it with WriteSnapshot on any thread
+	// progress (if set) is called on the writing thread with the number of steps done and the total
+	ProjectSnapshot snapshot() const;
+	static bool WriteSnapshot(const ProjectSnapshot& snapshot, const QString& fileName, QList<QString>* log,
+		const std::function<void(int, int)>& progress = nullptr);
+	// Only rewrites files that changed since the last export to directoryName (see export_manifest.json)
+	bool exportSimple(const QString& directoryName, bool trim = false);
+	bool exportAtlas(const QString& directoryName, const AtlasSettings& settings);
 
     AssetRef createAssetRef(AssetType type = AssetType::None);
 
+	// A single asset in the save format (e.g., for the journal, see journal.h)
+	// The frames of a part are added to imageMap
+	QJsonObject assetToJson(const AssetRef& ref, QMap<QString, QSharedPointer<QImage>>* imageMap);
+	// Adds or replaces an asset. Returns false if an image is missing from imageMap.
+	bool assetFromJson(const AssetRef& ref, const QJsonObject& obj, const QMap<QString, QSharedPointer<QImage>>& imageMap);
+
     // Access assets
     Asset* getAsset(const AssetRef& ref);
     bool hasAsset(const AssetRef& ref);
@@ -93,9 +147,20 @@ public:
     Composite* findCompositeByName(const QString& name);
     Folder* findFolderByName(const QString& name);
 
+	// Mounts another project file as a read-only library of parts (see Library)
+	// name is how the project refers to it, by default the base name of the file
+	bool mountLibrary(const QString& fileName, QString& reason, QString name = QString());
+	const QList<QSharedPointer<Library>>& libraries() const { return mLibraries; }
+	static bool IsLibraryRef(const AssetRef& ref) { return ref.type == AssetType::Part && ref.id < 0; }
+	// NB: Library parts are named "library/part"
+	AssetRef findLibraryPart(const QString& name) const;
+
 	// Call this if a qimage changes
 	void resetImageCache(QImage*);
 
+	// Search by name, mode and properties (see assetindex.h)
+	AssetIndex* searchIndex();
+
     // Direct access (be careful!)
     QMap<AssetRef, QSharedPointer<Part>> parts;
     QMap<AssetRef, QSharedPointer<Composite>> composites;
@@ -115,15 +180,47 @@ private:
 	QMap<QImage*, QString> mImageCache; 
 	QList<QString> mJunkFiles;
 
+	// The project file as it was loaded or saved (see reloadChanges)
+	QMap<QString, quint32> mFileCrcs;
+	QMap<AssetRef, QJsonObject> mFileAssets;
+
+	QScopedPointer<AssetIndex> mSearchIndex;
+
+	QList<QSharedPointer<Library>> mLibraries;
+	int mNextLibraryId = -1; // NB: Library parts have negative ids so they never clash with the project's
+
 protected:
     void jsonToFolder(const QJsonObject& obj, Folder* folder);
-    void folderToJson(const QString& name, const Folder& folder, QJsonObject* obj);
+    static void folderToJson(const QString& name, const Folder& folder, QJsonObject* obj);
     void jsonToPart(const QJsonObject& obj, const QMap<QString, QSharedPointer<QImage>>& imageMap, Part* part);
-    void partToJson(const QString& name, const Part& part, QJsonObject* obj, QMap<QString,QSharedPointer<QImage>>* imageMap);
-    void compositeToJson(const QString& name, const Composite& comp, QJsonObject* obj);
+    static void partToJson(const QMap<AssetRef, QSharedPointer<Folder>>& folders, const QString& name, const Part& part, QJsonObject* obj, QMap<QString,QSharedPointer<QImage>>* imageMap);
+    static void compositeToJson(const QString& name, const Composite& comp, const QMap<AssetRef, LibraryPartId>& libraryParts, QJsonObject* obj);
     void jsonToComposite(const QJsonObject& obj, Composite* comp);
-	QString importAndFormatProperties(const QString& assetName, const QString& properties);
 	void clearImageCache();
+	Part* loadLibraryPart(const AssetRef& ref);
+	AssetRef libraryRef(const QString& library, int id) const;
+	QMap<AssetRef, LibraryPartId> libraryPartIds() const;
+};
+
+// A project file mounted read-only so its parts can be used by the composites of other projects.
+// Only its data.json is read when it's mounted; the images of a part are loaded the first time
+// the part is used (see ProjectModel::getPart). Its parts are never saved with the project,
+// the project only saves the file of the library and the library ids of the parts it uses.
+struct Library {
+	QString name;
+	QString fileName;
+	QMap<int, AssetRef> refs; // id in the library file -> ref in the project
+	QMap<QString, AssetRef> names;
+	QMap<AssetRef, QJsonObject> unloaded; // parts that haven't been used yet
+	QMap<AssetRef, QSharedPointer<Part>> parts;
+};
+
+// Properties are the contents of a JSON object, without the braces
+struct PropertiesCache {
+	bool parsed = false;
+	bool formatted = true; // false if loaded and not pretty printed yet
+	QJsonObject object;
+	QString error; // empty if the properties are a valid object
 };
 
 struct Asset {
@@ -157,6 +254,7 @@ struct Part: public Asset {
 
     QMap<QString,Mode> modes; // fourcc->mode
     QString properties;
+	PropertiesCache propertiesCache; // see ParseProperties
 };
 
 struct Composite: public Asset {
@@ -174,7 +272,16 @@ struct Composite: public Asset {
     QMap<QString, Child> childrenMap;
     QList<QString> children;
 	QString properties{};
+	PropertiesCache propertiesCache; // see ParseProperties
 };
 
+// Parses the properties once and caches them, until CChangePartProperties or CChangeCompProperties resets the cache
+const PropertiesCache& ParseProperties(Part* part);
+const PropertiesCache& ParseProperties(Composite* comp);
+
+// The properties for editing. Properties loaded from a file are pretty printed the first time.
+const QString& FormattedProperties(Part* part);
+const QString& FormattedProperties(Composite* comp);
+
 
 #endif // PROJECTMODEL_H
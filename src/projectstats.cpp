@@ -0,0 +1,190 @@
+#include "projectstats.h"
+#include "commands.h"
+#include "trace.h"
+
+#include <QBuffer>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QRunnable>
+#include <QSet>
+#include <QThreadPool>
+#include <QUndoStack>
+#include <QVector>
+
+namespace {
+
+struct PartResult {
+    QVector<uint> frameHashes;
+    QVector<qint64> compressedBytes;
+    QSet<QRgb> colours;
+};
+
+class PartStatsTask: public QRunnable {
+public:
+    PartStatsTask(const ProjectStatsSnapshot::PartData& part, PartResult* result)
+        :mPart(part), mResult(result){}
+
+    void run() override {
+        TRACE_SCOPE("PartStatsTask");
+        for (const QImage& frame: mPart.frames){
+            const QImage image = frame.convertToFormat(QImage::Format_ARGB32);
+            uint hash = qHash(image.width()) ^ (qHash(image.height()) << 1);
+            for (int y = 0; y < image.height(); y++){
+                const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+                hash = qHash(QByteArray::fromRawData(reinterpret_cast<const char*>(line), image.width() * 4), hash);
+                for (int x = 0; x < image.width(); x++){
+                    mResult->colours.insert(line[x]);
+                }
+            }
+            mResult->frameHashes.push_back(hash);
+
+            QByteArray png;
+            QBuffer buffer(&png);
+            buffer.open(QIODevice::WriteOnly);
+            frame.save(&buffer, "PNG");
+            mResult->compressedBytes.push_back(png.size());
+        }
+    }
+
+private:
+    const ProjectStatsSnapshot::PartData& mPart;
+    PartResult* mResult;
+};
+
+QJsonObject AssetStatsToJson(const AssetStats& stats){
+    QJsonObject obj;
+    obj.insert("name", stats.name);
+    obj.insert("frames", stats.numFrames);
+    obj.insert("duplicateFrames", stats.duplicateFrames);
+    obj.insert("uniqueColours", stats.uniqueColours);
+    obj.insert("decodedBytes", stats.decodedBytes);
+    obj.insert("compressedBytes", stats.compressedBytes);
+    return obj;
+}
+
+}
+
+ProjectStatsSnapshot TakeProjectStatsSnapshot(const QUndoStack* undoStack){
+    ProjectStatsSnapshot snapshot;
+    for (auto part: PM()->parts){
+        ProjectStatsSnapshot::PartData data {part->ref, part->parent, part->name, {}};
+        for (const Part::Mode& mode: part->modes){
+            for (const auto& img: mode.frames){
+                if (img) data.frames.append(*img);
+            }
+        }
+        snapshot.parts.append(data);
+    }
+    for (auto folder: PM()->folders){
+        snapshot.folders.append(ProjectStatsSnapshot::FolderData {folder->ref, folder->parent, folder->name});
+    }
+    if (undoStack){
+        for (int i = 0; i < undoStack->count(); i++){
+            const Command* command = dynamic_cast<const Command*>(undoStack->command(i));
+            if (command) snapshot.undoStackBytes += command->memoryBytes();
+        }
+    }
+    snapshot.fileName = PM()->fileName;
+    return snapshot;
+}
+
+ProjectStats ComputeProjectStats(const ProjectStatsSnapshot& snapshot){
+    TRACE_SCOPE("ComputeProjectStats");
+    QVector<PartResult> results(snapshot.parts.size());
+    {
+        QThreadPool pool;
+        for (int i = 0; i < snapshot.parts.size(); i++){
+            pool.start(new PartStatsTask(snapshot.parts.at(i), &results[i]));
+        }
+        pool.waitForDone();
+    }
+
+    ProjectStats stats;
+    stats.undoStackBytes = snapshot.undoStackBytes;
+    stats.fileBytes = snapshot.fileName.isEmpty() ? 0 : QFileInfo(snapshot.fileName).size();
+    stats.total.name = "Total";
+
+    QMap<AssetRef, int> folderIndex;
+    QMap<AssetRef, AssetRef> folderParent;
+    for (const auto& folder: snapshot.folders){
+        AssetStats folderStats;
+        folderStats.ref = folder.ref;
+        folderStats.name = folder.name;
+        folderIndex.insert(folder.ref, stats.folders.size());
+        folderParent.insert(folder.ref, folder.parent);
+        stats.folders.append(folderStats);
+    }
+    QVector<QSet<QRgb>> folderColours(stats.folders.size());
+    QSet<QRgb> totalColours;
+
+    // Frames are duplicates if they're identical to an earlier frame (in project order)
+    QHash<uint, QList<QImage>> seenFrames;
+    for (int i = 0; i < snapshot.parts.size(); i++){
+        const ProjectStatsSnapshot::PartData& part = snapshot.parts.at(i);
+        const PartResult& result = results.at(i);
+
+        AssetStats partStats;
+        partStats.ref = part.ref;
+        partStats.name = part.name;
+        partStats.numFrames = part.frames.size();
+        partStats.uniqueColours = result.colours.size();
+        for (int f = 0; f < part.frames.size(); f++){
+            const QImage& frame = part.frames.at(f);
+            partStats.decodedBytes += frame.byteCount();
+            partStats.compressedBytes += result.compressedBytes.at(f);
+
+            QList<QImage>& seen = seenFrames[result.frameHashes.at(f)];
+            bool duplicate = false;
+            for (const QImage& other: seen){
+                if (other.size() == frame.size() && other.convertToFormat(QImage::Format_ARGB32) == frame.convertToFormat(QImage::Format_ARGB32)){
+                    duplicate = true;
+                    break;
+                }
+            }
+            if (duplicate) partStats.duplicateFrames++;
+            else seen.append(frame);
+        }
+        stats.parts.append(partStats);
+
+        // Add the part to the total, its folder and all the folders above it
+        QList<AssetStats*> totals {&stats.total};
+        QList<QSet<QRgb>*> colourSets {&totalColours};
+        AssetRef folder = part.parent;
+        for (int depth = 0; !folder.isNull() && folderIndex.contains(folder) && depth <= stats.folders.size(); depth++){
+            const int index = folderIndex.value(folder);
+            totals.append(&stats.folders[index]);
+            colourSets.append(&folderColours[index]);
+            folder = folderParent.value(folder);
+        }
+        for (AssetStats* t: totals){
+            t->numFrames += partStats.numFrames;
+            t->duplicateFrames += partStats.duplicateFrames;
+            t->decodedBytes += partStats.decodedBytes;
+            t->compressedBytes += partStats.compressedBytes;
+        }
+        for (QSet<QRgb>* colours: colourSets){
+            colours->unite(result.colours);
+        }
+    }
+
+    for (int i = 0; i < stats.folders.size(); i++){
+        stats.folders[i].uniqueColours = folderColours.at(i).size();
+    }
+    stats.total.uniqueColours = totalColours.size();
+    return stats;
+}
+
+QJsonObject ProjectStatsToJson(const ProjectStats& stats){
+    QJsonArray parts, folders;
+    for (const AssetStats& part: stats.parts) parts.append(AssetStatsToJson(part));
+    for (const AssetStats& folder: stats.folders) folders.append(AssetStatsToJson(folder));
+
+    QJsonObject obj;
+    obj.insert("total", AssetStatsToJson(stats.total));
+    obj.insert("undoStackBytes", stats.undoStackBytes);
+    obj.insert("fileBytes", stats.fileBytes);
+    obj.insert("parts", parts);
+    obj.insert("folders", folders);
+    return obj;
+}
@@ -0,0 +1,59 @@
+#ifndef PROJECTSTATS_H
+#define PROJECTSTATS_H
+
+#include "projectmodel.h"
+
+#include <QJsonObject>
+#include <QList>
+#include <QMap>
+
+class QUndoStack;
+
+// Memory and storage accounting for a project, per sprite, per folder and in total.
+// Take a snapshot on the main thread, then compute the stats on any thread.
+
+struct AssetStats {
+    AssetRef ref {};
+    QString name {};
+    int numFrames = 0;
+    int duplicateFrames = 0; // frames identical to an earlier frame in the project
+    int uniqueColours = 0;
+    qint64 decodedBytes = 0; // the size of the images in memory
+    qint64 compressedBytes = 0; // the size of the images as PNGs (as stored in the .mqs)
+};
+
+struct ProjectStats {
+    QList<AssetStats> parts;
+    QList<AssetStats> folders; // each includes the parts in its subfolders
+    AssetStats total;
+    qint64 undoStackBytes = 0; // images held by the undo stack
+    qint64 fileBytes = 0; // the size of the .mqs (0 if it isn't saved)
+};
+
+// A copy of the project data the stats pass needs.
+// NB: QImages are implicitly shared, so this doesn't copy any pixels, and edits made
+// to the project afterwards don't affect it.
+struct ProjectStatsSnapshot {
+    struct PartData {
+        AssetRef ref;
+        AssetRef parent;
+        QString name;
+        QList<QImage> frames;
+    };
+    struct FolderData {
+        AssetRef ref;
+        AssetRef parent;
+        QString name;
+    };
+
+    QList<PartData> parts;
+    QList<FolderData> folders;
+    qint64 undoStackBytes = 0;
+    QString fileName;
+};
+
+ProjectStatsSnapshot TakeProjectStatsSnapshot(const QUndoStack* undoStack = nullptr);
+ProjectStats ComputeProjectStats(const ProjectStatsSnapshot& snapshot);
+QJsonObject ProjectStatsToJson(const ProjectStats& stats);
+
+#endif // PROJECTSTATS_H
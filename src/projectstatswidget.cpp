@@ -0,0 +1,107 @@
+#include "projectstatswidget.h"
+
+#include <QHeaderView>
+#include <QLabel>
+#include <QLocale>
+#include <QPushButton>
+#include <QThreadPool>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+namespace {
+
+enum Column {ColumnName, ColumnDecoded, ColumnCompressed, ColumnFrames, ColumnDuplicates, ColumnColours, NumColumns};
+
+// Sorts numeric columns by value rather than by their formatted text
+class StatsItem: public QTreeWidgetItem {
+public:
+    using QTreeWidgetItem::QTreeWidgetItem;
+
+    bool operator<(const QTreeWidgetItem& other) const override {
+        const int column = treeWidget() ? treeWidget()->sortColumn() : 0;
+        if (column == ColumnName) return QTreeWidgetItem::operator<(other);
+        return data(column, Qt::UserRole).toLongLong() < other.data(column, Qt::UserRole).toLongLong();
+    }
+};
+
+QString FormatBytes(qint64 bytes){
+    if (bytes < 1024) return QString("%1 B").arg(bytes);
+    if (bytes < 1024 * 1024) return QString("%1 KB").arg(bytes / 1024.0, 0, 'f', 1);
+    return QString("%1 MB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+void SetStats(QTreeWidgetItem* item, const AssetStats& stats){
+    auto set = [item](int column, qint64 value, const QString& text){
+        item->setText(column, text);
+        item->setData(column, Qt::UserRole, value);
+        item->setTextAlignment(column, Qt::AlignRight | Qt::AlignVCenter);
+    };
+    item->setText(ColumnName, stats.name);
+    set(ColumnDecoded, stats.decodedBytes, FormatBytes(stats.decodedBytes));
+    set(ColumnCompressed, stats.compressedBytes, FormatBytes(stats.compressedBytes));
+    set(ColumnFrames, stats.numFrames, QString::number(stats.numFrames));
+    set(ColumnDuplicates, stats.duplicateFrames, QString::number(stats.duplicateFrames));
+    set(ColumnColours, stats.uniqueColours, QString::number(stats.uniqueColours));
+}
+
+}
+
+void ProjectStatsTask::run(){
+    emit finished(ComputeProjectStats(mSnapshot), mGeneration);
+}
+
+ProjectStatsWidget::ProjectStatsWidget(QUndoStack* undoStack, QWidget *parent)
+    :QWidget(parent), mUndoStack(undoStack)
+{
+    qRegisterMetaType<ProjectStats>();
+
+    auto* layout = new QVBoxLayout(this);
+    mSummary = new QLabel(this);
+    mSummary->setWordWrap(true);
+    layout->addWidget(mSummary);
+
+    mTree = new QTreeWidget(this);
+    mTree->setColumnCount(NumColumns);
+    mTree->setHeaderLabels({"Asset", "Memory", "Compressed", "Frames", "Duplicates", "Colours"});
+    mTree->setSortingEnabled(true);
+    mTree->sortByColumn(ColumnDecoded, Qt::DescendingOrder);
+    mTree->header()->setSectionResizeMode(ColumnName, QHeaderView::Stretch);
+    layout->addWidget(mTree);
+
+    mRefreshButton = new QPushButton("Refresh", this);
+    connect(mRefreshButton, SIGNAL(clicked()), this, SLOT(refresh()));
+    layout->addWidget(mRefreshButton);
+}
+
+void ProjectStatsWidget::refresh(){
+    // NB: The snapshot must be taken here on the main thread, the rest is done in the background
+    auto* task = new ProjectStatsTask(TakeProjectStatsSnapshot(mUndoStack), ++mGeneration);
+    connect(task, &ProjectStatsTask::finished, this, &ProjectStatsWidget::statsFinished, Qt::QueuedConnection);
+    connect(task, &ProjectStatsTask::finished, task, &QObject::deleteLater, Qt::QueuedConnection);
+    mSummary->setText("Computing...");
+    mRefreshButton->setEnabled(false);
+    QThreadPool::globalInstance()->start(task);
+}
+
+void ProjectStatsWidget::statsFinished(ProjectStats stats, int generation){
+    if (generation != mGeneration) return;
+    mRefreshButton->setEnabled(true);
+
+    mSummary->setText(QString("%1 in memory, %2 as PNGs, %3 .mqs, %4 held by undo. %5 of %6 frames are duplicates.")
+        .arg(FormatBytes(stats.total.decodedBytes))
+        .arg(FormatBytes(stats.total.compressedBytes))
+        .arg(stats.fileBytes > 0 ? FormatBytes(stats.fileBytes) : QString("unsaved"))
+        .arg(FormatBytes(stats.undoStackBytes))
+        .arg(stats.total.duplicateFrames)
+        .arg(stats.total.numFrames));
+
+    mTree->setSortingEnabled(false);
+    mTree->clear();
+    auto* folders = new StatsItem(mTree, QStringList {"Folders"});
+    for (const AssetStats& folder: stats.folders) SetStats(new StatsItem(folders), folder);
+    auto* parts = new StatsItem(mTree, QStringList {"Sprites"});
+    for (const AssetStats& part: stats.parts) SetStats(new StatsItem(parts), part);
+    folders->setExpanded(true);
+    parts->setExpanded(true);
+    mTree->setSortingEnabled(true);
+}
@@ -0,0 +1,55 @@
+#ifndef PROJECTSTATSWIDGET_H
+#define PROJECTSTATSWIDGET_H
+
+#include "projectstats.h"
+
+#include <QMetaType>
+#include <QObject>
+#include <QRunnable>
+#include <QWidget>
+class QLabel;
+class QPushButton;
+class QTreeWidget;
+class QUndoStack;
+
+Q_DECLARE_METATYPE(ProjectStats)
+
+// Computes ProjectStats on the global thread pool and reports back with finished()
+class ProjectStatsTask: public QObject, public QRunnable {
+    Q_OBJECT
+public:
+    ProjectStatsTask(const ProjectStatsSnapshot& snapshot, int generation)
+        :mSnapshot(snapshot), mGeneration(generation){setAutoDelete(false);}
+    void run() override;
+
+signals:
+    void finished(ProjectStats stats, int generation);
+
+private:
+    ProjectStatsSnapshot mSnapshot;
+    int mGeneration;
+};
+
+// The Project Statistics panel: memory and storage per sprite and per folder
+class ProjectStatsWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit ProjectStatsWidget(QUndoStack* undoStack, QWidget *parent = nullptr);
+
+public slots:
+    void refresh(); // Recomputes the stats in the background
+
+protected slots:
+    void statsFinished(ProjectStats stats, int generation);
+
+private:
+    QUndoStack* mUndoStack = nullptr;
+    QTreeWidget* mTree = nullptr;
+    QLabel* mSummary = nullptr;
+    QPushButton* mRefreshButton = nullptr;
+    int mGeneration = 0; // Ignore the results of older refreshes
+};
+
+#endif // PROJECTSTATSWIDGET_H
@@ -3,7 +3,6 @@
 
 #include "commands.h"
 #include "partwidget.h"
-#include <QJsonDocument>
 #include <QLabel>
 #include <QStyle>
 
@@ -44,7 +43,7 @@ void PropertiesWidget::setTargetPartWidget(PartWidget* p) {
 		mTarget = p;
 		Part* part = PM()->getPart(p->partRef());
 		Q_ASSERT(part);
-		setProperties(part->properties);
+		setProperties(part);
 		QTextCursor cursor = mTextEditProperties->textCursor();
 		cursor.movePosition(QTextCursor::Start);
 		this->setEnabled(true);
@@ -64,24 +63,19 @@ void PropertiesWidget::targetPartPropertiesChanged() {
 	if (mTarget) {
 		Part* part = PM()->getPart(mTarget->partRef());
 		if (part) {
-			setProperties(part->properties);
+			setProperties(part);
 		}
 	}
 }
 
-void PropertiesWidget::setProperties(const QString& properties) {
+void PropertiesWidget::setProperties(Part* part) {
 	int cursorPos = mTextEditProperties->textCursor().position();
 	
-	QString text = properties;
-	QJsonParseError error;
-	auto doc = QJsonDocument::fromJson(("{" + properties + "}").toUtf8(), &error);
-	if (doc.isNull()) {
+	QString text = FormattedProperties(part);
+	const PropertiesCache& props = ParseProperties(part);
+	if (!props.error.isEmpty()) {
 		mTextEditProperties->setTextColor(QColor("red"));		
-		mLabelParseStatus->setText("Error: " + error.errorString());
-	}
-	else if (!doc.isObject()) {
-		mTextEditProperties->setTextColor(QColor("red"));
-		mLabelParseStatus->setText("Error: " + error.errorString());
+		mLabelParseStatus->setText("Error: " + props.error);
 	}
 	else {
 		mTextEditProperties->setTextColor(mDefaultTextEditColour);
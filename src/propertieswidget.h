@@ -6,6 +6,7 @@
 class QLabel;
 class QTextEdit;
 class PartWidget;
+struct Part;
 
 namespace Ui {
 class PropertiesWidget;
@@ -27,7 +28,7 @@ public slots:
 	void targetPartPropertiesChanged();
 
 private:
-	void setProperties(const QString& properties);
+	void setProperties(Part* part);
 
 private:
     Ui::PropertiesWidget *ui = nullptr;
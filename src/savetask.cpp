@@ -0,0 +1,16 @@
+#include "savetask.h"
+#include "trace.h"
+
+void SaveTask::run(){
+    TRACE_SCOPE("SaveTask");
+    int lastPercent = -1;
+    mSuccess = ProjectModel::WriteSnapshot(mSnapshot, mFileName, &mLog, [&](int done, int total){
+        // NB: Only signal when the number changes, there can be many thousands of images
+        const int percent = total > 0 ? 100*done/total : 100;
+        if (percent != lastPercent){
+            lastPercent = percent;
+            emit progress(percent);
+        }
+    });
+    emit finished();
+}
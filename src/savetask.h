@@ -0,0 +1,34 @@
+#ifndef SAVETASK_H
+#define SAVETASK_H
+
+#include "projectmodel.h"
+
+#include <QObject>
+#include <QRunnable>
+#include <QStringList>
+
+// Writes a ProjectSnapshot on a thread pool and reports back with progress() and finished().
+// The results can be read once it has finished.
+class SaveTask: public QObject, public QRunnable {
+    Q_OBJECT
+public:
+    SaveTask(const ProjectSnapshot& snapshot, const QString& fileName)
+        :mSnapshot(snapshot), mFileName(fileName){setAutoDelete(false);}
+    void run() override;
+
+    const QString& fileName() const {return mFileName;}
+    bool success() const {return mSuccess;}
+    const QStringList& log() const {return mLog;}
+
+signals:
+    void progress(int percent);
+    void finished();
+
+private:
+    ProjectSnapshot mSnapshot;
+    QString mFileName;
+    bool mSuccess = false;
+    QStringList mLog;
+};
+
+#endif // SAVETASK_H
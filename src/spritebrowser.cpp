@@ -0,0 +1,317 @@
+#include "spritebrowser.h"
+#include "animationclock.h"
+#include "trace.h"
+
+#include <QApplication>
+#include <QEvent>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QListView>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QSlider>
+#include <QVBoxLayout>
+#include <algorithm>
+#include <cmath>
+
+static const int CellPadding = 4;
+static const int ThumbnailCacheKB = 64*1024;
+
+static QSize CellSize(int thumbnailSize, const QFontMetrics& fontMetrics){
+    return QSize(thumbnailSize + 2*CellPadding, thumbnailSize + 3*CellPadding + fontMetrics.height());
+}
+
+SpriteBrowserModel::SpriteBrowserModel(QObject* parent):QAbstractListModel(parent){
+}
+
+bool SpriteBrowserModel::lessThan(const Entry& a, const Entry& b){
+    if (a.name != b.name) return a.name < b.name;
+    return a.ref.id < b.ref.id;
+}
+
+int SpriteBrowserModel::sortedRow(const Entry& entry) const {
+    return std::lower_bound(mEntries.begin(), mEntries.end(), entry, lessThan) - mEntries.begin();
+}
+
+AssetRef SpriteBrowserModel::assetRef(const QModelIndex& index) const {
+    if (!index.isValid() || index.row() >= mEntries.size()) return AssetRef();
+    return mEntries.at(index.row()).ref;
+}
+
+QModelIndex SpriteBrowserModel::assetIndex(AssetRef ref) const {
+    Part* part = PM()->getPart(ref);
+    if (part == nullptr) return QModelIndex();
+    const int row = sortedRow(Entry {ref, part->name});
+    if (row < mEntries.size() && mEntries.at(row).ref == ref) return index(row);
+    // NB: The name may have just changed
+    for (int i = 0; i < mEntries.size(); i++){
+        if (mEntries.at(i).ref == ref) return index(i);
+    }
+    return QModelIndex();
+}
+
+void SpriteBrowserModel::reset(){
+    TRACE_SCOPE("SpriteBrowserModel::reset");
+    beginResetModel();
+    mEntries.clear();
+    mEntries.reserve(PM()->parts.size());
+    for (auto it = PM()->parts.begin(); it != PM()->parts.end(); ++it){
+        mEntries.push_back(Entry {it.key(), it.value()->name});
+    }
+    std::sort(mEntries.begin(), mEntries.end(), lessThan);
+    endResetModel();
+}
+
+void SpriteBrowserModel::assetInserted(AssetRef ref){
+    if (ref.type != AssetType::Part) return;
+    Part* part = PM()->getPart(ref);
+    if (part == nullptr || assetIndex(ref).isValid()) return;
+
+    const Entry entry {ref, part->name};
+    const int row = sortedRow(entry);
+    beginInsertRows(QModelIndex(), row, row);
+    mEntries.insert(row, entry);
+    endInsertRows();
+}
+
+void SpriteBrowserModel::assetRemoved(AssetRef ref){
+    if (ref.type != AssetType::Part) return;
+    for (int row = 0; row < mEntries.size(); row++){
+        if (mEntries.at(row).ref == ref){
+            beginRemoveRows(QModelIndex(), row, row);
+            mEntries.remove(row);
+            endRemoveRows();
+            return;
+        }
+    }
+}
+
+void SpriteBrowserModel::assetRenamed(AssetRef ref){
+    if (ref.type != AssetType::Part) return;
+    assetRemoved(ref);
+    assetInserted(ref);
+}
+
+int SpriteBrowserModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : mEntries.size();
+}
+
+QVariant SpriteBrowserModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= mEntries.size()) return QVariant();
+    if (role == Qt::DisplayRole || role == Qt::ToolTipRole) return mEntries.at(index.row()).name;
+    return QVariant();
+}
+
+SpriteBrowserDelegate::SpriteBrowserDelegate(SpriteBrowser* browser)
+    :QStyledItemDelegate(browser), mBrowser(browser){
+}
+
+void SpriteBrowserDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const {
+    // Selection and focus, but not the text
+    QStyleOptionViewItem opt = option;
+    initStyleOption(&opt, index);
+    const QString name = opt.text;
+    opt.text.clear();
+    const QWidget* widget = opt.widget;
+    QStyle* style = widget ? widget->style() : QApplication::style();
+    style->drawControl(QStyle::CE_ItemViewItem, &opt, painter, widget);
+
+    const SpriteBrowserModel* model = static_cast<const SpriteBrowserModel*>(index.model());
+    const int size = mBrowser->thumbnailSize();
+    const QRect thumbRect(opt.rect.x() + (opt.rect.width() - size)/2, opt.rect.y() + CellPadding, size, size);
+    const QPixmap pixmap = mBrowser->thumbnail(model->assetRef(index));
+    if (!pixmap.isNull()){
+        const QPoint pos = thumbRect.center() - QPoint(pixmap.width()/2, pixmap.height()/2);
+        painter->drawPixmap(pos, pixmap);
+    }
+
+    const QRect textRect(opt.rect.x() + CellPadding, thumbRect.bottom() + CellPadding, opt.rect.width() - 2*CellPadding, opt.fontMetrics.height());
+    const QString text = opt.fontMetrics.elidedText(name, Qt::ElideMiddle, textRect.width());
+    painter->setPen(opt.palette.color(opt.state & QStyle::State_Selected ? QPalette::HighlightedText : QPalette::Text));
+    painter->drawText(textRect, Qt::AlignHCenter | Qt::AlignTop, text);
+}
+
+QSize SpriteBrowserDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex&) const {
+    return CellSize(mBrowser->thumbnailSize(), option.fontMetrics);
+}
+
+SpriteBrowser::SpriteBrowser(QWidget *parent)
+    :QWidget(parent), mThumbnails(ThumbnailCacheKB)
+{
+    auto* layout = new QVBoxLayout(this);
+
+    mModel = new SpriteBrowserModel(this);
+    mView = new QListView(this);
+    mView->setViewMode(QListView::IconMode);
+    mView->setMovement(QListView::Static);
+    mView->setResizeMode(QListView::Adjust);
+    mView->setUniformItemSizes(true); // NB: Layout only measures the first cell
+    mView->setSelectionMode(QAbstractItemView::SingleSelection);
+    mView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    mView->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    mView->setGridSize(CellSize(mThumbnailSize, mView->fontMetrics()));
+    mView->setItemDelegate(new SpriteBrowserDelegate(this));
+    mView->setModel(mModel);
+    mView->viewport()->installEventFilter(this);
+    layout->addWidget(mView);
+
+    auto* sizeLayout = new QHBoxLayout();
+    sizeLayout->addWidget(new QLabel("Size", this));
+    mSizeSlider = new QSlider(Qt::Horizontal, this);
+    mSizeSlider->setRange(16, 256);
+    mSizeSlider->setSingleStep(16);
+    mSizeSlider->setPageStep(32);
+    mSizeSlider->setValue(mThumbnailSize);
+    sizeLayout->addWidget(mSizeSlider);
+    layout->addLayout(sizeLayout);
+
+    connect(mSizeSlider, SIGNAL(valueChanged(int)), this, SLOT(setThumbnailSize(int)));
+    connect(mView, &QListView::activated, [this](const QModelIndex& index){
+        emit assetDoubleClicked(mModel->assetRef(index));
+    });
+    connect(mView->selectionModel(), &QItemSelectionModel::currentChanged, [this](const QModelIndex& index){
+        if (index.isValid()) emit assetSelected(mModel->assetRef(index));
+    });
+
+    mTime.start();
+}
+
+SpriteBrowser::~SpriteBrowser(){
+    AnimationClock::Instance()->stop(this);
+}
+
+double SpriteBrowser::animationTime() const {
+    return mTime.nsecsElapsed()*1e-9;
+}
+
+const SpriteBrowser::Preview& SpriteBrowser::preview(Part* part, AssetRef ref){
+    auto it = mPreviews.find(ref);
+    if (it == mPreviews.end()){
+        // Prefer a mode that animates, in the same order as the icon
+        QStringList modeList{ "icon", "side", "wrld" };
+        modeList.append(part->modes.keys());
+        Preview p;
+        for (const QString& mode: modeList){
+            auto mit = part->modes.find(mode);
+            if (mit == part->modes.end() || mit->frames.isEmpty()) continue;
+            if (p.mode.isEmpty()) p.mode = mode;
+            if (mit->frames.size() > 1 && mit->framesPerSecond > 0){
+                p.mode = mode;
+                break;
+            }
+        }
+        p.version = ++mVersion; // Old thumbnails of this sprite are never looked up again
+        it = mPreviews.insert(ref, p);
+    }
+    return it.value();
+}
+
+QPixmap SpriteBrowser::thumbnail(AssetRef ref){
+    Part* part = PM()->getPart(ref);
+    if (part == nullptr) return QPixmap();
+    const Preview& p = preview(part, ref);
+    if (p.mode.isEmpty()) return QPixmap();
+    const Part::Mode& mode = part->modes[p.mode];
+
+    int frame = 0;
+    if (mode.frames.size() > 1 && mode.framesPerSecond > 0){
+        frame = static_cast<qint64>(animationTime()*mode.framesPerSecond) % mode.frames.size();
+    }
+    mPainted.insert(ref, PaintedFrame {frame, mode.frames.size(), mode.framesPerSecond});
+    if (mode.frames.size() > 1 && mode.framesPerSecond > 0 && !AnimationClock::Instance()->isRunning(this)){
+        AnimationClock::Instance()->start(this, [this](double seconds){ return updateAnimation(seconds); });
+    }
+
+    const QString key = QString("%1/%2/%3/%4").arg(ref.id).arg(p.version).arg(frame).arg(mThumbnailSize);
+    if (QPixmap* cached = mThumbnails.object(key)) return *cached;
+
+    TRACE_SCOPE("SpriteBrowser::thumbnail");
+    const QImage* image = mode.frames.at(frame).data();
+    if (image == nullptr || image->isNull()) return QPixmap();
+
+    // Whole pixels for pixel art, unless it doesn't fit
+    QImage scaled;
+    const int largest = qMax(image->width(), image->height());
+    if (largest <= mThumbnailSize){
+        const int scale = mThumbnailSize / largest;
+        scaled = image->scaled(image->width()*scale, image->height()*scale, Qt::IgnoreAspectRatio, Qt::FastTransformation);
+    }
+    else {
+        scaled = image->scaled(mThumbnailSize, mThumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    QPixmap* pixmap = new QPixmap(QPixmap::fromImage(scaled));
+    const QPixmap result = *pixmap;
+    mThumbnails.insert(key, pixmap, qMax(1, pixmap->width()*pixmap->height()*4/1024));
+    return result;
+}
+
+double SpriteBrowser::updateAnimation(double){
+    TRACE_SCOPE("SpriteBrowser::updateAnimation");
+    if (!isVisible()) return -1;
+
+    // Repaint if any visible sprite has moved on a frame, and sleep until the next one does
+    const double time = animationTime();
+    bool changed = false;
+    double next = -1;
+    for (auto it = mPainted.begin(); it != mPainted.end(); ++it){
+        const PaintedFrame& painted = it.value();
+        if (painted.numFrames <= 1 || painted.framesPerSecond <= 0) continue;
+        const double frames = time*painted.framesPerSecond;
+        if (static_cast<qint64>(frames) % painted.numFrames != painted.frame) changed = true;
+        const double untilNext = (std::floor(frames) + 1 - frames)/painted.framesPerSecond;
+        if (next < 0 || untilNext < next) next = untilNext;
+    }
+    if (changed) mView->viewport()->update();
+    return next;
+}
+
+bool SpriteBrowser::eventFilter(QObject* watched, QEvent* event){
+    if (watched == mView->viewport() && event->type() == QEvent::Paint){
+        // A full repaint draws exactly the visible cells, so forget the rest
+        if (static_cast<QPaintEvent*>(event)->rect().contains(mView->viewport()->rect())) mPainted.clear();
+    }
+    return QWidget::eventFilter(watched, event);
+}
+
+void SpriteBrowser::hideEvent(QHideEvent* event){
+    AnimationClock::Instance()->stop(this);
+    mPainted.clear();
+    QWidget::hideEvent(event);
+}
+
+void SpriteBrowser::updateList(){
+    mPreviews.clear();
+    mPainted.clear();
+    mThumbnails.clear();
+    mModel->reset();
+}
+
+void SpriteBrowser::assetInserted(AssetRef ref){
+    mModel->assetInserted(ref);
+}
+
+void SpriteBrowser::assetRemoved(AssetRef ref){
+    mPreviews.remove(ref);
+    mPainted.remove(ref);
+    mModel->assetRemoved(ref);
+}
+
+void SpriteBrowser::assetRenamed(AssetRef ref){
+    mModel->assetRenamed(ref);
+}
+
+void SpriteBrowser::spriteChanged(AssetRef ref){
+    if (ref.type != AssetType::Part) return;
+    mPreviews.remove(ref);
+    const QModelIndex index = mModel->assetIndex(ref);
+    if (index.isValid()) mView->update(index);
+}
+
+void SpriteBrowser::setThumbnailSize(int size){
+    if (size == mThumbnailSize) return;
+    mThumbnailSize = size;
+    mThumbnails.clear();
+    // NB: Relayout forgets the cached cell size
+    mView->setGridSize(CellSize(mThumbnailSize, mView->fontMetrics()));
+    mView->doItemsLayout();
+}
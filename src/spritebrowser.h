@@ -0,0 +1,124 @@
+#ifndef SPRITEBROWSER_H
+#define SPRITEBROWSER_H
+
+#include "projectmodel.h"
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPixmap>
+#include <QStyledItemDelegate>
+#include <QVector>
+#include <QWidget>
+
+class QListView;
+class QSlider;
+
+// Every sprite of PM() in a flat list sorted by name, kept up to date like AssetTreeModel
+class SpriteBrowserModel: public QAbstractListModel {
+    Q_OBJECT
+public:
+    explicit SpriteBrowserModel(QObject* parent = nullptr);
+
+    AssetRef assetRef(const QModelIndex& index) const;
+    QModelIndex assetIndex(AssetRef ref) const;
+
+    void reset();
+    void assetInserted(AssetRef ref);
+    void assetRemoved(AssetRef ref);
+    void assetRenamed(AssetRef ref);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+private:
+    struct Entry {
+        AssetRef ref;
+        QString name;
+    };
+
+    static bool lessThan(const Entry& a, const Entry& b);
+    int sortedRow(const Entry& entry) const;
+
+    QVector<Entry> mEntries;
+};
+
+class SpriteBrowser;
+
+// Draws the current frame of a sprite above its name
+class SpriteBrowserDelegate: public QStyledItemDelegate {
+    Q_OBJECT
+public:
+    explicit SpriteBrowserDelegate(SpriteBrowser* browser);
+
+    void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+    QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+
+private:
+    SpriteBrowser* mBrowser = nullptr;
+};
+
+// A grid of large, animated previews of every sprite.
+// The list view only lays out and paints the cells on screen, and only those cells
+// make thumbnails, so the cost of the browser depends on the size of the window and
+// not the size of the project. Thumbnails are kept in a cache of bounded size.
+// All previews play in step off one AnimationClock client, which only wakes up when
+// a visible sprite is due to change frame.
+class SpriteBrowser : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit SpriteBrowser(QWidget *parent = nullptr);
+    ~SpriteBrowser();
+
+    int thumbnailSize() const {return mThumbnailSize;}
+
+    // The thumbnail for the current frame of ref, called by the delegate while painting
+    QPixmap thumbnail(AssetRef ref);
+
+public slots:
+    void updateList();
+    void assetInserted(AssetRef ref);
+    void assetRemoved(AssetRef ref);
+    void assetRenamed(AssetRef ref);
+    void spriteChanged(AssetRef ref); // Frames or modes have changed
+    void setThumbnailSize(int size);
+
+signals:
+    void assetDoubleClicked(AssetRef ref);
+    void assetSelected(AssetRef ref);
+
+protected:
+    void hideEvent(QHideEvent* event) override;
+    bool eventFilter(QObject* watched, QEvent* event) override;
+    double updateAnimation(double seconds);
+
+private:
+    struct Preview {
+        QString mode;
+        int version = 0;
+    };
+
+    struct PaintedFrame {
+        int frame;
+        int numFrames;
+        int framesPerSecond;
+    };
+
+    const Preview& preview(Part* part, AssetRef ref);
+    double animationTime() const;
+
+    SpriteBrowserModel* mModel = nullptr;
+    QListView* mView = nullptr;
+    QSlider* mSizeSlider = nullptr;
+    int mThumbnailSize = 64;
+
+    QElapsedTimer mTime; // Shared by all the previews, so they stay in step
+    QHash<AssetRef, Preview> mPreviews;
+    QHash<AssetRef, PaintedFrame> mPainted; // The cells drawn since the last full repaint
+    QCache<QString, QPixmap> mThumbnails; // Cost is in KB
+    int mVersion = 0;
+};
+
+#endif // SPRITEBROWSER_H
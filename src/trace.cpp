@@ -0,0 +1,116 @@
+#include "trace.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QVector>
+
+namespace {
+
+struct Event {
+    const char* name;
+    qint64 startNs;
+    qint64 endNs;
+    quint64 thread;
+};
+
+// Keeps a runaway trace from eating all the memory
+const int MaxEvents = 1 << 21;
+
+QMutex sMutex;
+QElapsedTimer sTimer;
+QVector<Event> sEvents;
+int sDroppedEvents = 0;
+QString sFileName;
+
+// Escapes a string for a json string literal
+QByteArray JsonString(const char* str){
+    QByteArray result = "\"";
+    for (const char* c = str; *c; c++){
+        if (*c == '"' || *c == '\\') result += '\\';
+        if ((unsigned char) *c >= 0x20) result += *c;
+    }
+    return result + "\"";
+}
+
+}
+
+std::atomic<bool> Trace::sEnabled(false);
+
+void Trace::start(const QString& fileName){
+    QMutexLocker lock(&sMutex);
+    sFileName = fileName;
+    sEvents.clear();
+    sDroppedEvents = 0;
+    sTimer.start();
+    sEnabled.store(true);
+}
+
+void Trace::startFromEnvironment(){
+    const QString fileName = QString::fromLocal8Bit(qgetenv("MQSPRITE_TRACE"));
+    if (!fileName.isEmpty()) start(fileName);
+}
+
+QString Trace::fileName(){
+    QMutexLocker lock(&sMutex);
+    return sFileName;
+}
+
+qint64 Trace::now(){
+    return sTimer.nsecsElapsed();
+}
+
+void Trace::addEvent(const char* name, qint64 startNs, qint64 endNs){
+    const quint64 thread = (quint64)(quintptr) QThread::currentThreadId();
+    QMutexLocker lock(&sMutex);
+    if (!sEnabled.load(std::memory_order_relaxed)) return;
+    if (sEvents.size() >= MaxEvents){
+        sDroppedEvents++;
+        return;
+    }
+    sEvents.push_back(Event {name, startNs, endNs, thread});
+}
+
+bool Trace::stop(){
+    QMutexLocker lock(&sMutex);
+    if (!sEnabled.load()) return true;
+    sEnabled.store(false);
+
+    QFile file(sFileName);
+    if (!file.open(QFile::OpenModeFlag::WriteOnly)){
+        qWarning() << "Couldn't write trace to" << sFileName;
+        return false;
+    }
+
+    // Small thread ids are easier to read in the viewer
+    QVector<quint64> threads;
+    QByteArray json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (int i = 0; i < sEvents.size(); i++){
+        const Event& e = sEvents.at(i);
+        int tid = threads.indexOf(e.thread);
+        if (tid == -1){
+            tid = threads.size();
+            threads.push_back(e.thread);
+        }
+        json += "{\"name\":" + JsonString(e.name) + ",\"ph\":\"X\",\"pid\":1,\"tid\":" + QByteArray::number(tid)
+            + ",\"ts\":" + QByteArray::number(e.startNs / 1000.0, 'f', 3)
+            + ",\"dur\":" + QByteArray::number((e.endNs - e.startNs) / 1000.0, 'f', 3) + "},\n";
+        if (json.size() > (1 << 20)){
+            file.write(json);
+            json.clear();
+        }
+    }
+    json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"MQ Sprite\"}}\n]";
+    if (sDroppedEvents > 0){
+        json += ",\"otherData\":{\"droppedEvents\":" + QByteArray::number(sDroppedEvents) + "}";
+    }
+    json += "}\n";
+    file.write(json);
+
+    sEvents.clear();
+    sEvents.squeeze();
+    return true;
+}
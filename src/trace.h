@@ -0,0 +1,45 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <atomic>
+
+// Lightweight scoped tracing, written as a Chrome Trace Event file (open it in Perfetto or chrome://tracing).
+// Wrap a hot path with TRACE_SCOPE("Name") (the name must be a string literal). When tracing is off
+// a scope only costs a relaxed atomic load.
+// Tracing is turned on by setting MQSPRITE_TRACE=<file.json>, or by Trace::start().
+
+class Trace {
+public:
+    static bool isEnabled(){return sEnabled.load(std::memory_order_relaxed);}
+
+    static void start(const QString& fileName);
+    static void startFromEnvironment(); // Starts if MQSPRITE_TRACE is set
+    static bool stop(); // Writes the trace file, returns false if it couldn't
+    static QString fileName();
+
+    static qint64 now(); // ns since the trace started
+    static void addEvent(const char* name, qint64 startNs, qint64 endNs);
+
+private:
+    static std::atomic<bool> sEnabled;
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name):mName(Trace::isEnabled() ? name : nullptr), mStartNs(mName ? Trace::now() : 0){}
+    ~TraceScope(){if (mName) Trace::addEvent(mName, mStartNs, Trace::now());}
+
+private:
+    TraceScope(const TraceScope&);
+    TraceScope& operator=(const TraceScope&);
+
+    const char* mName;
+    qint64 mStartNs;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
+
+#endif // TRACE_H
@@ -0,0 +1,72 @@
+#include "validate.h"
+#include "projectmodel.h"
+
+#include <QSet>
+#include <algorithm>
+
+QStringList ValidateProject(){
+    QStringList problems;
+
+    QSet<QString> partNames;
+    for (auto part: PM()->parts){
+        const QString name = "Sprite " + part->name;
+        if (partNames.contains(part->name)) problems.append(name + " has a duplicate name");
+        partNames.insert(part->name);
+        if (!part->parent.isNull() && !PM()->hasFolder(part->parent)) problems.append(name + " is in a missing folder");
+        if (part->modes.isEmpty()) problems.append(name + " has no modes");
+        if (!ParseProperties(part.data()).error.isEmpty()) problems.append(name + " has invalid properties (" + part->propertiesCache.error + ")");
+
+        for (auto mit = part->modes.begin(); mit != part->modes.end(); ++mit){
+            const QString modeName = name + " mode " + mit.key();
+            const Part::Mode& m = mit.value();
+            if (m.numFrames <= 0) problems.append(modeName + " has no frames");
+            if (m.framesPerSecond <= 0) problems.append(modeName + " has an invalid fps");
+            if (m.numPivots < 0 || m.numPivots > Part::MaxPivots) problems.append(modeName + " has an invalid number of pivots");
+            if (m.frames.size() != m.numFrames) problems.append(modeName + " has the wrong number of images");
+            if (m.anchor.size() != m.numFrames) problems.append(modeName + " has the wrong number of anchors");
+            for (int p = 0; p < std::min(m.numPivots, (int) Part::MaxPivots); p++){
+                if (m.pivots[p].size() != m.numFrames) problems.append(modeName + QString(" has the wrong number of pivot %1s").arg(p + 1));
+            }
+            for (int f = 0; f < m.frames.size(); f++){
+                const auto& img = m.frames.at(f);
+                if (!img || img->isNull()) problems.append(modeName + QString(" frame %1 has no image").arg(f));
+                else if (img->width() != m.width || img->height() != m.height) problems.append(modeName + QString(" frame %1 is the wrong size").arg(f));
+            }
+        }
+    }
+
+    QSet<QString> compNames;
+    for (auto comp: PM()->composites){
+        const QString name = "Composite " + comp->name;
+        if (compNames.contains(comp->name)) problems.append(name + " has a duplicate name");
+        compNames.insert(comp->name);
+        if (!comp->parent.isNull() && !PM()->hasFolder(comp->parent)) problems.append(name + " is in a missing folder");
+        if (!ParseProperties(comp.data()).error.isEmpty()) problems.append(name + " has invalid properties (" + comp->propertiesCache.error + ")");
+
+        const int numChildren = comp->children.size();
+        if (comp->root < -1 || comp->root >= numChildren) problems.append(name + " has an invalid root");
+        for (int i = 0; i < numChildren; i++){
+            const QString& childName = comp->children.at(i);
+            if (!comp->childrenMap.contains(childName)){
+                problems.append(name + " is missing child " + childName);
+                continue;
+            }
+            const Composite::Child& child = comp->childrenMap.value(childName);
+            const QString fullChildName = name + " child " + childName;
+            if (child.index != i) problems.append(fullChildName + " has the wrong index");
+            if (!PM()->hasPart(child.part)) problems.append(fullChildName + " refers to a missing sprite");
+            if (child.parent < -1 || child.parent >= numChildren) problems.append(fullChildName + " has an invalid parent");
+            for (int c: child.children){
+                if (c < 0 || c >= numChildren) problems.append(fullChildName + " has an invalid child");
+            }
+
+            // Walk up to the root to find cycles
+            int steps = 0;
+            for (int p = child.parent; p >= 0 && p < numChildren && steps <= numChildren; steps++){
+                p = comp->childrenMap.value(comp->children.at(p)).parent;
+            }
+            if (steps > numChildren) problems.append(fullChildName + " is part of a cycle");
+        }
+    }
+    return problems;
+}
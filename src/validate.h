@@ -0,0 +1,9 @@
+#ifndef VALIDATE_H
+#define VALIDATE_H
+
+#include <QStringList>
+
+// Returns the list of problems with the project in PM() (see mqsprite-cli validate)
+QStringList ValidateProject();
+
+#endif // VALIDATE_H
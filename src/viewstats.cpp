@@ -0,0 +1,100 @@
+#include "viewstats.h"
+#include "projectmodel.h"
+
+#include <QGraphicsScene>
+#include <QGraphicsView>
+#include <QFontMetrics>
+#include <QPainter>
+#include <QStringList>
+#include <QVector>
+#include <algorithm>
+
+void RollingSamples::add(float sample){
+    const unsigned count = mCount.load(std::memory_order_relaxed);
+    mSamples[count % Size] = sample;
+    mCount.store(count + 1, std::memory_order_release);
+}
+
+float RollingSamples::percentile(float p) const {
+    const unsigned count = mCount.load(std::memory_order_acquire);
+    const int n = (int) std::min<unsigned>(count, Size);
+    if (n == 0) return 0;
+
+    QVector<float> samples(n);
+    std::copy(mSamples, mSamples + n, samples.begin());
+    const int k = std::min(n - 1, std::max(0, (int)(p * (n - 1) + 0.5f)));
+    std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+    return samples.at(k);
+}
+
+ViewStats::ViewStats(){
+    mClock.start();
+}
+
+void ViewStats::beginPaint(const QRect& rect){
+    mOverlayOnly = isVisible() && mOverlayRect.contains(rect);
+    mPaintStartNs = mClock.nsecsElapsed();
+}
+
+bool ViewStats::endPaint(){
+    if (mOverlayOnly) return false;
+    const qint64 now = mClock.nsecsElapsed();
+    mPaintMs.add((now - mPaintStartNs) / 1e6f);
+    if (mInputNs >= 0){
+        mInputLatencyMs.add((now - mInputNs) / 1e6f);
+        mInputNs = -1;
+    }
+    // NB: Only the overlay is repainted, the view keeps its own update mode
+    return isVisible() && !mOverlayRect.isEmpty();
+}
+
+void ViewStats::sceneChanged(const QGraphicsScene* scene){
+    mItems = scene ? scene->items().size() : 0;
+}
+
+void ViewStats::input(){
+    if (mInputNs < 0) mInputNs = mClock.nsecsElapsed();
+}
+
+void ViewStats::animationTick(double seconds, double nextDelay){
+    // NB: Ticks that come early (e.g., when woken by a speed change) count as on time
+    if (mExpectedTickDelay >= 0){
+        mTickLateMs.add((float) std::max(0.0, (seconds - mExpectedTickDelay) * 1000));
+    }
+    mExpectedTickDelay = nextDelay;
+}
+
+void ViewStats::draw(QPainter* painter){
+    auto line = [](const char* name, const RollingSamples& samples) -> QString {
+        if (samples.isEmpty()) return QString("%1 -").arg(name);
+        return QString("%1 p50 %2 p95 %3 max %4 ms").arg(name)
+            .arg(samples.percentile(0.5f), 0, 'f', 2)
+            .arg(samples.percentile(0.95f), 0, 'f', 2)
+            .arg(samples.percentile(1.0f), 0, 'f', 2);
+    };
+    const QStringList lines {
+        line("paint", mPaintMs),
+        line("input to paint", mInputLatencyMs),
+        line("tick late", mTickLateMs),
+        QString("items %1").arg(mItems),
+    };
+
+    painter->save();
+    painter->resetTransform();
+    painter->setRenderHint(QPainter::TextAntialiasing);
+    const QFontMetrics metrics = painter->fontMetrics();
+    int width = 0;
+    for (const QString& text: lines) width = std::max(width, metrics.width(text));
+    const QRect box(4, 4, width + 8, lines.size() * metrics.height() + 6);
+    mOverlayRect = box;
+    painter->fillRect(box, QColor(0, 0, 0, 160));
+    painter->setPen(Qt::white);
+    for (int i = 0; i < lines.size(); i++){
+        painter->drawText(box.left() + 4, box.top() + 3 + metrics.ascent() + i * metrics.height(), lines.at(i));
+    }
+    painter->restore();
+}
+
+bool ViewStats::isVisible(){
+    return GlobalPreferences().showPerformanceOverlay;
+}
@@ -0,0 +1,69 @@
+#ifndef VIEWSTATS_H
+#define VIEWSTATS_H
+
+#include <QElapsedTimer>
+#include <QRect>
+#include <atomic>
+
+class QGraphicsScene;
+class QGraphicsView;
+class QPainter;
+
+// A fixed size ring of the most recent samples, for rolling percentiles.
+// Lock-free for a single writer: the count is published after the sample is written,
+// so a reader never sees a slot before it is filled.
+class RollingSamples {
+public:
+    static const int Size = 256;
+
+    void add(float sample);
+    float percentile(float p) const; // p in [0, 1], 0 if there are no samples
+    bool isEmpty() const {return mCount.load(std::memory_order_acquire) == 0;}
+
+private:
+    float mSamples[Size] = {};
+    std::atomic<unsigned> mCount {0};
+};
+
+// The performance overlay of a sprite or composite view (View > Performance Overlay)
+// Shows the paint time, the number of scene items, how late animation ticks are
+// and the time from mouse input to the next repaint.
+class ViewStats {
+public:
+    ViewStats();
+
+    // Call these around QGraphicsView::paintEvent, with the rect being painted.
+    // endPaint returns true if overlayRect() should be repainted to show the new stats.
+    void beginPaint(const QRect& rect);
+    bool endPaint();
+    QRect overlayRect() const {return mOverlayRect;}
+
+    void input(); // Call on mouse and wheel events
+
+    // Call after adding or removing items, so the items aren't counted on every paint
+    void sceneChanged(const QGraphicsScene* scene);
+
+    // Call on each animation tick with the seconds since the last tick,
+    // and the delay the view asked for until the next one
+    void animationTick(double seconds, double nextDelay);
+
+    // Draws the overlay in the top left of the view, call from drawForeground
+    void draw(QPainter* painter);
+
+    static bool isVisible();
+
+private:
+    QElapsedTimer mClock;
+    qint64 mPaintStartNs = 0;
+    qint64 mInputNs = -1; // earliest input not yet painted
+    double mExpectedTickDelay = -1;
+    int mItems = 0;
+    QRect mOverlayRect;
+    bool mOverlayOnly = false; // painting just the overlay, which isn't counted
+
+    RollingSamples mPaintMs;
+    RollingSamples mTickLateMs;
+    RollingSamples mInputLatencyMs;
+};
+
+#endif // VIEWSTATS_H
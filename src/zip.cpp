@@ -1,4 +1,5 @@
 #include "zip.h"
+#include "trace.h"
 
 #include <QDebug>
 #include <QDir>
@@ -25,6 +26,7 @@ static void printErrNo() {
 }
 
 QMap<QString, QByteArray> LoadZip(QString filename) {
+	TRACE_SCOPE("LoadZip");
 	QMap<QString, QByteArray> fileMap;
 
 	mz_zip_archive zipFile;
@@ -70,7 +72,76 @@ QMap<QString, QByteArray> LoadZip(QString filename) {
 	return fileMap;
 }
 
-QMap<QString, QString> LoadZipToFiles(QString filename) {
+QMap<QString, QByteArray> LoadZipEntries(QString filename, const QSet<QString>& names) {
+	TRACE_SCOPE("LoadZipEntries");
+	QMap<QString, QByteArray> fileMap;
+
+	mz_zip_archive zipFile;
+	memset(&zipFile, 0, sizeof(zipFile));
+	mz_bool status = mz_zip_reader_init_file(&zipFile, filename.toStdString().c_str(), 0);
+	if (!status) {
+		qWarning() << "Couldn't open " << filename << ". Reason: mz_zip_reader_init_file() failed!\n";
+		printErrNo();
+		mz_zip_reader_end(&zipFile);
+		return {};
+	}
+
+	for (const QString& name : names) {
+		const int index = mz_zip_reader_locate_file(&zipFile, name.toStdString().c_str(), nullptr, MzZipFlagCaseSensitive);
+		mz_zip_archive_file_stat fileStat;
+		if (index < 0 || !mz_zip_reader_file_stat(&zipFile, index, &fileStat)) {
+			qWarning() << "Couldn't find " << name << " in " << filename;
+			mz_zip_reader_end(&zipFile);
+			return {};
+		}
+
+		size_t numBytes = (size_t) fileStat.m_uncomp_size;
+		auto it = fileMap.insert(name, {});
+		it->fill('\0', numBytes);
+		mz_bool readStatus = mz_zip_reader_extract_to_mem(&zipFile, index, reinterpret_cast<void*>(it->data()), numBytes, 0);
+		if (!readStatus) {
+			qWarning() << "Couldn't read " << filename << ". Reason: mz_zip_reader_extract_to_mem() failed!\n";
+			printErrNo();
+			mz_zip_reader_end(&zipFile);
+			return {};
+		}
+	}
+
+	mz_zip_reader_end(&zipFile);
+	return fileMap;
+}
+
+QMap<QString, quint32> ReadZipCrcs(QString filename) {
+	TRACE_SCOPE("ReadZipCrcs");
+	QMap<QString, quint32> crcs;
+
+	mz_zip_archive zipFile;
+	memset(&zipFile, 0, sizeof(zipFile));
+	mz_bool status = mz_zip_reader_init_file(&zipFile, filename.toStdString().c_str(), 0);
+	if (!status) {
+		qWarning() << "Couldn't open " << filename << ". Reason: mz_zip_reader_init_file() failed!\n";
+		printErrNo();
+		mz_zip_reader_end(&zipFile);
+		return {};
+	}
+
+	for (int i = 0; i < (int)mz_zip_reader_get_num_files(&zipFile); i++) {
+		mz_zip_archive_file_stat fileStat;
+		if (!mz_zip_reader_file_stat(&zipFile, i, &fileStat)) {
+			qWarning() << "Couldn't read " << filename << ". Reason: mz_zip_reader_file_stat() failed!\n";
+			printErrNo();
+			mz_zip_reader_end(&zipFile);
+			return {};
+		}
+		crcs.insert(fileStat.m_filename, fileStat.m_crc32);
+	}
+
+	mz_zip_reader_end(&zipFile);
+	return crcs;
+}
+
+QMap<QString, QString> LoadZipToFiles(QString filename, QMap<QString, quint32>* crcs) {
+	TRACE_SCOPE("LoadZipToFiles");
 	const QDir tempDir{ QDir::tempPath() };
 
 	auto newFileName = [tempDir](){		
@@ -107,6 +178,7 @@ QMap<QString, QString> LoadZipToFiles(QString filename) {
 		}
 
 		fileMap.insert(fileStat.m_filename, fileName);
+		if (crcs) crcs->insert(fileStat.m_filename, fileStat.m_crc32);
 	}
 
 	mz_zip_reader_end(&zipFile);
@@ -114,6 +186,7 @@ QMap<QString, QString> LoadZipToFiles(QString filename) {
 }
 
 bool WriteZip(QString filename, const QMap<QString, QString>& filenames) {
+	TRACE_SCOPE("WriteZip");
 	// Open zip and dump into directory
 	mz_zip_archive zipArchive;
 	memset(&zipArchive, 0, sizeof(zipArchive));
@@ -3,10 +3,16 @@
 
 #include <QByteArray>
 #include <QMap>
+#include <QSet>
 #include <QString>
 
 QMap<QString, QByteArray> LoadZip(QString filename);
-QMap<QString, QString> LoadZipToFiles(QString filename);
+// Only extracts the entries in names
+QMap<QString, QByteArray> LoadZipEntries(QString filename, const QSet<QString>& names);
+// crcs (if set) is filled with the CRC-32 of each entry
+QMap<QString, QString> LoadZipToFiles(QString filename, QMap<QString, quint32>* crcs = nullptr);
+// The CRC-32 of each entry, read from the central directory without extracting anything
+QMap<QString, quint32> ReadZipCrcs(QString filename);
 bool WriteZip(QString filename, const QMap<QString, QString>& filenames);
 
 // void SaveProject(ProjectModel* pm, std::string filename);
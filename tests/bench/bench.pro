@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = tst_bench
+INCLUDEPATH += ../../src
+# NB: widgets is only needed for QUndoCommand, the benchmarks never create a window
+QT += core gui widgets testlib
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+include(../../src/core.pri)
+
+SOURCES += \
+    tst_bench.cpp
@@ -0,0 +1,208 @@
+// QBENCHMARK versions of some of the mqsprite-cli bench timings, so they can run in CI
+// (e.g., make check TESTARGS="-iterations 5")
+
+#include "assetindex.h"
+#include "commands.h"
+#include "generator.h"
+#include "imageops.h"
+#include "projectmodel.h"
+#include "zip.h"
+
+#include <QDirIterator>
+#include <QTemporaryDir>
+#include <QtTest>
+
+class Bench: public QObject {
+    Q_OBJECT
+private slots:
+    void initTestCase();
+
+    void save_data();
+    void save();
+    void load_data();
+    void load();
+    void search_data();
+    void search();
+    void exportSimple_data();
+    void exportSimple();
+    void writeZip_data();
+    void writeZip();
+    void loadZip_data();
+    void loadZip();
+    void createIcon_data();
+    void createIcon();
+    void floodFill_data();
+    void floodFill();
+    void copyPart_data();
+    void copyPart();
+
+private:
+    void addPartCounts();
+    bool generate(int numParts);
+    QMap<QString, QString> exportFiles(const QString& exportDir);
+
+    ProjectModel mModel;
+    QTemporaryDir mTempDir;
+};
+
+void Bench::initTestCase(){
+    QVERIFY(mTempDir.isValid());
+}
+
+void Bench::addPartCounts(){
+    QTest::addColumn<int>("parts");
+    QTest::newRow("10") << 10;
+    QTest::newRow("100") << 100;
+}
+
+bool Bench::generate(int numParts){
+    GeneratorSettings settings;
+    settings.numParts = numParts;
+    QStringList log;
+    const bool result = GenerateProject(settings, &log);
+    if (!result) qWarning() << log.join("\n");
+    return result;
+}
+
+// Exports the generated project and returns its files (relative path to file path)
+QMap<QString, QString> Bench::exportFiles(const QString& exportDir){
+    QMap<QString, QString> files;
+    QDir(exportDir).removeRecursively();
+    QDir().mkpath(exportDir);
+    if (!PM()->exportSimple(exportDir)) return files;
+    QDirIterator it(exportDir, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()){
+        it.next();
+        files.insert(QDir(exportDir).relativeFilePath(it.filePath()), it.filePath());
+    }
+    return files;
+}
+
+void Bench::save_data(){
+    addPartCounts();
+}
+
+void Bench::save(){
+    QFETCH(int, parts);
+    QVERIFY(generate(parts));
+    const QString fileName = mTempDir.filePath("save.mqs");
+    QBENCHMARK {
+        QVERIFY(PM()->save(fileName));
+    }
+}
+
+void Bench::load_data(){
+    addPartCounts();
+}
+
+void Bench::load(){
+    QFETCH(int, parts);
+    QVERIFY(generate(parts));
+    const QString fileName = mTempDir.filePath("load.mqs");
+    QVERIFY(PM()->save(fileName));
+    QString reason;
+    QBENCHMARK {
+        QVERIFY2(PM()->load(fileName, reason), qPrintable(reason));
+    }
+}
+
+void Bench::search_data(){
+    addPartCounts();
+}
+
+void Bench::search(){
+    QFETCH(int, parts);
+    QVERIFY(generate(parts));
+    const QStringList queries {"s", "sprite_0", "m001", "group_3", "nothing"};
+    QBENCHMARK {
+        for (const QString& query: queries) PM()->searchIndex()->find(query);
+    }
+}
+
+void Bench::exportSimple_data(){
+    addPartCounts();
+}
+
+void Bench::exportSimple(){
+    QFETCH(int, parts);
+    QVERIFY(generate(parts));
+    const QString exportDir = mTempDir.filePath("export");
+    QDir(exportDir).removeRecursively();
+    QDir().mkpath(exportDir);
+    // NB: Once, as a second export only writes the images that changed
+    QBENCHMARK_ONCE {
+        QVERIFY(PM()->exportSimple(exportDir));
+    }
+}
+
+void Bench::writeZip_data(){
+    addPartCounts();
+}
+
+void Bench::writeZip(){
+    QFETCH(int, parts);
+    QVERIFY(generate(parts));
+    const QMap<QString, QString> files = exportFiles(mTempDir.filePath("export"));
+    QVERIFY(!files.isEmpty());
+    const QString zipFile = mTempDir.filePath("write.zip");
+    QBENCHMARK {
+        QVERIFY(WriteZip(zipFile, files));
+    }
+}
+
+void Bench::loadZip_data(){
+    addPartCounts();
+}
+
+void Bench::loadZip(){
+    QFETCH(int, parts);
+    QVERIFY(generate(parts));
+    const QMap<QString, QString> files = exportFiles(mTempDir.filePath("export"));
+    const QString zipFile = mTempDir.filePath("load.zip");
+    QVERIFY(WriteZip(zipFile, files));
+    QBENCHMARK {
+        QCOMPARE(LoadZip(zipFile).size(), files.size());
+    }
+}
+
+void Bench::createIcon_data(){
+    addPartCounts();
+}
+
+void Bench::createIcon(){
+    QFETCH(int, parts);
+    QVERIFY(generate(parts));
+    QBENCHMARK {
+        for (auto part: PM()->parts) PartIconImage(part.data());
+    }
+}
+
+void Bench::floodFill_data(){
+    addPartCounts();
+}
+
+void Bench::floodFill(){
+    QFETCH(int, parts);
+    QVERIFY(generate(parts));
+    QBENCHMARK {
+        for (auto part: PM()->parts) for (const Part::Mode& m: part->modes) for (const auto& img: m.frames) FloodFill(*img, QPoint(0, 0), qRgba(255, 0, 255, 255));
+    }
+}
+
+void Bench::copyPart_data(){
+    addPartCounts();
+}
+
+void Bench::copyPart(){
+    QFETCH(int, parts);
+    QVERIFY(generate(parts));
+    const QList<AssetRef> originals = PM()->parts.keys();
+    // NB: Once, as every run adds a copy of each part
+    QBENCHMARK_ONCE {
+        for (const AssetRef& ref: originals) QVERIFY(TryCommand(new CCopyPart(ref)));
+    }
+    QCOMPARE(PM()->parts.size(), 2 * originals.size());
+}
+
+QTEST_GUILESS_MAIN(Bench)
+#include "tst_bench.moc"
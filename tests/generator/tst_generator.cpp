@@ -0,0 +1,47 @@
+// Generated projects must load and validate like a project saved by the editor
+
+#include "generator.h"
+#include "projectmodel.h"
+#include "validate.h"
+
+#include <QTemporaryDir>
+#include <QtTest>
+
+class TestGenerator: public QObject {
+    Q_OBJECT
+private slots:
+    void savedProjectValidates();
+
+private:
+    ProjectModel mModel;
+};
+
+void TestGenerator::savedProjectValidates(){
+    GeneratorSettings settings;
+    settings.numParts = 20;
+    settings.folderDepth = 2;
+    settings.numComposites = 4;
+    settings.duplicateRatio = 0.25;
+    QStringList log;
+    QVERIFY2(GenerateProject(settings, &log), qPrintable(log.join("\n")));
+
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    const QString fileName = tempDir.filePath("generated.mqs");
+    QVERIFY(PM()->save(fileName));
+    QString reason;
+    QVERIFY2(PM()->load(fileName, reason), qPrintable(reason));
+    QCOMPARE(PM()->parts.size(), settings.numParts);
+
+    for (auto part: PM()->parts){
+        const PropertiesCache& properties = ParseProperties(part.data());
+        QVERIFY2(properties.error.isEmpty(), qPrintable(part->name + ": " + properties.error));
+    }
+
+    // NB: mqsprite-cli validate exits with 0 if there are no problems
+    const QStringList problems = ValidateProject();
+    QVERIFY2(problems.isEmpty(), qPrintable(problems.join("\n")));
+}
+
+QTEST_GUILESS_MAIN(TestGenerator)
+#include "tst_generator.moc"
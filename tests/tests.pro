@@ -0,0 +1,3 @@
+# QtTest targets, run with make check
+TEMPLATE = subdirs
+SUBDIRS = bench generator